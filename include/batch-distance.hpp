@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "dataset.hpp"
+#include "quantization.hpp"
+#include "topk.hpp"
+
+using namespace std;
+
+/*
+ * Blocked (GEMM-style) distance engine.
+ *
+ * Distances between a block of queries and a block of candidates are computed
+ * through ||x||^2 + ||y||^2 - 2 x.y with precomputed norms. The dot products
+ * come from a register-blocked micro-kernel that multiplies @batch_rows
+ * queries with a panel of @batch_cols candidates, so every candidate
+ * coordinate loaded from memory is reused by several queries.
+ */
+
+// Queries per micro-kernel call.
+static constexpr uint32_t batch_rows = 4;
+
+// Candidates per panel, the micro-kernel's width.
+static constexpr uint32_t batch_cols = 32;
+
+/*
+ * A set of candidates packed for the micro-kernel.
+ *
+ * The candidates are split in panels of @batch_cols points. Inside a panel the
+ * coordinates are stored dimension-major, i.e. the first coordinate of all the
+ * panel's candidates, then the second etc. The last panel is zero padded.
+ */
+class packed_block_t {
+	// The dimension of each candidate.
+	uint32_t _n_dims;
+
+	// The ids of the candidates, in the order they were packed.
+	vector<uint32_t> _ids;
+
+	// The squared norm of each candidate.
+	vector<float> _norms;
+
+	// The leading dimensions of the partial distances, 0 if none.
+	uint32_t _n_leading;
+
+	// The squared norm of each candidate's leading dimensions.
+	vector<float> _leading_norms;
+
+	// The panels, each is (n_dims x batch_cols) floats.
+	vector<float> _panels;
+
+public:
+	/*
+	 * @brief Pack the points with the specified ids.
+	 *
+	 * @param dataset The coordinates of the points.
+	 * @param ids The ids of the points to pack.
+	 * @param n_ids The number of ids in @ids.
+	 * @param n_leading If positive, the search first computes the distances
+	 * over the first @n_leading dimensions, and abandons the candidates that
+	 * are already too far. Pays off on PCA rotated points, see pca_t.
+	 */
+	packed_block_t(const dataset_t& dataset, const uint32_t* ids, size_t n_ids,
+			uint32_t n_leading = 0);
+
+	// The number of candidates in the block.
+	size_t size() const;
+
+	// The number of panels in the block.
+	size_t n_panels() const;
+
+	// The leading dimensions of the partial distances, 0 if none.
+	uint32_t n_leading() const;
+
+	// The id of the @c_cand-th packed candidate.
+	inline uint32_t id(size_t c_cand) const { return _ids[c_cand]; }
+
+	// The squared norm of the @c_cand-th packed candidate.
+	inline float norm(size_t c_cand) const { return _norms[c_cand]; }
+
+	// The squared norm of the leading dimensions of the @c_cand-th packed
+	// candidate.
+	inline float leading_norm(size_t c_cand) const { return _leading_norms[c_cand]; }
+
+	// The coordinates of the @c_panel-th panel.
+	inline const float* panel(size_t c_panel) const
+	{
+		return _panels.data() + c_panel * _n_dims * batch_cols;
+	}
+};
+
+/*
+ * A set of candidates packed for the micro-kernel, as codes of a quantizer.
+ *
+ * Same layout as packed_block_t, with 1 (int8) or 2 (fp16) bytes per
+ * coordinate instead of 4. The norms are those of the decoded candidates.
+ */
+class quantized_block_t {
+	// The dimension of each candidate.
+	uint32_t _n_dims;
+
+	// The bytes of a code.
+	size_t _code_size;
+
+	// The ids of the candidates, in the order they were packed.
+	vector<uint32_t> _ids;
+
+	// The squared norm of each decoded candidate.
+	vector<float> _norms;
+
+	// The panels, each is (n_dims x batch_cols) codes.
+	vector<uint8_t> _panels;
+
+public:
+	/*
+	 * @brief Encode and pack the points with the specified ids.
+	 *
+	 * @param dataset The coordinates of the points.
+	 * @param quantizer How to encode them. Not none.
+	 * @param ids The ids of the points to pack.
+	 * @param n_ids The number of ids in @ids.
+	 */
+	quantized_block_t(const dataset_t& dataset, const quantizer_t& quantizer,
+			const uint32_t* ids, size_t n_ids);
+
+	// The number of candidates in the block.
+	size_t size() const;
+
+	// The number of panels in the block.
+	size_t n_panels() const;
+
+	// The id of the @c_cand-th packed candidate.
+	inline uint32_t id(size_t c_cand) const { return _ids[c_cand]; }
+
+	// The squared norm of the @c_cand-th packed candidate, decoded.
+	inline float norm(size_t c_cand) const { return _norms[c_cand]; }
+
+	// The codes of the @c_panel-th panel.
+	inline const uint8_t* panel(size_t c_panel) const
+	{
+		return _panels.data() + c_panel * _n_dims * batch_cols * _code_size;
+	}
+};
+
+/*
+ * @brief The squared norm of a coordinate vector.
+ */
+float squared_norm(const float* coords, uint32_t n_dims);
+
+/*
+ * @brief Offer every candidate of @candidates to the knn of every query.
+ *
+ * A query is never offered to itself. Candidates are processed in cache-sized
+ * tiles, and for each tile all the queries are processed before moving on.
+ * If @candidates have leading dimensions, a panel is first evaluated on them
+ * only, and the rest of the dimensions only for the candidates that are
+ * still nearer than the k-th nearest so far.
+ *
+ * @param dataset The coordinates of the queries.
+ * @param query_ids The ids of the queries.
+ * @param n_queries The number of queries in @query_ids.
+ * @param candidates The packed candidates.
+ * @param topks The knn of each query, same order as @query_ids.
+ *
+ * @return None. The nearest candidates are pushed to @topks.
+ */
+void knn_search_block(const dataset_t& dataset, const uint32_t* query_ids,
+		uint32_t n_queries, const packed_block_t& candidates, topk_t* topks);
+
+/*
+ * @brief Like knn_search_block(), with the candidates' codes.
+ *
+ * The distances are those to the decoded candidates, only approximate. The
+ * caller keeps more than k candidates and re-ranks them exactly.
+ *
+ * @param dataset The coordinates of the queries.
+ * @param quantizer The quantizer that encoded @candidates.
+ * @param query_ids The ids of the queries.
+ * @param n_queries The number of queries in @query_ids.
+ * @param candidates The packed codes of the candidates.
+ * @param topks The nearest candidates of each query, same order as @query_ids.
+ *
+ * @return None. The nearest candidates are pushed to @topks.
+ */
+void knn_search_quantized(const dataset_t& dataset, const quantizer_t& quantizer,
+		const uint32_t* query_ids, uint32_t n_queries, const quantized_block_t& candidates,
+		topk_t* topks);
+
+/*
+ * @brief Evaluate every pair of a query tile and a candidate tile of the same
+ * packed points once, and offer each distance to both points' knn.
+ *
+ * If the two tiles are the same one, each pair inside it is evaluated once and
+ * a point is never offered to itself. The caller must own the knn of both
+ * tiles, no other thread may touch them during the call.
+ *
+ * @param dataset The coordinates of the points.
+ * @param points The packed points, both queries and candidates.
+ * @param query_first The index in @points of the first query.
+ * @param n_queries The number of queries.
+ * @param cand_first The index in @points of the first candidate. A multiple
+ * of @batch_cols.
+ * @param n_cands The number of candidates.
+ * @param topks The knn of each point, same order as @points.
+ *
+ * @return None. The nearest points are pushed to @topks.
+ */
+void knn_search_symmetric(const dataset_t& dataset, const packed_block_t& points,
+		size_t query_first, size_t n_queries, size_t cand_first, size_t n_cands,
+		topk_t* topks);
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "point.hpp"
+#include "cluster.hpp"
+#include "dataset.hpp"
+#include "graph.hpp"
+#include "generator.hpp"
+
+using namespace std;
+
+struct config_t;
+
+/*
+ * The hyperparameters of the checkpoints of a run.
+ */
+struct checkpoint_params_t {
+	// Where to keep the checkpoint. Empty takes none.
+	string path;
+
+	// Continue from the checkpoint at @path, if it was taken of this run.
+	bool resume = false;
+
+	// The least seconds between two flushes of the checkpoint to disk.
+	double interval = 60.0;
+};
+
+/*
+ * The header of a checkpoint file, at its start.
+ */
+struct checkpoint_header_t {
+	// "KNNGCKP" and a NUL.
+	char magic[8];
+
+	// The layout of the file, checkpoint_t::version when written.
+	uint32_t version;
+
+	// Whether the rows have distances.
+	uint32_t with_distances;
+
+	// The run the checkpoint was taken of, see checkpoint_fingerprint().
+	uint64_t fingerprint;
+
+	// The points, the dimension of the centroids and the neighbors per point.
+	uint32_t n_points;
+	uint32_t n_dims;
+	uint32_t k;
+
+	// The partitions of the candidate generator, the clusters of the first
+	// one and of all of them.
+	uint32_t n_partitions;
+	uint32_t n_clusters;
+	uint32_t n_flags;
+
+	// Where each section starts in the file, in bytes.
+	uint64_t partitions_offset;
+	uint64_t centroids_offset;
+	uint64_t assignments_offset;
+	uint64_t flags_offset;
+	uint64_t saved_offset;
+	uint64_t rows_offset;
+	uint64_t distances_offset;
+};
+
+/*
+ * The progress of a run, in a file, so that a killed run can be resumed.
+ *
+ * Taken after the clustering, with the centroids and the cluster of each
+ * point of the first partition. Then every cluster searched marks itself
+ * done, after copying the rows of its points. The file is mapped shared, so
+ * a copy is a memcpy and survives the process being killed, and it is
+ * flushed to disk every @interval seconds in case the machine goes down.
+ *
+ * After a header page, the page-aligned sections are:
+ *  - the number of clusters of each partition, n_partitions uint32_t,
+ *  - the centroids of the first partition, (n_clusters x n_dims) floats,
+ *  - the cluster of each point in it, n_points uint32_t,
+ *  - whether each cluster of each partition is done, n_flags bytes,
+ *  - whether each row was saved, n_points bytes,
+ *  - the rows, (n_points x k) uint32_t, and their distances if any.
+ */
+class checkpoint_t {
+	// Where the checkpoint is kept.
+	string _path;
+
+	// The mapping of the whole file.
+	char* _base;
+
+	// The size of the mapping in bytes.
+	size_t _n_bytes;
+
+	// The least seconds between two flushes.
+	double _interval;
+
+	// When the checkpoint was last flushed, and who flushes it.
+	double _last_flush;
+	mutex _flush_lock;
+
+	// The first flag of each partition.
+	vector<uint32_t> _first_flags;
+
+	// Map the file at @_path, of @n_bytes or its own size if 0.
+	void _map(size_t n_bytes);
+
+	// The header, at the start of the mapping.
+	inline checkpoint_header_t& _header() const
+	{
+		return *(checkpoint_header_t*)_base;
+	}
+
+	// A section of the file.
+	template <typename item_t>
+	inline item_t* _section(uint64_t offset) const
+	{
+		return (item_t*)(_base + offset);
+	}
+
+public:
+	// The current layout of checkpoint files.
+	static constexpr uint32_t version = 1;
+
+	/*
+	 * @brief Take a checkpoint after the clustering, in a new file.
+	 *
+	 * @param params Where to keep it and how often to flush it.
+	 * @param fingerprint The run, see checkpoint_fingerprint().
+	 * @param generator The clusters, after run().
+	 * @param n_points The number of points of the run.
+	 * @param n_dims The dimension of the centroids.
+	 * @param k The number of neighbors per point.
+	 * @param with_distances Whether the knng has distances.
+	 *
+	 * @throws runtime_error If the file cannot be created.
+	 */
+	checkpoint_t(const checkpoint_params_t& params, uint64_t fingerprint,
+			const candidate_generator_t& generator, uint32_t n_points, uint32_t n_dims,
+			uint32_t k, bool with_distances);
+
+	/*
+	 * @brief Open the checkpoint of a run to resume it.
+	 *
+	 * @throws runtime_error If there is none at @params.path, it is damaged
+	 * or it was taken of another run.
+	 */
+	checkpoint_t(const checkpoint_params_t& params, uint64_t fingerprint);
+
+	checkpoint_t(const checkpoint_t&) = delete;
+	checkpoint_t& operator=(const checkpoint_t&) = delete;
+
+	~checkpoint_t();
+
+	// The number of points of the run.
+	uint32_t n_points() const;
+
+	// The number of clusters of the first partition.
+	uint32_t n_clusters() const;
+
+	// The centroids of the first partition, one per cluster.
+	const float* centroids() const;
+
+	// The cluster of each point in the first partition.
+	const uint32_t* assignments() const;
+
+	// Whether the clusters of @generator are those of the checkpoint.
+	bool matches(const candidate_generator_t& generator) const;
+
+	// Whether cluster @c_cluster of partition @c_partition is done.
+	inline bool done(uint32_t c_partition, uint32_t c_cluster) const
+	{
+		const uint8_t* flags = _section<uint8_t>(_header().flags_offset);
+
+		return __atomic_load_n(&flags[_first_flags[c_partition] + c_cluster], __ATOMIC_ACQUIRE);
+	}
+
+	/*
+	 * @brief Save the rows of the points of a cluster, then mark it done.
+	 *
+	 * Thread-safe for distinct clusters. Flushes the checkpoint if the last
+	 * flush is @interval seconds old.
+	 *
+	 * @param c_partition The partition of the cluster.
+	 * @param c_cluster The cluster, its index in the partition.
+	 * @param members The points of the cluster.
+	 * @param knng The knng, with the cluster's rows complete.
+	 *
+	 * @return None.
+	 */
+	void cluster_done(uint32_t c_partition, uint32_t c_cluster,
+			const vector<uint32_t>& members, const graph_t& knng);
+
+	/*
+	 * @brief Copy the saved rows into @knng.
+	 *
+	 * @return The number of rows restored.
+	 */
+	uint32_t restore_rows(graph_t& knng) const;
+
+	/*
+	 * @brief Flush the checkpoint to disk.
+	 *
+	 * @param wait Wait for the pages to be written.
+	 *
+	 * @return None.
+	 */
+	void flush(bool wait);
+};
+
+/*
+ * The clusters of a checkpoint, as a candidate generator, to resume a run
+ * without clustering again. Only K-Means runs resume from it, it has their
+ * single partition.
+ */
+class checkpoint_generator_t : public candidate_generator_t {
+	// The checkpoint.
+	const checkpoint_t& _checkpoint;
+
+	// The dimension of the centroids.
+	uint32_t _n_dims;
+
+	// All the points, left in their cluster.
+	vector<point_t>& _points;
+
+	// The clusters.
+	vector<cluster_t> _clusters;
+
+public:
+	// The clusters of @checkpoint, with centroids of @n_dims dimensions.
+	checkpoint_generator_t(const checkpoint_t& checkpoint, uint32_t n_dims,
+			vector<point_t>& points);
+
+	void run() override;
+
+	uint32_t n_partitions() const override;
+
+	const vector<cluster_t>& partition(uint32_t c_partition) const override;
+
+	void describe(run_report_t& report) const override;
+};
+
+/*
+ * @brief A hash of what a checkpoint of a run depends on: the dataset's
+ * size and a sample of its rows, the clustering and the search
+ * hyperparameters, and the seed.
+ *
+ * @param config The run.
+ * @param dataset The dataset of the run.
+ * @param n_dims The dimension of the centroids.
+ *
+ * @return The fingerprint.
+ */
+uint64_t checkpoint_fingerprint(const config_t& config, const dataset_t& dataset,
+		uint32_t n_dims);
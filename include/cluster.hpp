@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include "point.hpp"
+#include "dataset.hpp"
 
 using namespace std;
 
@@ -10,17 +11,16 @@ class cluster_t {
 	// The id of the cluster.
 	uint32_t _cluster_id;
 
-	// The center of the cluster.
-	point_t _centroid;
+	// The center of the cluster. Not a point of the dataset, so we own it.
+	vector<float> _centroid;
 
-	// The points in this cluster.
-	// TODO: Use a map for guaranteed O(log(n)) or
-	// unordered map with Szudzik's point hash function.
-	vector<point_t> _points;
+	// The ids of the points in this cluster. Their coordinates are the
+	// rows of the dataset with the same index.
+	vector<uint32_t> _points;
 
 public:
-	// Initialize the cluster with its id and centroid point.
-	cluster_t(uint32_t cluster_id, const point_t& centroid);
+	// Initialize the cluster with its id and centroid coordinates.
+	cluster_t(uint32_t cluster_id, const float* centroid, uint32_t n_dims);
 
 	// The id of this cluster.
 	uint32_t id() const;
@@ -28,30 +28,35 @@ public:
 	/*
 	 * Get the centroid of the cluster.
 	 */
-	const point_t& centroid() const;
+	const float* centroid() const;
 
 	/*
-	 * Change centroid to the specified one.
+	 * Change centroid to the specified coordinates.
 	 */
-	void centroid(const point_t& centroid);
+	void centroid(const float* centroid);
 
 	/*
 	 * @brief Recalculate the cluster's center and update centroid.
+	 *
+	 * @param dataset The coordinates of the cluster's points.
 	 */
-	void recenter();
+	void recenter(const dataset_t& dataset);
 
 	/*
-	 * Add a point to the cluster.
+	 * Add a point to the cluster using its id. Not thread-safe.
 	 */
-	void add_point(const point_t& point);
+	void add_point(uint32_t point_id);
 
 	/*
 	 * Remove a point from the cluster using its id.
 	 */
 	bool remove_point(uint32_t point_id);
 
-	// Get the cluster's points.
-	const vector<point_t>& points() const;
+	// Get the ids of the cluster's points.
+	const vector<uint32_t>& points() const;
+
+	// Replace the cluster's points with the @n_points ids at @point_ids.
+	void points(const uint32_t* point_ids, size_t n_points);
 
 	/*
 	 * @brief Remove all points from this cluster.
@@ -61,7 +66,7 @@ public:
 	void clear();
 
 	/*
-	 * @brief Print the cluster ID, its centroid and its member points.
+	 * @brief Print the cluster ID, its centroid and its member point IDs.
 	 *
 	 * @return None.
 	 */
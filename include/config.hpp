@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "kmeans.hpp"
+#include "nndescent.hpp"
+#include "quantization.hpp"
+#include "pq.hpp"
+#include "pca.hpp"
+#include "generator.hpp"
+#include "rpforest.hpp"
+#include "streaming.hpp"
+#include "checkpoint.hpp"
+
+using namespace std;
+
+/*
+ * The hyperparameters of a run. The defaults match the contest's setup.
+ */
+struct config_t {
+	// Where to read the dataset from.
+	string dataset_path = "datasets/dummy-data.bin";
+
+	// Where to write the knng.
+	string output_path = "output.bin";
+
+	// Where to write the JSON report of the run. Empty writes none.
+	string report_path;
+
+	// Add hardware counters (perf_event) to the report.
+	bool hardware_counters = false;
+
+	// The number of neighbors to find per point.
+	uint32_t k = 100;
+
+	// The dimension of each point in the dataset.
+	uint32_t n_dims = 100;
+
+	// How to cut the points in groups to search, see candidate_generator_t.
+	engine_t engine = engine_t::kmeans;
+
+	// The trees and leaves of the random projection forest. Its seed is
+	// @seed. Leaves are made large enough to fill the rows.
+	rpforest_params_t rpforest_params;
+
+	// The number of clusters, the iterations and the training of K-Means.
+	// Its seed is @seed.
+	kmeans_params_t kmeans_params;
+
+	// If positive, cluster hierarchically instead, until no cluster has more
+	// than @max_cluster_size points, nor fewer than @max_cluster_size /
+	// @branching but for chunks of duplicates. The number of clusters is then
+	// ignored.
+	uint32_t max_cluster_size = 0;
+
+	// The maximum number of children of a hierarchical split.
+	uint32_t branching = 16;
+
+	// If positive, no child of a hierarchical split gets more than
+	// @balance times its fair share of the points.
+	float balance = 0.0f;
+
+	// Evaluate each pair of points of a cluster once, for both of them.
+	// Only applies to the search of a single cluster per point.
+	bool symmetric = false;
+
+	// Scan the candidates of the search as int8 or fp16 codes, keep
+	// @rerank * k of them per point and re-rank those with the floats.
+	// Doesn't apply to the symmetric and multi-probe searches.
+	quantization_t quantization = quantization_t::none;
+	uint32_t rerank = 2;
+
+	// If it has subspaces, filter the candidates of the search, or of the
+	// @n_probes nearest clusters, with product quantization and re-rank
+	// @rerank * k of them. Takes over the other searches. Its seed is @seed.
+	pq_params_t pq_params;
+
+	// Rotate the points onto their principal axes and abandon candidates on
+	// their leading dimensions, optionally cluster on those only. Abandoning
+	// only applies to the plain and multi-probe searches.
+	pca_params_t pca_params;
+
+	// The number of nearest clusters to search per point.
+	uint32_t n_probes = 1;
+
+	// If positive, instead of searching @n_probes clusters per point, copy
+	// points into those of their @n_probes nearest clusters that are at
+	// most @overlap_ratio times further than their nearest cluster. Needs
+	// @n_probes > 1.
+	float overlap_ratio = 0.0f;
+
+	// The seed of every random choice, runs with the same seed match.
+	uint64_t seed = 2023;
+
+	// Refine the cluster-based knng with NN-Descent.
+	bool refine = false;
+
+	// The budget and sampling of the refinement. Its seed is @seed.
+	nndescent_params_t refine_params;
+
+	// If not empty, save the knng and its clusters as an index there, or
+	// with @append, add the points of the dataset beyond those of the index
+	// to it, in place.
+	string index_path;
+	bool append = false;
+
+	// Build out of core, one bucket of points at a time, see
+	// create_knng_streaming().
+	streaming_params_t streaming_params;
+
+	// Checkpoint the clustering and the search, to resume the run if it is
+	// killed, see checkpoint_t.
+	checkpoint_params_t checkpoint_params;
+
+	// If positive, the wall time of the whole run in seconds, writing the
+	// knng included. K-Means, the search and the refinement stop early as
+	// needed, and the best knng found by then is written.
+	double time_budget = 0.0;
+};
+
+/*
+ * @brief Parse the command line into @config.
+ *
+ * The first two positional arguments are the dataset path and the number of
+ * clusters, as always. Everything else is a "--name value" option, see
+ * print_usage().
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments, the first one is the program.
+ * @param config The configuration to update. Unspecified options are kept.
+ *
+ * @return False on --help or an invalid argument, true otherwise.
+ */
+bool parse_config(int argc, char** argv, config_t& config);
+
+/*
+ * @brief Print the command line usage of @program.
+ *
+ * @return None.
+ */
+void print_usage(ostream& outstream, const char* program);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "point.hpp"
+
+using namespace std;
+
+/*
+ * The coordinates of every point of the dataset.
+ *
+ * Stored as one row-major (n_points x n_dims) float matrix in a single 64-byte
+ * aligned allocation. The i-th row holds the coordinates of the point with
+ * id i. Points and clusters only keep ids and pointers into this matrix.
+ *
+ * Alternatively the matrix is the payload of a memory-mapped dataset file.
+ * The payload follows a 4-byte header, so it is only aligned to a float.
+ */
+class dataset_t {
+	// The number of points (rows) of the matrix.
+	uint32_t _n_points;
+
+	// The number of dimensions (columns) of each point.
+	uint32_t _n_dims;
+
+	// The start of the allocation or mapping that backs the matrix.
+	void* _base;
+
+	// The first coordinate of the first point. Within @_base.
+	float* _data;
+
+	// The size in bytes of the allocation that backs @_data.
+	size_t _n_bytes;
+
+	// Whether @_base was allocated with mmap instead of aligned_alloc.
+	bool _mapped;
+
+	// Release the memory that backs the matrix.
+	void _release();
+
+public:
+	// The alignment of the matrix in bytes. Matches a cache line.
+	static constexpr size_t alignment = 64;
+
+	// An empty dataset without any points.
+	dataset_t();
+
+	/*
+	 * @brief Allocate an uninitialized (n_points x n_dims) matrix.
+	 *
+	 * @param n_points The number of points the dataset holds.
+	 * @param n_dims The dimension of each point.
+	 * @param huge_pages Back the matrix with transparent huge pages.
+	 */
+	dataset_t(uint32_t n_points, uint32_t n_dims, bool huge_pages = false);
+
+	/*
+	 * @brief Map a dataset file in memory, without copying it.
+	 *
+	 * The file starts with the number of points (uint32_t) followed by
+	 * the (n_points x n_dims) floats. The pages are populated up front.
+	 * The mapping is read-only, the rows of the dataset must not be written.
+	 *
+	 * @param path The dataset file.
+	 * @param n_dims The dimension of each point in @path.
+	 *
+	 * @throws runtime_error If the file cannot be opened or mapped.
+	 */
+	dataset_t(const string& path, uint32_t n_dims);
+
+	dataset_t(dataset_t&& other) noexcept;
+	dataset_t& operator=(dataset_t&& other) noexcept;
+
+	// The matrix is large, never copy it by accident.
+	dataset_t(const dataset_t&) = delete;
+	dataset_t& operator=(const dataset_t&) = delete;
+
+	~dataset_t();
+
+	// The number of points in the dataset.
+	uint32_t n_points() const;
+
+	// The dimension of each point.
+	uint32_t n_dims() const;
+
+	// The coordinates of the point with id @point_id. Inline, it's hot.
+	inline const float* row(uint32_t point_id) const
+	{
+		return _data + (size_t)point_id * _n_dims;
+	}
+
+	inline float* row(uint32_t point_id)
+	{
+		return _data + (size_t)point_id * _n_dims;
+	}
+
+	// The whole matrix.
+	const float* data() const;
+	float* data();
+
+	/*
+	 * @brief Shrink the dataset to its first @n_points points.
+	 *
+	 * The memory is not released, only the number of points is reduced.
+	 *
+	 * @return None.
+	 */
+	void truncate(uint32_t n_points);
+
+	/*
+	 * @brief Create a view for each point of the dataset.
+	 *
+	 * @return The points, the i-th point has id i and refers to the i-th row.
+	 */
+	vector<point_t> points() const;
+};
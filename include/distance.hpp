@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+using namespace std;
+
+/*
+ * Squared euclidean distance kernels.
+ *
+ * The binary is built for the baseline x86-64 instruction set. Each kernel is
+ * compiled for a specific instruction set through target attributes and the
+ * fastest one the CPU supports is selected once at startup using CPUID.
+ */
+
+// Signature of a kernel: the squared L2 distance of two float vectors.
+typedef float (*l2_sqr_kernel_t)(const float* coords1, const float* coords2,
+		uint32_t n_dims);
+
+// Portable kernel, works on every CPU.
+float l2_sqr_scalar(const float* coords1, const float* coords2, uint32_t n_dims);
+
+// AVX2 and FMA kernel. Only call it if the CPU supports them.
+float l2_sqr_avx2(const float* coords1, const float* coords2, uint32_t n_dims);
+
+// AVX-512F kernel. Only call it if the CPU supports it.
+float l2_sqr_avx512(const float* coords1, const float* coords2, uint32_t n_dims);
+
+// The fastest kernel this CPU supports, selected at startup.
+extern const l2_sqr_kernel_t l2_sqr;
+
+/*
+ * @brief The instruction set of the selected kernels.
+ *
+ * @return One of "avx512", "avx2" or "scalar".
+ */
+const char* distance_isa();
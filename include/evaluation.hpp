@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "dataset.hpp"
+#include "graph.hpp"
+
+using namespace std;
+
+/*
+ * @brief Pick @n_queries distinct points to evaluate a knng on.
+ *
+ * @param n_points The number of points of the dataset.
+ * @param n_queries The number of points to pick. At most @n_points.
+ * @param seed The seed of the sampling, same seed same queries.
+ *
+ * @return The ids of the queries, ascending.
+ */
+vector<uint32_t> sample_queries(uint32_t n_points, uint32_t n_queries, uint64_t seed);
+
+/*
+ * @brief Find the exact k nearest neighbors of @queries by brute force.
+ *
+ * The dataset is packed in chunks and each chunk is searched by all the
+ * queries with the blocked distance engine. Chunks are split among the
+ * threads, each keeps its own knn of every query, merged at the end.
+ *
+ * @param dataset The coordinates of the points.
+ * @param queries The ids of the points to find their knn.
+ * @param k The number of neighbors per query.
+ *
+ * @return The (n_queries x k) ground truth, the i-th row is the knn of the
+ * i-th query, nearest first.
+ */
+graph_t exact_knn(const dataset_t& dataset, const vector<uint32_t>& queries, uint32_t k);
+
+/*
+ * @brief The recall of @knng on @queries.
+ *
+ * @param knng The graph to evaluate.
+ * @param queries The ids of the evaluated points.
+ * @param truth Their exact knn, see exact_knn(). Same k as @knng.
+ *
+ * @return The fraction of the true neighbors of the queries found in their
+ * rows of @knng, i.e. recall@k.
+ */
+double recall(const graph_t& knng, const vector<uint32_t>& queries, const graph_t& truth);
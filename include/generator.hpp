@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "point.hpp"
+#include "cluster.hpp"
+#include "dataset.hpp"
+#include "kmeans.hpp"
+#include "hkmeans.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+/*
+ * Candidate generation.
+ *
+ * A generator cuts the points in groups, and every point is searched
+ * exhaustively among the points of its group. It may cut them more than
+ * once, each cut is a partition. The knn a point gets in each partition are
+ * merged, so a neighbor separated from it by one cut can be found by another.
+ */
+
+/*
+ * The available generators.
+ */
+enum class engine_t {
+	// The clusters of K-Means, flat or hierarchical. A single partition.
+	kmeans,
+
+	// The leaves of random projection trees, a partition per tree.
+	rpforest
+};
+
+class candidate_generator_t {
+public:
+	virtual ~candidate_generator_t() = default;
+
+	// Cut the points in groups, once per partition.
+	virtual void run() = 0;
+
+	// The number of partitions. Valid after run().
+	virtual uint32_t n_partitions() const = 0;
+
+	/*
+	 * @brief The groups of the partition @c_partition. Valid after run().
+	 *
+	 * Every point is in exactly one group, the index of a group is its id
+	 * - 1. The points are left in their group of the first partition.
+	 *
+	 * @throws out_of_range If @c_partition isn't below n_partitions().
+	 */
+	virtual const vector<cluster_t>& partition(uint32_t c_partition) const = 0;
+
+	// Record how run() went, e.g. its iterations, in @report.
+	virtual void describe(run_report_t& report) const = 0;
+};
+
+/*
+ * The clusters of K-Means, or of hierarchical K-Means if they have a maximum
+ * size.
+ */
+class kmeans_generator_t : public candidate_generator_t {
+	// The maximum number of points of a cluster, 0 runs flat K-Means.
+	uint32_t _max_cluster_size;
+
+	// Flat K-Means.
+	kmeans_t _kmeans;
+
+	// Hierarchical K-Means.
+	hkmeans_t _hkmeans;
+
+public:
+	/*
+	 * @brief Initialize K-Means, see kmeans_t and hkmeans_t.
+	 *
+	 * @param params The K-Means, of each split if hierarchical.
+	 * @param max_cluster_size If positive, split clusters hierarchically
+	 * until none has more points. The number of clusters is then ignored.
+	 * @param branching The maximum number of children of a split.
+	 * @param balance The size limit of a child relative to its fair share.
+	 * @param dataset The coordinates of @points.
+	 * @param points The points to cluster, views into @dataset.
+	 */
+	kmeans_generator_t(const kmeans_params_t& params, uint32_t max_cluster_size,
+			uint32_t branching, float balance, const dataset_t& dataset,
+			vector<point_t>& points);
+
+	void run() override;
+
+	uint32_t n_partitions() const override;
+
+	const vector<cluster_t>& partition(uint32_t c_partition) const override;
+
+	void describe(run_report_t& report) const override;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/*
+ * The k nearest neighbor graph.
+ *
+ * Stored as one flat (n_points x k) uint32_t array. The i-th row holds the
+ * ids of the k nearest neighbors of the point with id i, exactly as they are
+ * written to the output file. Search threads fill their rows in place,
+ * nearest neighbor first.
+ *
+ * Optionally the graph also keeps the squared distance of every neighbor in a
+ * second (n_points x k) array, for stages that refine an existing graph.
+ */
+class graph_t {
+	// The number of points (rows) of the graph.
+	uint32_t _n_points;
+
+	// The number of neighbors per point.
+	uint32_t _k;
+
+	// The rows. Left uninitialized, the first touch is by the search threads.
+	unique_ptr<uint32_t[]> _neighbors;
+
+	// The distance of each neighbor in @_neighbors. Empty if not kept.
+	unique_ptr<float[]> _distances;
+
+public:
+	/*
+	 * @brief Allocate an uninitialized graph.
+	 *
+	 * @param n_points The number of points of the graph.
+	 * @param k The number of neighbors per point.
+	 * @param with_distances Also keep the distance of every neighbor.
+	 */
+	graph_t(uint32_t n_points, uint32_t k, bool with_distances = false);
+
+	// The number of points of the graph.
+	uint32_t n_points() const;
+
+	// The number of neighbors per point.
+	uint32_t k() const;
+
+	// The neighbors of the point with id @point_id.
+	inline uint32_t* row(uint32_t point_id)
+	{
+		return _neighbors.get() + (size_t)point_id * _k;
+	}
+
+	inline const uint32_t* row(uint32_t point_id) const
+	{
+		return _neighbors.get() + (size_t)point_id * _k;
+	}
+
+	// All the rows, one after the other.
+	const uint32_t* data() const;
+
+	// Whether the graph keeps the distance of every neighbor.
+	bool has_distances() const;
+
+	// The distances of the neighbors of @point_id. Only if has_distances().
+	inline float* distances(uint32_t point_id)
+	{
+		return _distances.get() + (size_t)point_id * _k;
+	}
+
+	inline const float* distances(uint32_t point_id) const
+	{
+		return _distances.get() + (size_t)point_id * _k;
+	}
+
+	/*
+	 * @brief Complete a row for which fewer than k neighbors were found.
+	 *
+	 * The missing slots repeat the found neighbors. If none was found they
+	 * get the ids of the points that follow @point_id, so that every id
+	 * in the graph refers to a point. Padded slots get an infinite
+	 * distance, so any real neighbor replaces them.
+	 *
+	 * @param point_id The point whose row to complete.
+	 * @param n_found The number of neighbors already in the row.
+	 *
+	 * @return None.
+	 */
+	void pad_row(uint32_t point_id, uint32_t n_found);
+};
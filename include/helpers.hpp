@@ -5,6 +5,23 @@
 #include <cstdint>
 #include <cmath>
 #include "point.hpp"
+#include "distance.hpp"
+
+/**
+ * @brief Compute the euclidean distance of two coordinate vectors.
+ *
+ * @param coords1 The coordinates of the first point.
+ * @param coords2 The coordinates of the second point.
+ * @param n_dims The number of coordinates of each point.
+ *
+ * @return The squared euclidean distance between @coords1 and @coords2.
+ * Computed by the SIMD kernel selected for this CPU, see distance.hpp.
+ */
+inline float
+euclidean_distance_aprox(const float* coords1, const float* coords2, uint32_t n_dims)
+{
+	return l2_sqr(coords1, coords2, n_dims);
+}
 
 /**
  * @brief Compute the euclidean distance of two points.
@@ -12,22 +29,10 @@
  * @param point1 The first point to use for euclidean distance.
  * @param point2 The second point to use for euclidean distance.
  *
- * @return The euclidean distance between @point1 and @point2.
+ * @return The squared euclidean distance between @point1 and @point2.
  */
-inline double
+inline float
 euclidean_distance_aprox(const point_t& point1, const point_t& point2)
 {
-	double distance = 0;
-
-	const vector<float>& coords1 = point1.coords();
-	const vector<float>& coords2 = point2.coords();
-	uint32_t n_dims = point1.coords().size();
-
-	if (n_dims == 1)
-		return abs(coords1[0] - coords2[0]);
-
-	for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
-		distance += (coords1[c_dim] - coords2[c_dim]) * (coords1[c_dim] - coords2[c_dim]);
-
-	return distance;
+	return euclidean_distance_aprox(point1.coords(), point2.coords(), point1.n_dims());
 }
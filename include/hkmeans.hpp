@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "point.hpp"
+#include "cluster.hpp"
+#include "dataset.hpp"
+#include "kmeans.hpp"
+
+using namespace std;
+
+/*
+ * Hierarchical K-Means with a bounded leaf size.
+ *
+ * Recursively splits the points with kmeans_t until no cluster has more than
+ * @_max_size points. The leaves are the resulting clusters, so their sizes
+ * don't depend on how the data is distributed. A child of a split smaller
+ * than @_min_size folds into its nearest sibling, so that no leaf is a few
+ * outliers.
+ */
+class hkmeans_t {
+	// The maximum number of points of a leaf.
+	uint32_t _max_size;
+
+	// The minimum number of points of a child of a split, @_max_size /
+	// @_branching.
+	uint32_t _min_size;
+
+	// The maximum number of children of a split.
+	uint32_t _branching;
+
+	// If positive, no child of a split gets more than @_balance times its
+	// fair share of the points.
+	float _balance;
+
+	// The K-Means of each split. The number of clusters is set per split.
+	kmeans_params_t _params;
+
+	// The coordinates of the points used in the clustering.
+	const dataset_t& _dataset;
+
+	// All the points used in the clustering.
+	vector<point_t>& _points;
+
+	// The leaves.
+	vector<cluster_t> _clusters;
+
+	// The K-Means runs of the splits, and their iterations.
+	uint32_t _n_splits = 0;
+	uint32_t _iterations = 0;
+
+	// Split the points with ids @members in two or more children.
+	vector<vector<uint32_t>> _split(const vector<uint32_t>& members);
+
+	// Move points out of the children that exceed their share.
+	void _rebalance(vector<vector<uint32_t>>& children,
+			const vector<cluster_t>& clusters) const;
+
+	// Fold the children that are too small into their nearest sibling.
+	void _fold(vector<vector<uint32_t>>& children,
+			const vector<cluster_t>& clusters) const;
+
+public:
+	/*
+	 * @brief Initialize hierarchical K-Means.
+	 *
+	 * @param max_size The maximum number of points of a leaf.
+	 * @param branching The maximum number of children of a split.
+	 * @param balance The size limit of a child relative to its fair share.
+	 * 0 disables the limit.
+	 * @param params The K-Means of each split, its number of clusters is
+	 * ignored.
+	 * @param dataset The coordinates of @points.
+	 * @param points The points to cluster, views into @dataset.
+	 */
+	hkmeans_t(uint32_t max_size, uint32_t branching, float balance,
+			const kmeans_params_t& params, const dataset_t& dataset,
+			vector<point_t>& points);
+
+	// Split until every cluster is small enough. Each point gets its leaf.
+	void run();
+
+	// Get the leaves. Valid after run(). Their index is their id - 1.
+	const vector<cluster_t>& clusters() const;
+
+	// The K-Means runs of run(), one per split.
+	uint32_t n_splits() const;
+
+	// The K-Means iterations of all the splits of run().
+	uint32_t iterations() const;
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "dataset.hpp"
+#include "graph.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+/*
+ * The header of an index file, at its start.
+ */
+struct index_header_t {
+	// "KNNGIDX" and a NUL.
+	char magic[8];
+
+	// The layout of the file, index_t::version when written.
+	uint32_t version;
+
+	// The dimension of each point and the neighbors per point.
+	uint32_t n_dims;
+	uint32_t k;
+
+	// The number of clusters, fixed when the index is created.
+	uint32_t n_clusters;
+
+	// The points in the index, and those the point sections have room for.
+	uint32_t n_points;
+	uint32_t capacity;
+
+	// Where each section starts in the file, in bytes.
+	uint64_t centroids_offset;
+	uint64_t sizes_offset;
+	uint64_t assignments_offset;
+	uint64_t neighbors_offset;
+	uint64_t distances_offset;
+};
+
+/*
+ * A knng saved with its clusters, so that points can be added to it later.
+ *
+ * The file is memory-mapped, read-only or shared. A header page is followed
+ * by page-aligned sections:
+ *  - the centroid of each cluster, (n_clusters x n_dims) floats,
+ *  - the number of points of each cluster, n_clusters uint64_t,
+ *  - the cluster of each point, capacity uint32_t,
+ *  - the neighbors of each point, (capacity x k) uint32_t, nearest first,
+ *  - their squared distances, (capacity x k) floats.
+ *
+ * The point sections have room for @capacity points, the unused room is a
+ * hole in the file. The header's @n_points is updated last, a save cut short
+ * by a crash leaves an index of no points. Growing is atomic, see reserve(),
+ * but appending is not, see append_to_index().
+ */
+class index_t {
+	// Where the index is stored.
+	string _path;
+
+	// The mapping of the whole file.
+	char* _base;
+
+	// The size of the mapping in bytes.
+	size_t _n_bytes;
+
+	// Whether the mapping is shared and writable.
+	bool _writable;
+
+	// Map the file at @_path.
+	void _map();
+
+	// Release the mapping.
+	void _unmap();
+
+	// The header, at the start of the mapping.
+	inline const index_header_t& _header() const
+	{
+		return *(const index_header_t*)_base;
+	}
+
+public:
+	// The current layout of index files.
+	static constexpr uint32_t version = 1;
+
+	/*
+	 * @brief Map an index file.
+	 *
+	 * @param path The index file.
+	 * @param writable Map it shared and writable, to append points.
+	 *
+	 * @throws runtime_error If the file cannot be mapped, isn't an index or
+	 * has another version.
+	 */
+	index_t(const string& path, bool writable = false);
+
+	index_t(index_t&& other) noexcept;
+
+	// The mapping is unique, never copy it.
+	index_t(const index_t&) = delete;
+	index_t& operator=(const index_t&) = delete;
+
+	~index_t();
+
+	/*
+	 * @brief Create an empty index file, with room for @capacity points.
+	 *
+	 * @throws runtime_error If the file cannot be created.
+	 *
+	 * @return The index, writable. Centroids and sizes are zero.
+	 */
+	static index_t create(const string& path, uint32_t n_dims, uint32_t k,
+			uint32_t n_clusters, uint32_t capacity);
+
+	// The dimension of each point.
+	uint32_t n_dims() const;
+
+	// The number of neighbors per point.
+	uint32_t k() const;
+
+	// The number of clusters.
+	uint32_t n_clusters() const;
+
+	// The number of points in the index.
+	uint32_t n_points() const;
+
+	// The points the index has room for.
+	uint32_t capacity() const;
+
+	// The centroid of cluster @c_cluster.
+	inline float* centroid(uint32_t c_cluster)
+	{
+		return (float*)(_base + _header().centroids_offset) + (size_t)c_cluster * n_dims();
+	}
+
+	inline const float* centroid(uint32_t c_cluster) const
+	{
+		return (const float*)(_base + _header().centroids_offset)
+			+ (size_t)c_cluster * n_dims();
+	}
+
+	// The number of points of each cluster.
+	inline uint64_t* sizes()
+	{
+		return (uint64_t*)(_base + _header().sizes_offset);
+	}
+
+	// The cluster of each point.
+	inline uint32_t* assignments()
+	{
+		return (uint32_t*)(_base + _header().assignments_offset);
+	}
+
+	inline const uint32_t* assignments() const
+	{
+		return (const uint32_t*)(_base + _header().assignments_offset);
+	}
+
+	// The neighbors of the point with id @point_id.
+	inline uint32_t* row(uint32_t point_id)
+	{
+		return (uint32_t*)(_base + _header().neighbors_offset) + (size_t)point_id * k();
+	}
+
+	inline const uint32_t* row(uint32_t point_id) const
+	{
+		return (const uint32_t*)(_base + _header().neighbors_offset) + (size_t)point_id * k();
+	}
+
+	// The squared distances of the neighbors of @point_id.
+	inline float* distances(uint32_t point_id)
+	{
+		return (float*)(_base + _header().distances_offset) + (size_t)point_id * k();
+	}
+
+	/*
+	 * @brief Make room for @n_points points.
+	 *
+	 * If the capacity is too small, the file is rewritten with twice as
+	 * much, or @n_points if more, and replaces the old one.
+	 *
+	 * @throws runtime_error If the file cannot be rewritten.
+	 *
+	 * @return None.
+	 */
+	void reserve(uint32_t n_points);
+
+	/*
+	 * @brief Set the number of points to @n_points and flush the file.
+	 *
+	 * The points' sections must be written first.
+	 *
+	 * @return None.
+	 */
+	void commit(uint32_t n_points);
+};
+
+/*
+ * @brief Save a knng and its clusters as an index.
+ *
+ * The centroids are the means of the clusters' points and the distances
+ * of the neighbors are recomputed, so the knng needs neither.
+ *
+ * @param path Where to write the index.
+ * @param dataset The coordinates of the points.
+ * @param knng The knng of the points.
+ * @param assignments The cluster of each point.
+ * @param n_clusters The number of clusters.
+ *
+ * @throws runtime_error If the index cannot be written.
+ *
+ * @return None.
+ */
+void save_index(const string& path, const dataset_t& dataset, const graph_t& knng,
+		const vector<uint32_t>& assignments, uint32_t n_clusters);
+
+/*
+ * @brief Add the points of @dataset beyond those of @index to it.
+ *
+ * The dataset is the one of the index with a batch of points appended.
+ * Every new point goes to its nearest cluster and is searched among the
+ * points of that cluster, old and new. The old points of the cluster are
+ * searched among the new ones only, and their rows are updated if any is
+ * nearer. So a batch costs about its share of a full build, the rest of the
+ * index is never read but for the clusters of the points.
+ *
+ * The centroids, the cluster sizes and the rows of the old points are
+ * updated in place, before the new points are committed. An append cut
+ * short by a crash leaves the index inconsistent, keep a copy of the file
+ * to recover from.
+ *
+ * @param index The index, writable.
+ * @param dataset The coordinates of the points, old and new.
+ * @param report If not NULL, where to record the clustering and search
+ * phases.
+ *
+ * @throws runtime_error If the dataset doesn't extend the index, or the
+ * index cannot grow.
+ *
+ * @return None. The index holds every point of @dataset.
+ */
+void append_to_index(index_t& index, const dataset_t& dataset, run_report_t* report = NULL);
+
+/*
+ * @brief Write the knng of @index in the format of write_knng().
+ *
+ * @throws runtime_error If the file cannot be written.
+ *
+ * @return None.
+ */
+void export_knng(const index_t& index, const string& path);
@@ -1,28 +1,61 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include "point.hpp"
+#include "dataset.hpp"
+#include "graph.hpp"
 
 using namespace std;
 
 /*
- * @brief Reading binary data vectors. Raw data stored as a (N x 100) float.
+ * @brief Reading binary data vectors. Raw data stored as a (N x n_dims) float.
+ *
+ * The file is memory-mapped and its payload is used as the dataset matrix,
+ * without any copy. If mapping fails, the payload is read into an allocated
+ * matrix instead.
  *
  * @param path Path to the file that contains the dataset in binary format.
  * @param n_dims The dimension of each point in @path to read.
+ * @param huge_pages Back an allocated matrix with transparent huge pages.
  *
- * @return The points
+ * @return The dataset. The i-th row is the i-th point in @path.
  */
-vector<point_t> read_dataset(const string& path, const uint32_t& n_dims);
+dataset_t read_dataset(const string& path, const uint32_t& n_dims,
+		bool huge_pages = true);
 
 /*
  * @brief Save knng in binary format (uint32_t) with the specified name.
  *
- * @param knng Is a (n_points * 100) shape 2-D vector. It stores the i-th
- * point's k nearest neighbors. All indexes refer to the point with the same id.
- * @param k The number of nearest neighbors per point.
+ * The file is sized up front and the rows are written by all the threads,
+ * each one with pwrite on its own chunk of the file.
+ *
+ * @param knng The graph. Its flat (n_points x k) array is the file's content.
  * @param path Where to write the knng.
  *
+ * @throws runtime_error If the file cannot be created or written.
+ *
  * @return None.
  */
-void write_knng(const vector<vector<uint32_t>>& knng, uint32_t k, string path);
+void write_knng(const graph_t& knng, const string& path);
+
+/*
+ * @brief Like write_knng(), with the flat (n_points x k) array @rows, e.g.
+ * a section of an index.
+ *
+ * @throws runtime_error If the file cannot be created or written.
+ *
+ * @return None.
+ */
+void write_knng(const uint32_t* rows, uint32_t n_points, uint32_t k, const string& path);
+
+/*
+ * @brief Read a knng saved by write_knng().
+ *
+ * @param path Where to read the knng from.
+ * @param n_points The number of points of the graph.
+ * @param k The number of neighbors per point.
+ *
+ * @throws runtime_error If the file cannot be read or its size doesn't match.
+ *
+ * @return The graph, without distances.
+ */
+graph_t read_knng(const string& path, uint32_t n_points, uint32_t k);
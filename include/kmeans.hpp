@@ -1,19 +1,64 @@
 #pragma once
 
 #include <cstdint>
+#include <random>
 #include <vector>
 #include "helpers.hpp"
 #include "point.hpp"
 #include "cluster.hpp"
+#include "dataset.hpp"
 
 using namespace std;
 
-class kmeans_t {
+/*
+ * How the initial centroids are picked.
+ */
+enum class kmeans_init_t {
+	// Distinct points picked uniformly at random.
+	random,
+
+	// Points picked with probability proportional to their squared distance
+	// to the nearest centroid so far.
+	plusplus
+};
+
+/*
+ * The hyperparameters of K-Means.
+ */
+struct kmeans_params_t {
 	// The number of clusters.
-	uint32_t _n_clusters;
+	uint32_t n_clusters = 2;
 
 	// The number of iterations to perform. May converge faster.
-	uint32_t _n_iters;
+	uint32_t n_iters = 100;
+
+	// Use Hamerly's bounds to skip distance computations.
+	bool accelerated = false;
+
+	// How the initial centroids are picked.
+	kmeans_init_t init = kmeans_init_t::random;
+
+	// Train the centroids on this many sampled points. 0 uses all of them.
+	uint32_t sample_size = 0;
+
+	// Train with mini-batches of this many points, one per iteration.
+	// 0 runs full iterations.
+	uint32_t batch_size = 0;
+
+	// The seed of the initialization and sampling.
+	uint64_t seed = 2023;
+
+	// No iteration but the first starts after this time, as returned by
+	// omp_get_wtime(). 0 is no deadline.
+	double deadline = 0.0;
+};
+
+class kmeans_t {
+	// The hyperparameters.
+	kmeans_params_t _params;
+
+	// The coordinates of the points used in the clustering.
+	const dataset_t& _dataset;
 
 	// All the points used in the clustering.
 	vector<point_t>& _points;
@@ -21,13 +66,46 @@ class kmeans_t {
 	// The clusters.
 	vector<cluster_t> _clusters;
 
+	// The iterations run() performed.
+	uint32_t _iterations = 0;
+
+	// The points that changed cluster in each iteration, if not mini-batch.
+	vector<uint64_t> _moved;
+
+	// Rebuild the clusters from the points' assignments and recenter them.
+	void _update(const vector<point_t>& points);
+
+	// Whether iteration @c_iter must not start, the deadline has passed.
+	// The first one always runs, so that every point has a cluster.
+	bool _out_of_time(uint32_t c_iter) const;
+
+	// The iterations of run() over the training points.
+	void _run_lloyd(vector<point_t>& points);
+
+	// The iterations of run(), accelerated with Hamerly's bounds.
+	void _run_hamerly(vector<point_t>& points);
+
+	// The iterations of run(), one random mini-batch each.
+	void _run_minibatch(vector<point_t>& points, mt19937_64& rng);
+
 public:
-	// Initialize with the number of clusters and number of iterations.
-	kmeans_t(uint32_t n_clusters, uint32_t n_iters, vector<point_t>& points);
+	// Initialize with the number of clusters, iterations and how to train.
+	kmeans_t(const kmeans_params_t& params, const dataset_t& dataset,
+			vector<point_t>& points);
 
 	// Perform k-means clustering.
 	void run();
 
+	// Get the clusters. Valid after run().
+	const vector<cluster_t>& clusters() const;
+
+	// The iterations performed by run().
+	uint32_t iterations() const;
+
+	// The points that changed cluster in each iteration of run(). Empty for
+	// mini-batch K-Means.
+	const vector<uint64_t>& moved() const;
+
 	// Print the clusters.
 	void print_clusters(ostream& outstream, string indent = "") const;
 
@@ -1,24 +1,36 @@
 #include <cstdint>
 #include <vector>
 #include "point.hpp"
+#include "dataset.hpp"
+#include "graph.hpp"
+#include "config.hpp"
+#include "profile.hpp"
 
 using namespace std;
 
 /*
  * @brief Calculate the knng of the @points.
  *
- * The knng is stored as a vector where each item is the point with ID the
- * same as its index. Its nearest neighbors are stored as a nested vector.
+ * The knng is stored as a flat (n_points x k) array where the i-th row holds
+ * the nearest neighbors of the point with ID i.
  *
- * @param points The points to use for the knng construction.
- * @param k The dimension each point lives in.
- * @param n_clusters The number of clusters to create.
- * @param n_iters The maximum number of iterations to perform.
+ * @param dataset The coordinates of @points.
+ * @param points The points to use for the knng construction. Each is left in
+ * its cluster, unless the clustering is on PCA projections.
+ * @param config The number of neighbors, clusters and iterations, and
+ * whether to refine the knng with NN-Descent after the cluster search. On a
+ * time budget, every row is first given some neighbors and each phase stops
+ * in time to leave the rest of the budget for writing the knng.
+ * @param report If not NULL, where to record the clustering, search and
+ * refinement phases, the K-Means iterations and the cluster sizes.
+ * @param assignments If not NULL, set to the cluster of each point, an index
+ * into the clusters of the first partition, e.g. to save an index.
  *
- * @return Each points nearest neighbors. Indexes of the top level vector
- * correspond to the index of each point. uint32_t numbers are the indexes
- * of each point's nearest neighbors. The index of each point correspond
- * to the order in which they were read from the dataset file.
+ * @return Each points nearest neighbors. Rows of the graph correspond to the
+ * index of each point. uint32_t numbers are the indexes of each point's
+ * nearest neighbors. The index of each point correspond to the order in
+ * which they were read from the dataset file.
  */
-vector<vector<uint32_t>> create_knng(vector<point_t>& points, uint32_t k,
-		uint32_t n_clusters, uint32_t n_iters);
+graph_t create_knng(const dataset_t& dataset, vector<point_t>& points,
+		const config_t& config, run_report_t* report = NULL,
+		vector<uint32_t>* assignments = NULL);
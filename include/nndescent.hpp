@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include "dataset.hpp"
+#include "graph.hpp"
+
+using namespace std;
+
+/*
+ * The hyperparameters of the NN-Descent refinement.
+ */
+struct nndescent_params_t {
+	// The maximum number of iterations.
+	uint32_t n_iters = 10;
+
+	// The fraction of k neighbors sampled per point in each iteration.
+	float sample_rate = 0.5f;
+
+	// Random points joined per point in each iteration, besides its neighbors.
+	uint32_t n_random = 4;
+
+	// Stop once fewer than delta * n_points * k neighbors change.
+	float delta = 0.001f;
+
+	// The wall time the refinement may use in seconds. 0 is unlimited.
+	double time_budget = 0.0;
+
+	// The seed of the sampling, runs with the same seed are reproducible.
+	uint64_t seed = 2023;
+};
+
+/*
+ * @brief Refine a knng with NN-Descent ("a neighbor of a neighbor is likely a
+ * neighbor").
+ *
+ * Starts from @knng as produced by the cluster search. Every iteration, each
+ * point joins its sampled new neighbors with each other and with its old
+ * neighbors, in both directions (reverse neighbors included). Only pairs with
+ * at least one neighbor that is new since the last iteration are evaluated.
+ * Points are joined in parallel and rows are updated under per-row locks.
+ *
+ * @param dataset The coordinates of the points.
+ * @param knng The graph to refine. It must keep distances, rows sorted
+ * nearest first. Stays sorted.
+ * @param params The iteration and time budget, and the sampling.
+ *
+ * @return The number of iterations performed.
+ */
+uint32_t nndescent_refine(const dataset_t& dataset, graph_t& knng,
+		const nndescent_params_t& params);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "dataset.hpp"
+
+using namespace std;
+
+/*
+ * Principal component analysis (PCA) of the points.
+ *
+ * The points are centered on their mean and rotated onto the eigenvectors of
+ * their covariance, largest variance first. A rotation preserves distances,
+ * so the knng of the rotated points is the knng of the points. But the first
+ * coordinates then hold most of the variance, so a partial distance over
+ * them is close to the full one, and a lower bound of it.
+ */
+
+/*
+ * The hyperparameters of the PCA.
+ */
+struct pca_params_t {
+	// Rotate the points onto their principal axes.
+	bool enabled = false;
+
+	// The leading dimensions of the partial distances. 0 picks the fewest
+	// that explain @variance of the variance. More than half of the
+	// dimensions disables the partial distances.
+	uint32_t n_leading = 0;
+
+	// The fraction of the variance the leading dimensions explain, if
+	// @n_leading is 0.
+	float variance = 0.99f;
+
+	// Cluster the points on their leading dimensions only.
+	bool clustering = false;
+};
+
+class pca_t {
+	// The dimension of each point.
+	uint32_t _n_dims;
+
+	// The mean of the points.
+	vector<float> _mean;
+
+	// The principal axes, (n_dims x n_dims). Coordinate d of every axis is
+	// at d * n_dims, so that rotating a point is a sum of scaled rows.
+	vector<float> _axes;
+
+	// The variance along each axis, in decreasing order.
+	vector<float> _variances;
+
+public:
+	/*
+	 * @brief Find the principal axes of the points of @dataset.
+	 *
+	 * The covariance is accumulated in parallel and diagonalized with
+	 * Jacobi rotations.
+	 *
+	 * @param dataset The points to analyze.
+	 */
+	pca_t(const dataset_t& dataset);
+
+	// The variance along each axis, in decreasing order.
+	const vector<float>& variances() const;
+
+	/*
+	 * @brief The fewest leading axes that explain @fraction of the variance.
+	 *
+	 * @return Between 1 and n_dims.
+	 */
+	uint32_t leading_dims(float fraction) const;
+
+	/*
+	 * @brief Rotate the coordinates @coords onto the first @n_axes axes.
+	 *
+	 * @param coords The point to rotate, n_dims floats.
+	 * @param rotated Where to write its first @n_axes rotated coordinates.
+	 * @param n_axes How many axes to keep, at most n_dims.
+	 *
+	 * @return None.
+	 */
+	void rotate(const float* coords, float* rotated, uint32_t n_axes) const;
+
+	/*
+	 * @brief Rotate every point of @dataset onto the first @n_axes axes.
+	 *
+	 * @return The (n_points x n_axes) rotated dataset, same ids.
+	 */
+	dataset_t rotate(const dataset_t& dataset, uint32_t n_axes) const;
+};
@@ -8,24 +8,34 @@ using namespace std;
 
 class cluster_t;
 
+/*
+ * A view of a point of the dataset.
+ *
+ * The point does not own its coordinates. They live in the dataset matrix,
+ * see dataset_t, and the id of the point is the index of its row.
+ */
 class point_t {
-	// The identifier of the point.
+	// The identifier of the point. Also its row in the dataset.
 	uint32_t _id;
 
+	// The n-dimensional space the point lives.
+	uint32_t _n_dims;
+
 	// Pointer to the cluster the point belongs.
 	const cluster_t* _cluster;
 
 	// The coordinates of the point in the n-dimensions.
-	vector<float> _coordinates;
+	const float* _coordinates;
 
 public:
 	/*
 	 * @brief Initialize the point with an ID and its coordinates.
 	 *
 	 * @param id The id of the point. Should be unique.
-	 * @param coordinates Where the point lives, its location.
+	 * @param coordinates Where the point lives, its location. Not copied.
+	 * @param n_dims The number of coordinates.
 	 */
-	point_t(const uint32_t& id, const vector<float>& coordinates);
+	point_t(const uint32_t& id, const float* coordinates, uint32_t n_dims);
 
 	/*
 	 * @brief Get the ID of the point.
@@ -53,9 +63,16 @@ public:
 	/*
 	 * @brief Get the coordinates of the point.
 	 *
-	 * @return None.
+	 * @return Pointer to the point's row in the dataset.
+	 */
+	const float* coords() const;
+
+	/*
+	 * @brief Get the dimension of the point.
+	 *
+	 * @return The number of coordinates of the point.
 	 */
-	const vector<float>& coords() const;
+	uint32_t n_dims() const;
 
 	/*
 	 * @brief Print the point to the specified stream.
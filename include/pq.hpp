@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "dataset.hpp"
+#include "topk.hpp"
+
+using namespace std;
+
+/*
+ * Product quantization (PQ) of the points, to filter candidates.
+ *
+ * The dimensions are cut in @n_subspaces contiguous groups. In each group a
+ * codebook of 2^@n_bits centroids is trained with K-Means on a sample of the
+ * points, and a point is encoded by its nearest centroid in every group. The
+ * distance of a query to a code is then approximated by a sum of lookups in a
+ * table of the query's distances to every centroid (asymmetric distance
+ * computation, ADC).
+ *
+ * With 4 bits a table row fits in a SIMD register. The codes of 32 points are
+ * interleaved so that a single shuffle looks up a group for all of them, and
+ * the table is quantized to bytes ("fast-scan").
+ */
+
+/*
+ * The hyperparameters of product quantization.
+ */
+struct pq_params_t {
+	// The number of groups of dimensions, the bytes of a code with 8 bits,
+	// half of them with 4 bits. 0 disables product quantization.
+	uint32_t n_subspaces = 0;
+
+	// The bits of a group's code, 4 or 8.
+	uint32_t n_bits = 4;
+
+	// The points the codebooks are trained on.
+	uint32_t sample_size = 32768;
+
+	// The iterations of the K-Means of each codebook.
+	uint32_t n_iters = 10;
+
+	// The seed of the sampling and of K-Means.
+	uint64_t seed = 2023;
+};
+
+/*
+ * The distances of a query to every centroid of every group, ready for the
+ * scan.
+ */
+struct pq_table_t {
+	// (n_subspaces x n_centroids) distances, 8 bits only.
+	vector<float> distances;
+
+	// (n_subspaces x 16) distances quantized to bytes, 4 bits only.
+	vector<uint8_t> quantized;
+};
+
+/*
+ * The codebooks of product quantization.
+ */
+class pq_t {
+	// The hyperparameters.
+	pq_params_t _params;
+
+	// The dimension of each point.
+	uint32_t _n_dims;
+
+	// The centroids per group, 2^n_bits.
+	uint32_t _n_centroids;
+
+	// The first dimension of each group, and n_dims last.
+	vector<uint32_t> _bounds;
+
+	// The centroids of each group, (n_centroids x its dimensions), one group
+	// after the other. The codebook of group m starts at n_centroids * bounds[m].
+	vector<float> _codebooks;
+
+public:
+	/*
+	 * @brief Train the codebooks on a sample of the points of @dataset.
+	 *
+	 * @param dataset The points to encode.
+	 * @param params The groups, bits and training of the codebooks.
+	 */
+	pq_t(const dataset_t& dataset, const pq_params_t& params);
+
+	// The number of groups.
+	uint32_t n_subspaces() const;
+
+	// The bits of a group's code.
+	uint32_t n_bits() const;
+
+	/*
+	 * @brief Encode the coordinates @coords.
+	 *
+	 * @param coords The point to encode.
+	 * @param codes Where to write the index of its nearest centroid in every
+	 * group, one byte each.
+	 *
+	 * @return None.
+	 */
+	void encode(const float* coords, uint8_t* codes) const;
+
+	/*
+	 * @brief Compute the lookup table of the query @coords.
+	 *
+	 * @return None. @table is resized as needed, reuse it across queries.
+	 */
+	void prepare(const float* coords, pq_table_t& table) const;
+};
+
+/*
+ * A set of candidates encoded for the scan.
+ *
+ * With 8 bits a candidate's codes are contiguous. With 4 bits the candidates
+ * are cut in blocks of 32, and for every group a block holds 16 bytes: byte j
+ * has the code of candidate j in its low nibble and of candidate j + 16 in its
+ * high one. The last block is padded with code 0.
+ */
+class pq_block_t {
+	// The groups of the codes.
+	uint32_t _n_subspaces;
+
+	// The bits of a group's code.
+	uint32_t _n_bits;
+
+	// The ids of the candidates, in the order they were encoded.
+	vector<uint32_t> _ids;
+
+	// The codes, laid out as above.
+	vector<uint8_t> _codes;
+
+public:
+	/*
+	 * @brief Encode the points with the specified ids.
+	 *
+	 * @param dataset The coordinates of the points.
+	 * @param pq The codebooks.
+	 * @param ids The ids of the points to encode.
+	 * @param n_ids The number of ids in @ids.
+	 */
+	pq_block_t(const dataset_t& dataset, const pq_t& pq, const uint32_t* ids, size_t n_ids);
+
+	// The number of candidates in the block.
+	size_t size() const;
+
+	/*
+	 * @brief Offer every candidate to @topk by its approximate distance to
+	 * the query of @table. The candidate @query_id is skipped.
+	 *
+	 * The approximate distances only rank the candidates of a query. They
+	 * are scaled differently for every query, re-rank the kept candidates.
+	 *
+	 * @return None. The ids of the nearest candidates are pushed to @topk.
+	 */
+	void scan(const pq_table_t& table, uint32_t query_id, topk_t& topk) const;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Low-overhead instrumentation of a run.
+ *
+ * Every thread counts its distance evaluations and its busy time in its own
+ * cache line, so counting costs an add and never contends. Counts are added
+ * per block of work, e.g. per tile of queries, never per distance. A phase
+ * resets the counts when it starts and collects them when it ends.
+ */
+
+// Add @n_distances distance evaluations to the calling thread's count.
+void profile_distances(uint64_t n_distances);
+
+// Add @secs of work to the calling thread's busy time.
+void profile_busy(double secs);
+
+/*
+ * Adds the lifetime of the object to the calling thread's busy time. Put it
+ * at the top of a parallel region whose loops are nowait, so that waiting at
+ * the region's closing barrier counts as idle.
+ */
+class busy_timer_t {
+	// When the work started.
+	double _start;
+
+public:
+	busy_timer_t();
+	~busy_timer_t();
+};
+
+/*
+ * The measurements of a phase.
+ */
+struct phase_report_t {
+	// The name of the phase, e.g. "search".
+	string name;
+
+	// The wall time of the phase, in seconds.
+	double wall = 0.0;
+
+	// The distances evaluated by all the threads.
+	uint64_t n_distances = 0;
+
+	// The busy time of each thread, in seconds. The rest of @wall is idle.
+	vector<double> busy;
+
+	// The peak resident set size of the process at the end, in KB.
+	uint64_t peak_rss = 0;
+
+	// Hardware counters over all the threads, e.g. ("cycles", n). Empty if
+	// they weren't asked for or aren't available.
+	vector<pair<string, uint64_t>> counters;
+};
+
+/*
+ * The measurements of a run, written out as JSON.
+ */
+struct run_report_t {
+	// The phases, in the order they ran.
+	vector<phase_report_t> phases;
+
+	// The iterations of K-Means, over all the splits if hierarchical.
+	uint32_t kmeans_iters = 0;
+
+	// The points that changed cluster in each K-Means iteration. Empty for
+	// mini-batch and hierarchical K-Means.
+	vector<uint64_t> kmeans_moved;
+
+	// The K-Means runs of hierarchical K-Means, 0 if flat.
+	uint32_t n_splits = 0;
+
+	// Whether the clusters were those of a checkpoint, K-Means didn't run.
+	bool resumed = false;
+
+	// The trees of a random projection forest and their maximum leaf size,
+	// 0 without one.
+	uint32_t n_trees = 0;
+	uint32_t leaf_size = 0;
+
+	// The number of points of each cluster.
+	vector<uint32_t> cluster_sizes;
+
+	// The wall time of the phase named @name, 0 if it didn't run.
+	double wall(const string& name) const;
+
+	// The wall time of all the phases.
+	double total_wall() const;
+};
+
+/*
+ * A phase of a run. Resets the thread counts when constructed, and appends
+ * the phase to the report when ended, or destroyed. Phases share the thread
+ * counts, so they can't nest: one must end before the next one starts.
+ */
+class profile_phase_t {
+	// The report to append to. NULL measures nothing.
+	run_report_t* _report;
+
+	// The phase so far.
+	phase_report_t _phase;
+
+	// When the phase started.
+	double _start;
+
+	// Whether end() has been called.
+	bool _ended;
+
+public:
+	/*
+	 * @brief Start the phase named @name of @report.
+	 *
+	 * @throws logic_error If another phase of a report is still open.
+	 */
+	profile_phase_t(const string& name, run_report_t* report);
+
+	profile_phase_t(const profile_phase_t&) = delete;
+	profile_phase_t& operator=(const profile_phase_t&) = delete;
+
+	~profile_phase_t();
+
+	// End the phase and append it to the report.
+	void end();
+};
+
+/*
+ * @brief Open the hardware counters of every thread of the OpenMP team.
+ *
+ * Call it once, before the first phase. Counters that can't be opened, e.g.
+ * without permission, are left out of the report.
+ *
+ * @return Whether any counter could be opened.
+ */
+bool open_hardware_counters();
+
+/*
+ * @brief Write @report as JSON.
+ *
+ * @return None.
+ */
+void write_report(const run_report_t& report, ostream& outstream);
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "dataset.hpp"
+
+using namespace std;
+
+/*
+ * Compressed coordinates for the candidate scan.
+ *
+ * With int8, each dimension is quantized to 256 levels between its minimum
+ * and maximum over the dataset. With fp16, each coordinate is stored as a
+ * half-precision float. Distances to codes are approximate, the scan keeps
+ * more candidates than needed and re-ranks them with the float coordinates.
+ */
+enum class quantization_t {
+	none,
+	int8,
+	fp16
+};
+
+/*
+ * @brief Convert a float to half precision, rounding to nearest.
+ *
+ * Values too large become infinite, too small become zero.
+ */
+inline uint16_t float_to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent >= 31) return sign | 0x7c00;
+
+	// Subnormal half, the implicit bit becomes explicit.
+	if (exponent <= 0) {
+		if (exponent < -10) return sign;
+
+		mantissa |= 0x800000;
+		uint32_t shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+
+		if ((mantissa >> (shift - 1)) & 1) ++half;
+
+		return sign | half;
+	}
+
+	uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+
+	// A carry out of the mantissa correctly bumps the exponent.
+	if (mantissa & 0x1000) ++half;
+
+	return half;
+}
+
+/*
+ * @brief Convert a half-precision float to float, exactly.
+ */
+inline float half_to_float(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits;
+
+	if (exponent == 0) {
+		// Zero or subnormal, mantissa * 2^-24.
+		float value = mantissa * (1.0f / 16777216.0f);
+		return sign ? -value : value;
+	}
+
+	if (exponent == 31)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+/*
+ * Encodes and decodes the coordinates of a dataset.
+ *
+ * An int8 code c of dimension i decodes to offset[i] + scale[i] * c. The dot
+ * product of a float query x with a decoded candidate is then
+ * sum(x[i] * offset[i]) + sum((x[i] * scale[i]) * c[i]). The first term only
+ * depends on the query, the second is a dot product with the raw codes. So
+ * the scan multiplies scaled queries with codes and never decodes them.
+ */
+class quantizer_t {
+	// How coordinates are encoded.
+	quantization_t _type;
+
+	// The dimension of each point.
+	uint32_t _n_dims;
+
+	// The minimum of each dimension, int8 only.
+	vector<float> _offsets;
+
+	// The step between two levels of each dimension, int8 only.
+	vector<float> _scales;
+
+public:
+	/*
+	 * @brief Fit the quantization of @type to the points of @dataset.
+	 *
+	 * @param dataset The points whose coordinates to encode.
+	 * @param type The encoding. none encodes nothing.
+	 */
+	quantizer_t(const dataset_t& dataset, quantization_t type);
+
+	// How coordinates are encoded.
+	quantization_t type() const;
+
+	// The bytes of a code, 1 for int8 and 2 for fp16.
+	size_t code_size() const;
+
+	// The int8 code of @value, a coordinate of dimension @c_dim.
+	inline uint8_t encode_int8(float value, uint32_t c_dim) const
+	{
+		if (_scales[c_dim] == 0.0f) return 0;
+
+		float level = (value - _offsets[c_dim]) / _scales[c_dim] + 0.5f;
+
+		return (uint8_t)min(max(level, 0.0f), 255.0f);
+	}
+
+	// The coordinate of dimension @c_dim that @code decodes to.
+	inline float decode_int8(uint8_t code, uint32_t c_dim) const
+	{
+		return _offsets[c_dim] + _scales[c_dim] * code;
+	}
+
+	/*
+	 * @brief Prepare a query for the dot products with codes.
+	 *
+	 * @param coords The coordinates of the query.
+	 * @param scaled Where to write the query to multiply with the codes,
+	 * @n_dims floats.
+	 *
+	 * @return The part of the dot product that depends on the query only.
+	 */
+	float prepare_query(const float* coords, float* scaled) const;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "point.hpp"
+#include "cluster.hpp"
+#include "dataset.hpp"
+#include "generator.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+/*
+ * The hyperparameters of a random projection forest.
+ */
+struct rpforest_params_t {
+	// The number of trees, each one is a partition.
+	uint32_t n_trees = 4;
+
+	// The maximum number of points of a leaf. Leaves get at least half.
+	uint32_t leaf_size = 256;
+
+	// The seed of the random splits.
+	uint64_t seed = 2023;
+};
+
+/*
+ * A forest of random projection trees.
+ *
+ * A tree splits the points in two halves by their side of the bisecting
+ * hyperplane of two random points, at the median, and the halves again,
+ * until no node has more than @leaf_size points. No iterations, a tree is
+ * built in O(n log n) distances. The leaves of each tree are a partition.
+ *
+ * The splits are random but depend only on the seed, the tree and the node,
+ * never on the threads.
+ */
+class rpforest_t : public candidate_generator_t {
+	// The hyperparameters.
+	rpforest_params_t _params;
+
+	// The coordinates of the points.
+	const dataset_t& _dataset;
+
+	// All the points. Left in their leaf of the first tree.
+	vector<point_t>& _points;
+
+	// The leaves of each tree.
+	vector<vector<cluster_t>> _trees;
+
+	// Split the node @ids[first, last) of tree @c_tree at its median.
+	void _split(uint32_t c_tree, vector<uint32_t>& ids, size_t first, size_t last,
+			bool parallel) const;
+
+	// The leaves of tree @c_tree.
+	vector<cluster_t> _build(uint32_t c_tree) const;
+
+public:
+	/*
+	 * @brief Initialize the forest.
+	 *
+	 * @param params The trees and their leaves.
+	 * @param dataset The coordinates of @points.
+	 * @param points The points to cut, views into @dataset.
+	 */
+	rpforest_t(const rpforest_params_t& params, const dataset_t& dataset,
+			vector<point_t>& points);
+
+	void run() override;
+
+	uint32_t n_partitions() const override;
+
+	const vector<cluster_t>& partition(uint32_t c_partition) const override;
+
+	void describe(run_report_t& report) const override;
+};
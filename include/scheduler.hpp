@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * The task queues of a parallel loop whose tasks vary a lot in cost, with
+ * work stealing.
+ *
+ * Every thread has its own deque. It takes its tasks from the front, and a
+ * task may push more at the front, e.g. the tiles of the cluster it just
+ * packed, which its thread then runs next while their data is in cache.
+ * A thread whose deque is empty steals from the back of the others', the
+ * tasks their owners would run last.
+ *
+ * The loop ends when every task pushed has finished, not when the deques
+ * are empty: a running task may still push more.
+ */
+template <typename task_t>
+class steal_queues_t {
+	// A thread's deque, on its own cache line.
+	struct alignas(64) queue_t {
+		mutex lock;
+		deque<task_t> tasks;
+	};
+
+	// The deque of each thread.
+	vector<queue_t> _queues;
+
+	// The tasks pushed and not finished yet.
+	atomic<size_t> _n_pending;
+
+public:
+	// Empty deques for @n_threads threads.
+	steal_queues_t(uint32_t n_threads)
+	: _queues(max(n_threads, 1u)), _n_pending(0)
+	{
+		/* Empty. */
+	}
+
+	// Queue @task at the back of thread @c_thread's deque, before the loop.
+	inline void push_back(uint32_t c_thread, task_t task)
+	{
+		queue_t& queue = _queues[c_thread % _queues.size()];
+
+		_n_pending.fetch_add(1);
+
+		lock_guard<mutex> guard(queue.lock);
+		queue.tasks.push_back(move(task));
+	}
+
+	// Queue @task at the front of thread @c_thread's deque, to run next.
+	inline void push_front(uint32_t c_thread, task_t task)
+	{
+		queue_t& queue = _queues[c_thread % _queues.size()];
+
+		_n_pending.fetch_add(1);
+
+		lock_guard<mutex> guard(queue.lock);
+		queue.tasks.push_front(move(task));
+	}
+
+	/*
+	 * @brief Take the next task of thread @c_thread, its own or a stolen one.
+	 *
+	 * @param task Set to the task taken, if any.
+	 *
+	 * @return False if every deque was empty, the loop may still not be over.
+	 */
+	inline bool pop(uint32_t c_thread, task_t& task)
+	{
+		uint32_t n_queues = _queues.size();
+
+		for (uint32_t c_victim = 0; c_victim < n_queues; ++c_victim) {
+			queue_t& queue = _queues[(c_thread + c_victim) % n_queues];
+
+			lock_guard<mutex> guard(queue.lock);
+
+			if (queue.tasks.empty()) continue;
+
+			if (c_victim == 0) {
+				task = move(queue.tasks.front());
+				queue.tasks.pop_front();
+			} else {
+				task = move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	// Report a task taken by pop() as finished, after it pushed its own.
+	inline void done()
+	{
+		_n_pending.fetch_sub(1);
+	}
+
+	/*
+	 * @brief Run the tasks with the calling thread, until all are finished.
+	 *
+	 * @param c_thread The calling thread, its deque comes first.
+	 * @param run Called with each task.
+	 *
+	 * @return None.
+	 */
+	template <typename run_t>
+	void work(uint32_t c_thread, run_t run)
+	{
+		task_t task;
+
+		while (_n_pending.load() > 0) {
+			if (!pop(c_thread, task)) {
+				// The last tasks are running, they may push more.
+				this_thread::yield();
+				continue;
+			}
+
+			run(task);
+			done();
+		}
+	}
+};
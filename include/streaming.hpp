@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "profile.hpp"
+
+using namespace std;
+
+struct config_t;
+
+/*
+ * The hyperparameters of the out-of-core build.
+ */
+struct streaming_params_t {
+	// Build out of core instead of loading the whole dataset.
+	bool enabled = false;
+
+	// Where to spill the buckets, ideally a local disk. The spill files are
+	// removed as their buckets are done.
+	string spill_dir = ".";
+
+	// The memory in GB for the buckets. The number of buckets follows from
+	// it, two of them are in memory at a time.
+	double memory_gb = 8.0;
+
+	// The number of points sampled to train the centroids of the buckets.
+	uint32_t sample_size = 262144;
+
+	// If positive, a point is also copied to its next nearest buckets that
+	// are at most @overlap times further than its own, as a candidate only.
+	float overlap = 0.0f;
+};
+
+/*
+ * @brief Calculate the knng of a dataset file that may not fit in memory.
+ *
+ * 1. Train the centroids of the buckets with K-Means on a sample.
+ * 2. Stream the file once, appending each point to the spill file of its
+ *    nearest bucket, and of its other near buckets with an overlap.
+ * 3. Load the buckets one at a time, the next one is read meanwhile, and
+ *    build the knng of each one with create_knng(), within the bucket.
+ * 4. Write the rows of the points of each bucket to their place in the
+ *    output file, which is sized up front.
+ *
+ * Only a sample, two buckets and their knng are in memory at a time. The
+ * number of clusters and a time budget are shared by the buckets in
+ * proportion to their points.
+ *
+ * @param config The dataset and output paths, the knng's hyperparameters
+ * and the streaming ones.
+ * @param report If not NULL, where to record the clustering, spill and
+ * search phases, and the bucket sizes.
+ *
+ * @throws runtime_error If the dataset cannot be read, or a spill file or
+ * the output cannot be written.
+ *
+ * @return None. The knng is in @config.output_path.
+ */
+void create_knng_streaming(const config_t& config, run_report_t* report = NULL);
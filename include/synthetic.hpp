@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "dataset.hpp"
+
+using namespace std;
+
+// The rows generated from one seed.
+static constexpr size_t synthetic_block = 1024;
+
+/*
+ * The shape of a synthetic dataset.
+ *
+ * Points are drawn around @n_clusters centers, uniform in the unit cube, with
+ * gaussian noise of deviation @spread per dimension. A fraction of the points
+ * repeats an earlier point exactly, like the duplicates of the contest data.
+ */
+struct synthetic_params_t {
+	// The dimension of each point.
+	uint32_t n_dims = 100;
+
+	// The number of centers. 0 draws every point uniformly instead.
+	uint32_t n_clusters = 100;
+
+	// The standard deviation around a center, per dimension.
+	float spread = 0.05f;
+
+	// The fraction of points that duplicate an earlier point.
+	float duplicates = 0.0f;
+
+	// Same seed, same dataset, whatever the number of threads.
+	uint64_t seed = 2023;
+};
+
+/*
+ * @brief Fill the rows [@first, @first + @n_rows) of a synthetic dataset.
+ *
+ * Rows are generated in fixed blocks, each from its own seed, so any range
+ * can be generated on its own and in parallel. Duplicates repeat a point of
+ * their own block.
+ *
+ * @param params The shape of the dataset.
+ * @param first The index of the first row. A multiple of synthetic_block.
+ * @param n_rows The number of rows to fill.
+ * @param rows Where to write the rows, (n_rows x n_dims) floats.
+ *
+ * @return None.
+ */
+void synthetic_rows(const synthetic_params_t& params, size_t first, size_t n_rows,
+		float* rows);
+
+/*
+ * @brief Generate a synthetic dataset in memory.
+ *
+ * @return The (n_points x n_dims) dataset.
+ */
+dataset_t synthetic_dataset(uint32_t n_points, const synthetic_params_t& params);
+
+/*
+ * @brief Write a synthetic dataset in the contest's format, a uint32_t with
+ * the number of points followed by the rows. Generated and written in chunks,
+ * so the dataset never has to fit in memory.
+ *
+ * @throws runtime_error If the file cannot be written.
+ *
+ * @return None.
+ */
+void write_synthetic(const string& path, uint32_t n_points, const synthetic_params_t& params);
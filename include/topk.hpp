@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+using namespace std;
+
+/*
+ * A fixed-capacity selection of the k nearest candidates.
+ *
+ * Candidates nearer than the cached threshold are appended to a buffer of 2k
+ * slots. Once k are kept, the farthest of them becomes the threshold. When the
+ * buffer fills up, a partial sort (nth_element) keeps the k nearest and the
+ * k-th distance becomes the new threshold. So a push is an
+ * append, amortized O(1), and the distance loops reject most candidates with
+ * a single compare against threshold().
+ *
+ * The buffer is allocated once. A thread keeps its topk_t objects and reset()s
+ * them for every query, nothing is allocated per point.
+ */
+class topk_t {
+public:
+	// A candidate, its distance first so that pairs sort nearest first.
+	typedef pair<float, uint32_t> item_t;
+
+private:
+	// The number of neighbors to keep.
+	uint32_t _k;
+
+	// The number of buffered candidates.
+	uint32_t _size;
+
+	// Candidates at this distance or further are rejected.
+	float _threshold;
+
+	// The buffer, 2k candidates.
+	unique_ptr<item_t[]> _items;
+
+	// Keep the k nearest buffered candidates and tighten the threshold.
+	inline void _shrink()
+	{
+		nth_element(_items.get(), _items.get() + _k - 1, _items.get() + _size);
+
+		_size = _k;
+		_threshold = _items[_k - 1].first;
+	}
+
+public:
+	// An empty selection of the @k nearest candidates.
+	topk_t(uint32_t k = 1)
+	: _k(max(k, 1u)), _size(0), _threshold(numeric_limits<float>::infinity()),
+	  _items(new item_t[2 * _k])
+	{
+		/* Empty. */
+	}
+
+	topk_t(topk_t&&) = default;
+	topk_t& operator=(topk_t&&) = default;
+
+	// Forget every candidate, keep the buffer.
+	inline void reset()
+	{
+		_size = 0;
+		_threshold = numeric_limits<float>::infinity();
+	}
+
+	// The distance a candidate must beat to be kept. Infinite until k
+	// candidates were kept.
+	inline float threshold() const { return _threshold; }
+
+	// Offer a candidate. It is kept only if nearer than threshold().
+	inline void push(float distance, uint32_t id)
+	{
+		if (distance >= _threshold) return;
+
+		_items[_size++] = {distance, id};
+
+		// The farthest of the first k bounds the k-th nearest already.
+		if (_size == _k && _threshold == numeric_limits<float>::infinity())
+			_threshold = max_element(_items.get(), _items.get() + _k)->first;
+		else if (_size == 2 * _k)
+			_shrink();
+	}
+
+	/*
+	 * @brief Write the kept candidates, nearest first, and reset.
+	 *
+	 * @param ids Where to write the ids, k slots.
+	 * @param distances Where to write the distances, k slots. May be NULL.
+	 *
+	 * @return The number of candidates written, at most k.
+	 */
+	inline uint32_t write(uint32_t* ids, float* distances)
+	{
+		if (_size > _k) _shrink();
+
+		sort(_items.get(), _items.get() + _size);
+
+		uint32_t n_found = _size;
+
+		for (uint32_t c_slot = 0; c_slot < n_found; ++c_slot) {
+			ids[c_slot] = _items[c_slot].second;
+			if (distances) distances[c_slot] = _items[c_slot].first;
+		}
+
+		reset();
+
+		return n_found;
+	}
+};
@@ -0,0 +1,666 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <immintrin.h>
+#include "batch-distance.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// Candidate panels per tile. 8 panels of 100-dim points fit in L2.
+static constexpr uint32_t tile_panels = 8;
+
+/*
+ * Signature of a micro-kernel. Computes the (batch_rows x batch_cols) dot
+ * products of @queries with the candidates of @panel into @dots, row-major.
+ */
+typedef void (*dot_panel_kernel_t)(const float* const* queries,
+		const float* panel, uint32_t n_dims, float* dots);
+
+static void _dot_panel_scalar(const float* const* queries, const float* panel,
+		uint32_t n_dims, float* dots)
+{
+	for (uint32_t c_row = 0; c_row < batch_rows; ++c_row) {
+		float* row = dots + c_row * batch_cols;
+		const float* query = queries[c_row];
+
+		fill(row, row + batch_cols, 0.0f);
+
+		// The inner loop is contiguous, the compiler vectorizes it.
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+			for (uint32_t c_col = 0; c_col < batch_cols; ++c_col)
+				row[c_col] += query[c_dim] * panel[c_dim * batch_cols + c_col];
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void _dot_panel_avx2(const float* const* queries, const float* panel,
+		uint32_t n_dims, float* dots)
+{
+	// 4 rows x 32 columns don't fit in 16 registers, do 16 columns at a time.
+	for (uint32_t c_half = 0; c_half < batch_cols; c_half += 16) {
+		__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+		__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+		__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+		__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+			const float* cols = panel + c_dim * batch_cols + c_half;
+			__m256 p0 = _mm256_loadu_ps(cols);
+			__m256 p1 = _mm256_loadu_ps(cols + 8);
+
+			__m256 q = _mm256_broadcast_ss(queries[0] + c_dim);
+			c00 = _mm256_fmadd_ps(q, p0, c00);
+			c01 = _mm256_fmadd_ps(q, p1, c01);
+
+			q = _mm256_broadcast_ss(queries[1] + c_dim);
+			c10 = _mm256_fmadd_ps(q, p0, c10);
+			c11 = _mm256_fmadd_ps(q, p1, c11);
+
+			q = _mm256_broadcast_ss(queries[2] + c_dim);
+			c20 = _mm256_fmadd_ps(q, p0, c20);
+			c21 = _mm256_fmadd_ps(q, p1, c21);
+
+			q = _mm256_broadcast_ss(queries[3] + c_dim);
+			c30 = _mm256_fmadd_ps(q, p0, c30);
+			c31 = _mm256_fmadd_ps(q, p1, c31);
+		}
+
+		_mm256_storeu_ps(dots + 0 * batch_cols + c_half, c00);
+		_mm256_storeu_ps(dots + 0 * batch_cols + c_half + 8, c01);
+		_mm256_storeu_ps(dots + 1 * batch_cols + c_half, c10);
+		_mm256_storeu_ps(dots + 1 * batch_cols + c_half + 8, c11);
+		_mm256_storeu_ps(dots + 2 * batch_cols + c_half, c20);
+		_mm256_storeu_ps(dots + 2 * batch_cols + c_half + 8, c21);
+		_mm256_storeu_ps(dots + 3 * batch_cols + c_half, c30);
+		_mm256_storeu_ps(dots + 3 * batch_cols + c_half + 8, c31);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void _dot_panel_avx512(const float* const* queries, const float* panel,
+		uint32_t n_dims, float* dots)
+{
+	__m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+	__m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+	__m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+	__m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+
+	for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+		const float* cols = panel + c_dim * batch_cols;
+		__m512 p0 = _mm512_loadu_ps(cols);
+		__m512 p1 = _mm512_loadu_ps(cols + 16);
+
+		__m512 q = _mm512_set1_ps(queries[0][c_dim]);
+		c00 = _mm512_fmadd_ps(q, p0, c00);
+		c01 = _mm512_fmadd_ps(q, p1, c01);
+
+		q = _mm512_set1_ps(queries[1][c_dim]);
+		c10 = _mm512_fmadd_ps(q, p0, c10);
+		c11 = _mm512_fmadd_ps(q, p1, c11);
+
+		q = _mm512_set1_ps(queries[2][c_dim]);
+		c20 = _mm512_fmadd_ps(q, p0, c20);
+		c21 = _mm512_fmadd_ps(q, p1, c21);
+
+		q = _mm512_set1_ps(queries[3][c_dim]);
+		c30 = _mm512_fmadd_ps(q, p0, c30);
+		c31 = _mm512_fmadd_ps(q, p1, c31);
+	}
+
+	_mm512_storeu_ps(dots + 0 * batch_cols, c00);
+	_mm512_storeu_ps(dots + 0 * batch_cols + 16, c01);
+	_mm512_storeu_ps(dots + 1 * batch_cols, c10);
+	_mm512_storeu_ps(dots + 1 * batch_cols + 16, c11);
+	_mm512_storeu_ps(dots + 2 * batch_cols, c20);
+	_mm512_storeu_ps(dots + 2 * batch_cols + 16, c21);
+	_mm512_storeu_ps(dots + 3 * batch_cols, c30);
+	_mm512_storeu_ps(dots + 3 * batch_cols + 16, c31);
+}
+
+/*
+ * @brief Pick the fastest micro-kernel the running CPU supports.
+ */
+static dot_panel_kernel_t _select_dot_panel()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+		return _dot_panel_avx512;
+
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return _dot_panel_avx2;
+
+	return _dot_panel_scalar;
+}
+
+static const dot_panel_kernel_t _dot_panel = _select_dot_panel();
+
+/*
+ * Decoding of quantized panels. A tile of panels is converted to floats once
+ * and then multiplied with every block of queries by the float micro-kernel,
+ * so the conversion is amortized over all the queries and only the codes are
+ * read from memory. An int8 code converts to its level, the queries are
+ * scaled to match, see quantizer_t.
+ */
+typedef void (*decode_kernel_t)(const uint8_t* codes, size_t n_codes, float* coords);
+
+static void _decode_int8_scalar(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	for (size_t c_code = 0; c_code < n_codes; ++c_code)
+		coords[c_code] = codes[c_code];
+}
+
+static void _decode_fp16_scalar(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	const uint16_t* halves = (const uint16_t*)codes;
+
+	for (size_t c_code = 0; c_code < n_codes; ++c_code)
+		coords[c_code] = half_to_float(halves[c_code]);
+}
+
+// Panels are batch_cols wide, @n_codes is a multiple of 16.
+__attribute__((target("avx2")))
+static void _decode_int8_avx2(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	for (size_t c_code = 0; c_code < n_codes; c_code += 8) {
+		__m128i packed = _mm_loadl_epi64((const __m128i*)(codes + c_code));
+		_mm256_storeu_ps(coords + c_code, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed)));
+	}
+}
+
+__attribute__((target("avx2,f16c")))
+static void _decode_fp16_avx2(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	const uint16_t* halves = (const uint16_t*)codes;
+
+	for (size_t c_code = 0; c_code < n_codes; c_code += 8) {
+		__m128i packed = _mm_loadu_si128((const __m128i*)(halves + c_code));
+		_mm256_storeu_ps(coords + c_code, _mm256_cvtph_ps(packed));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void _decode_int8_avx512(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	for (size_t c_code = 0; c_code < n_codes; c_code += 16) {
+		__m128i packed = _mm_loadu_si128((const __m128i*)(codes + c_code));
+		_mm512_storeu_ps(coords + c_code, _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(packed)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void _decode_fp16_avx512(const uint8_t* codes, size_t n_codes, float* coords)
+{
+	const uint16_t* halves = (const uint16_t*)codes;
+
+	for (size_t c_code = 0; c_code < n_codes; c_code += 16) {
+		__m256i packed = _mm256_loadu_si256((const __m256i*)(halves + c_code));
+		_mm512_storeu_ps(coords + c_code, _mm512_cvtph_ps(packed));
+	}
+}
+
+/*
+ * @brief Pick the fastest decoding of @type the running CPU supports.
+ */
+static decode_kernel_t _select_decode(quantization_t type)
+{
+	__builtin_cpu_init();
+
+	bool int8 = (type == quantization_t::int8);
+
+	if (__builtin_cpu_supports("avx512f"))
+		return int8 ? _decode_int8_avx512 : _decode_fp16_avx512;
+
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+		return int8 ? _decode_int8_avx2 : _decode_fp16_avx2;
+
+	return int8 ? _decode_int8_scalar : _decode_fp16_scalar;
+}
+
+static const decode_kernel_t _decode_int8 = _select_decode(quantization_t::int8);
+static const decode_kernel_t _decode_fp16 = _select_decode(quantization_t::fp16);
+
+float squared_norm(const float* coords, uint32_t n_dims)
+{
+	float norm = 0.0f;
+
+	for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+		norm += coords[c_dim] * coords[c_dim];
+
+	return norm;
+}
+
+packed_block_t::packed_block_t(const dataset_t& dataset, const uint32_t* ids, size_t n_ids,
+		uint32_t n_leading)
+: _n_dims(dataset.n_dims()), _ids(ids, ids + n_ids), _norms(n_ids),
+  _n_leading(n_leading < _n_dims ? n_leading : 0), _leading_norms(_n_leading ? n_ids : 0)
+{
+	size_t n_panels = (n_ids + batch_cols - 1) / batch_cols;
+
+	// Zero initialized, so the padding of the last panel is zero.
+	_panels.resize(n_panels * _n_dims * batch_cols, 0.0f);
+
+	#pragma omp parallel for
+	for (size_t c_panel = 0; c_panel < n_panels; ++c_panel) {
+		float* panel = _panels.data() + c_panel * _n_dims * batch_cols;
+		size_t first = c_panel * batch_cols;
+		size_t last = min(first + batch_cols, n_ids);
+
+		for (size_t c_cand = first; c_cand < last; ++c_cand) {
+			const float* coords = dataset.row(_ids[c_cand]);
+
+			for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim)
+				panel[c_dim * batch_cols + (c_cand - first)] = coords[c_dim];
+
+			_norms[c_cand] = squared_norm(coords, _n_dims);
+
+			if (_n_leading > 0)
+				_leading_norms[c_cand] = squared_norm(coords, _n_leading);
+		}
+	}
+}
+
+size_t packed_block_t::size() const
+{
+	return _ids.size();
+}
+
+size_t packed_block_t::n_panels() const
+{
+	return (_ids.size() + batch_cols - 1) / batch_cols;
+}
+
+uint32_t packed_block_t::n_leading() const
+{
+	return _n_leading;
+}
+
+quantized_block_t::quantized_block_t(const dataset_t& dataset, const quantizer_t& quantizer,
+		const uint32_t* ids, size_t n_ids)
+: _n_dims(dataset.n_dims()), _code_size(quantizer.code_size()), _ids(ids, ids + n_ids),
+  _norms(n_ids)
+{
+	size_t n_panels = (n_ids + batch_cols - 1) / batch_cols;
+	bool int8 = (quantizer.type() == quantization_t::int8);
+
+	// Zero initialized, so the padding of the last panel is zero.
+	_panels.resize(n_panels * _n_dims * batch_cols * _code_size, 0);
+
+	#pragma omp parallel for
+	for (size_t c_panel = 0; c_panel < n_panels; ++c_panel) {
+		uint8_t* panel = _panels.data() + c_panel * _n_dims * batch_cols * _code_size;
+		size_t first = c_panel * batch_cols;
+		size_t last = min(first + batch_cols, n_ids);
+
+		for (size_t c_cand = first; c_cand < last; ++c_cand) {
+			const float* coords = dataset.row(_ids[c_cand]);
+			size_t col = c_cand - first;
+			float norm = 0.0f;
+
+			for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+				float decoded;
+
+				if (int8) {
+					uint8_t code = quantizer.encode_int8(coords[c_dim], c_dim);
+					panel[c_dim * batch_cols + col] = code;
+					decoded = quantizer.decode_int8(code, c_dim);
+				} else {
+					uint16_t code = float_to_half(coords[c_dim]);
+					((uint16_t*)panel)[c_dim * batch_cols + col] = code;
+					decoded = half_to_float(code);
+				}
+
+				norm += decoded * decoded;
+			}
+
+			_norms[c_cand] = norm;
+		}
+	}
+}
+
+size_t quantized_block_t::size() const
+{
+	return _ids.size();
+}
+
+size_t quantized_block_t::n_panels() const
+{
+	return (_ids.size() + batch_cols - 1) / batch_cols;
+}
+
+/*
+ * @brief knn_search_block() with early abandoning, @candidates have leading
+ * dimensions.
+ *
+ * The distance over the leading dimensions is a lower bound of the full one.
+ * The micro-kernel first evaluates a block of queries and a panel over them.
+ * If no pair's bound is below its query's k-th nearest, the panel is
+ * abandoned, otherwise the micro-kernel evaluates the rest of the dimensions.
+ * Pairs are abandoned by panel, not one by one, a single pair costs more than
+ * the micro-kernel spends on the whole panel's.
+ */
+static void _search_block_pruned(const dataset_t& dataset, const uint32_t* query_ids,
+		uint32_t n_queries, const packed_block_t& candidates, topk_t* topks)
+{
+	uint32_t n_dims = dataset.n_dims();
+	uint32_t n_leading = candidates.n_leading();
+	uint32_t n_trailing = n_dims - n_leading;
+	size_t n_cands = candidates.size();
+	size_t n_panels = candidates.n_panels();
+
+	if (n_queries == 0) return;
+
+	profile_distances((uint64_t)n_queries * n_cands);
+
+	// The output of the micro-kernel, over the leading and the other
+	// dimensions.
+	alignas(64) float dots[batch_rows * batch_cols];
+	alignas(64) float trailing_dots[batch_rows * batch_cols];
+
+	/*
+	 * If the candidates are sorted by their first coordinate, those of the
+	 * tiles around the queries' are likely the nearest. Start there and go
+	 * outwards, the thresholds tighten early and more far panels are
+	 * abandoned. Otherwise the order makes no difference.
+	 */
+	size_t n_tiles = (n_panels + tile_panels - 1) / tile_panels;
+	float middle = dataset.row(query_ids[n_queries / 2])[0];
+
+	size_t center = 0;
+	while (center + 1 < n_tiles && candidates.panel((center + 1) * tile_panels)[0] <= middle)
+		++center;
+
+	// The next tile above the center, and one past the next below it.
+	size_t up = center + 1, down = center;
+
+	for (size_t c_step = 0; c_step < n_tiles; ++c_step) {
+		size_t c_tile;
+
+		if (c_step == 0)
+			c_tile = center;
+		else if (down == 0 || (up < n_tiles && c_step % 2 == 1))
+			c_tile = up++;
+		else
+			c_tile = --down;
+
+		size_t tile = c_tile * tile_panels;
+		size_t tile_end = min(tile + tile_panels, n_panels);
+
+		for (uint32_t block = 0; block < n_queries; block += batch_rows) {
+			uint32_t n_rows = min(batch_rows, n_queries - block);
+
+			// A partial block repeats its last query, the extra rows are ignored.
+			const float* queries[batch_rows];
+			const float* trailing[batch_rows];
+			for (uint32_t c_row = 0; c_row < batch_rows; ++c_row) {
+				queries[c_row] = dataset.row(query_ids[block + min(c_row, n_rows - 1)]);
+				trailing[c_row] = queries[c_row] + n_leading;
+			}
+
+			float query_norms[batch_rows], leading_norms[batch_rows];
+			for (uint32_t c_row = 0; c_row < batch_rows; ++c_row) {
+				leading_norms[c_row] = squared_norm(queries[c_row], n_leading);
+				query_norms[c_row] = leading_norms[c_row]
+					+ squared_norm(trailing[c_row], n_trailing);
+			}
+
+			for (size_t c_panel = tile; c_panel < tile_end; ++c_panel) {
+				const float* panel = candidates.panel(c_panel);
+
+				_dot_panel(queries, panel, n_leading, dots);
+
+				size_t first = c_panel * batch_cols;
+				uint32_t n_cols = min((size_t)batch_cols, n_cands - first);
+				bool abandoned = true;
+
+				for (uint32_t c_row = 0; c_row < n_rows && abandoned; ++c_row) {
+					float threshold = topks[block + c_row].threshold();
+					const float* row = dots + c_row * batch_cols;
+
+					for (uint32_t c_col = 0; c_col < n_cols; ++c_col) {
+						float partial = leading_norms[c_row]
+							+ candidates.leading_norm(first + c_col) - 2.0f * row[c_col];
+
+						if (partial < threshold) {
+							abandoned = false;
+							break;
+						}
+					}
+				}
+
+				if (abandoned) continue;
+
+				_dot_panel(trailing, panel + (size_t)n_leading * batch_cols, n_trailing,
+						trailing_dots);
+
+				for (uint32_t c_row = 0; c_row < n_rows; ++c_row) {
+					topk_t& topk = topks[block + c_row];
+					uint32_t query_id = query_ids[block + c_row];
+					float query_norm = query_norms[c_row];
+					const float* row = dots + c_row * batch_cols;
+					const float* trailing_row = trailing_dots + c_row * batch_cols;
+
+					float threshold = topk.threshold();
+
+					for (uint32_t c_col = 0; c_col < n_cols; ++c_col) {
+						float distance = query_norm + candidates.norm(first + c_col)
+							- 2.0f * (row[c_col] + trailing_row[c_col]);
+
+						if (distance >= threshold) continue;
+
+						uint32_t cand_id = candidates.id(first + c_col);
+
+						// Skip itself. A point isn't a neighbor of itself.
+						if (cand_id == query_id) continue;
+
+						topk.push(distance, cand_id);
+						threshold = topk.threshold();
+					}
+				}
+			}
+		}
+	}
+}
+
+void knn_search_block(const dataset_t& dataset, const uint32_t* query_ids,
+		uint32_t n_queries, const packed_block_t& candidates, topk_t* topks)
+{
+	if (candidates.n_leading() > 0) {
+		_search_block_pruned(dataset, query_ids, n_queries, candidates, topks);
+		return;
+	}
+
+	uint32_t n_dims = dataset.n_dims();
+	size_t n_cands = candidates.size();
+	size_t n_panels = candidates.n_panels();
+
+	profile_distances((uint64_t)n_queries * n_cands);
+
+	// The output of the micro-kernel.
+	alignas(64) float dots[batch_rows * batch_cols];
+
+	for (size_t tile = 0; tile < n_panels; tile += tile_panels) {
+		size_t tile_end = min(tile + tile_panels, n_panels);
+
+		for (uint32_t block = 0; block < n_queries; block += batch_rows) {
+			uint32_t n_rows = min(batch_rows, n_queries - block);
+
+			// A partial block repeats its last query, the extra rows are ignored.
+			const float* queries[batch_rows];
+			for (uint32_t c_row = 0; c_row < batch_rows; ++c_row)
+				queries[c_row] = dataset.row(query_ids[block + min(c_row, n_rows - 1)]);
+
+			// Recomputed per tile, which is cheaper than allocating them.
+			float query_norms[batch_rows];
+			for (uint32_t c_row = 0; c_row < batch_rows; ++c_row)
+				query_norms[c_row] = squared_norm(queries[c_row], n_dims);
+
+			for (size_t c_panel = tile; c_panel < tile_end; ++c_panel) {
+				_dot_panel(queries, candidates.panel(c_panel), n_dims, dots);
+
+				size_t first = c_panel * batch_cols;
+				uint32_t n_cols = min((size_t)batch_cols, n_cands - first);
+
+				for (uint32_t c_row = 0; c_row < n_rows; ++c_row) {
+					topk_t& topk = topks[block + c_row];
+					uint32_t query_id = query_ids[block + c_row];
+					float query_norm = query_norms[c_row];
+					const float* row = dots + c_row * batch_cols;
+
+					// Anything not nearer than the current k-th is rejected.
+					float threshold = topk.threshold();
+
+					for (uint32_t c_col = 0; c_col < n_cols; ++c_col) {
+						float distance = query_norm + candidates.norm(first + c_col)
+							- 2.0f * row[c_col];
+
+						if (distance >= threshold) continue;
+
+						uint32_t cand_id = candidates.id(first + c_col);
+
+						// Skip itself. A point isn't a neighbor of itself.
+						if (cand_id == query_id) continue;
+
+						topk.push(distance, cand_id);
+						threshold = topk.threshold();
+					}
+				}
+			}
+		}
+	}
+}
+
+void knn_search_quantized(const dataset_t& dataset, const quantizer_t& quantizer,
+		const uint32_t* query_ids, uint32_t n_queries, const quantized_block_t& candidates,
+		topk_t* topks)
+{
+	uint32_t n_dims = dataset.n_dims();
+	size_t n_cands = candidates.size();
+	size_t n_panels = candidates.n_panels();
+
+	decode_kernel_t decode =
+		(quantizer.type() == quantization_t::int8) ? _decode_int8 : _decode_fp16;
+	size_t panel_size = (size_t)n_dims * batch_cols;
+
+	profile_distances((uint64_t)n_queries * n_cands);
+
+	// The queries to multiply with the codes, their norms and the part of
+	// their dot products that doesn't depend on the codes.
+	vector<float> scaled((size_t)n_queries * n_dims);
+	vector<float> query_norms(n_queries), offset_dots(n_queries);
+
+	for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+		const float* coords = dataset.row(query_ids[c_query]);
+
+		query_norms[c_query] = squared_norm(coords, n_dims);
+		offset_dots[c_query] = quantizer.prepare_query(coords,
+				scaled.data() + (size_t)c_query * n_dims);
+	}
+
+	// The decoded panels of a tile.
+	vector<float> decoded(tile_panels * panel_size);
+
+	// The output of the micro-kernel.
+	alignas(64) float dots[batch_rows * batch_cols];
+
+	for (size_t tile = 0; tile < n_panels; tile += tile_panels) {
+		size_t tile_end = min(tile + tile_panels, n_panels);
+
+		// The panels of a block are contiguous.
+		decode(candidates.panel(tile), (tile_end - tile) * panel_size, decoded.data());
+
+		for (uint32_t block = 0; block < n_queries; block += batch_rows) {
+			uint32_t n_rows = min(batch_rows, n_queries - block);
+
+			// A partial block repeats its last query, the extra rows are ignored.
+			const float* queries[batch_rows];
+			for (uint32_t c_row = 0; c_row < batch_rows; ++c_row)
+				queries[c_row] = scaled.data()
+					+ (size_t)(block + min(c_row, n_rows - 1)) * n_dims;
+
+			for (size_t c_panel = tile; c_panel < tile_end; ++c_panel) {
+				_dot_panel(queries, decoded.data() + (c_panel - tile) * panel_size,
+						n_dims, dots);
+
+				size_t first = c_panel * batch_cols;
+				uint32_t n_cols = min((size_t)batch_cols, n_cands - first);
+
+				for (uint32_t c_row = 0; c_row < n_rows; ++c_row) {
+					topk_t& topk = topks[block + c_row];
+					uint32_t query_id = query_ids[block + c_row];
+					float query_norm = query_norms[block + c_row];
+					float offset_dot = offset_dots[block + c_row];
+					const float* row = dots + c_row * batch_cols;
+
+					float threshold = topk.threshold();
+
+					for (uint32_t c_col = 0; c_col < n_cols; ++c_col) {
+						float distance = query_norm + candidates.norm(first + c_col)
+							- 2.0f * (offset_dot + row[c_col]);
+
+						if (distance >= threshold) continue;
+
+						if (candidates.id(first + c_col) == query_id) continue;
+
+						topk.push(distance, candidates.id(first + c_col));
+						threshold = topk.threshold();
+					}
+				}
+			}
+		}
+	}
+}
+
+void knn_search_symmetric(const dataset_t& dataset, const packed_block_t& points,
+		size_t query_first, size_t n_queries, size_t cand_first, size_t n_cands,
+		topk_t* topks)
+{
+	uint32_t n_dims = dataset.n_dims();
+	size_t first_panel = cand_first / batch_cols;
+	size_t last_panel = (cand_first + n_cands + batch_cols - 1) / batch_cols;
+
+	// Within a single tile each pair shows up twice, keep the one above
+	// the diagonal.
+	bool diagonal = (query_first == cand_first);
+
+	profile_distances(diagonal ? n_queries * (n_queries - 1) / 2 : n_queries * n_cands);
+
+	// The output of the micro-kernel.
+	alignas(64) float dots[batch_rows * batch_cols];
+
+	for (size_t block = 0; block < n_queries; block += batch_rows) {
+		uint32_t n_rows = min((size_t)batch_rows, n_queries - block);
+
+		// A partial block repeats its last query, the extra rows are ignored.
+		const float* queries[batch_rows];
+		for (uint32_t c_row = 0; c_row < batch_rows; ++c_row)
+			queries[c_row] = dataset.row(points.id(query_first + block
+						+ min(c_row, n_rows - 1)));
+
+		for (size_t c_panel = first_panel; c_panel < last_panel; ++c_panel) {
+			_dot_panel(queries, points.panel(c_panel), n_dims, dots);
+
+			size_t first = c_panel * batch_cols;
+			size_t n_cols = min((size_t)batch_cols, cand_first + n_cands - first);
+
+			for (uint32_t c_row = 0; c_row < n_rows; ++c_row) {
+				size_t query = query_first + block + c_row;
+				float query_norm = points.norm(query);
+				const float* row = dots + c_row * batch_cols;
+
+				size_t c_col = 0;
+				if (diagonal && query + 1 > first)
+					c_col = min(query + 1 - first, n_cols);
+
+				for (; c_col < n_cols; ++c_col) {
+					size_t cand = first + c_col;
+					float distance = query_norm + points.norm(cand) - 2.0f * row[c_col];
+
+					topks[query].push(distance, points.id(cand));
+					topks[cand].push(distance, points.id(query));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "checkpoint.hpp"
+#include "config.hpp"
+
+using namespace std;
+
+// The magic bytes of a checkpoint file.
+static constexpr char checkpoint_magic[8] = "KNNGCKP";
+
+// Sections start on a page.
+static constexpr size_t page_size = 4096;
+
+// The rows of the dataset in the fingerprint, strided from the first one to
+// the last one.
+static constexpr uint32_t fingerprint_rows = 1024;
+
+/*
+ * @brief Round @n_bytes up to the next multiple of @multiple.
+ */
+static inline size_t _round_up(size_t n_bytes, size_t multiple)
+{
+	return (n_bytes + multiple - 1) / multiple * multiple;
+}
+
+// The size of a checkpoint file laid out as in @header.
+static size_t
+_file_size(const checkpoint_header_t& header)
+{
+	size_t n_rows = (size_t)header.n_points * header.k;
+
+	return header.distances_offset + (header.with_distances ? n_rows * sizeof(float) : 0);
+}
+
+void checkpoint_t::_map(size_t n_bytes)
+{
+	int fd = open(_path.c_str(), O_RDWR);
+	if (fd < 0) throw runtime_error("cannot open " + _path);
+
+	struct stat status;
+	if (n_bytes == 0) {
+		if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(checkpoint_header_t)) {
+			close(fd);
+			throw runtime_error(_path + " is not a checkpoint");
+		}
+
+		n_bytes = status.st_size;
+	}
+
+	// Shared, every write reaches the file even if the process is killed.
+	void* base = mmap(NULL, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	// The mapping keeps its own reference to the file.
+	close(fd);
+
+	if (base == MAP_FAILED) throw runtime_error("cannot map " + _path);
+
+	_base = (char*)base;
+	_n_bytes = n_bytes;
+}
+
+checkpoint_t::checkpoint_t(const checkpoint_params_t& params, uint64_t fingerprint,
+		const candidate_generator_t& generator, uint32_t n_points, uint32_t n_dims,
+		uint32_t k, bool with_distances)
+: _path(params.path), _base(NULL), _n_bytes(0), _interval(params.interval),
+  _last_flush(omp_get_wtime())
+{
+	const vector<cluster_t>& clusters = generator.partition(0);
+
+	checkpoint_header_t header;
+	memset(&header, 0, sizeof(header));
+
+	memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+	header.version = version;
+	header.with_distances = with_distances;
+	header.fingerprint = fingerprint;
+	header.n_points = n_points;
+	header.n_dims = n_dims;
+	header.k = k;
+	header.n_partitions = generator.n_partitions();
+	header.n_clusters = clusters.size();
+
+	for (uint32_t c_partition = 0; c_partition < header.n_partitions; ++c_partition) {
+		_first_flags.push_back(header.n_flags);
+		header.n_flags += generator.partition(c_partition).size();
+	}
+
+	header.partitions_offset = page_size;
+	header.centroids_offset = _round_up(header.partitions_offset
+			+ (size_t)header.n_partitions * sizeof(uint32_t), page_size);
+	header.assignments_offset = _round_up(header.centroids_offset
+			+ (size_t)header.n_clusters * n_dims * sizeof(float), page_size);
+	header.flags_offset = _round_up(header.assignments_offset
+			+ (size_t)n_points * sizeof(uint32_t), page_size);
+	header.saved_offset = _round_up(header.flags_offset + header.n_flags, page_size);
+	header.rows_offset = _round_up(header.saved_offset + n_points, page_size);
+	header.distances_offset = _round_up(header.rows_offset
+			+ (size_t)n_points * k * sizeof(uint32_t), page_size);
+
+	// The flags start cleared, the rows are holes until saved.
+	int fd = open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) throw runtime_error("cannot create " + _path);
+
+	bool failed = (ftruncate(fd, _file_size(header)) < 0);
+	close(fd);
+
+	if (failed) throw runtime_error("cannot resize " + _path);
+
+	_map(_file_size(header));
+
+	uint32_t* partition_sizes = _section<uint32_t>(header.partitions_offset);
+	for (uint32_t c_partition = 0; c_partition < header.n_partitions; ++c_partition)
+		partition_sizes[c_partition] = generator.partition(c_partition).size();
+
+	float* centroids = _section<float>(header.centroids_offset);
+	uint32_t* assignments = _section<uint32_t>(header.assignments_offset);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (uint32_t c_cluster = 0; c_cluster < clusters.size(); ++c_cluster) {
+		copy(clusters[c_cluster].centroid(), clusters[c_cluster].centroid() + n_dims,
+				centroids + (size_t)c_cluster * n_dims);
+
+		for (uint32_t point_id : clusters[c_cluster].points())
+			assignments[point_id] = c_cluster;
+	}
+
+	// The header last, a checkpoint cut short is never valid.
+	flush(true);
+	_header() = header;
+	flush(true);
+}
+
+checkpoint_t::checkpoint_t(const checkpoint_params_t& params, uint64_t fingerprint)
+: _path(params.path), _base(NULL), _n_bytes(0), _interval(params.interval),
+  _last_flush(omp_get_wtime())
+{
+	_map(0);
+
+	const checkpoint_header_t& header = _header();
+	string error;
+
+	if (memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0)
+		error = _path + " is not a checkpoint";
+	else if (header.version != version)
+		error = _path + " is a checkpoint of version " + to_string(header.version)
+			+ ", not " + to_string(version);
+	else if (_file_size(header) > _n_bytes)
+		error = _path + " is truncated";
+	else if (header.fingerprint != fingerprint)
+		error = _path + " is a checkpoint of another run";
+
+	if (!error.empty()) {
+		munmap(_base, _n_bytes);
+		throw runtime_error(error);
+	}
+
+	const uint32_t* partition_sizes = _section<uint32_t>(header.partitions_offset);
+	uint32_t n_flags = 0;
+
+	for (uint32_t c_partition = 0; c_partition < header.n_partitions; ++c_partition) {
+		_first_flags.push_back(n_flags);
+		n_flags += partition_sizes[c_partition];
+	}
+}
+
+checkpoint_t::~checkpoint_t()
+{
+	if (_base == NULL) return;
+
+	flush(false);
+	munmap(_base, _n_bytes);
+}
+
+uint32_t checkpoint_t::n_points() const
+{
+	return _header().n_points;
+}
+
+uint32_t checkpoint_t::n_clusters() const
+{
+	return _header().n_clusters;
+}
+
+const float* checkpoint_t::centroids() const
+{
+	return _section<float>(_header().centroids_offset);
+}
+
+const uint32_t* checkpoint_t::assignments() const
+{
+	return _section<uint32_t>(_header().assignments_offset);
+}
+
+bool checkpoint_t::matches(const candidate_generator_t& generator) const
+{
+	const checkpoint_header_t& header = _header();
+	const uint32_t* partition_sizes = _section<uint32_t>(header.partitions_offset);
+
+	if (generator.n_partitions() != header.n_partitions) return false;
+
+	for (uint32_t c_partition = 0; c_partition < header.n_partitions; ++c_partition)
+		if (generator.partition(c_partition).size() != partition_sizes[c_partition])
+			return false;
+
+	return true;
+}
+
+void checkpoint_t::cluster_done(uint32_t c_partition, uint32_t c_cluster,
+		const vector<uint32_t>& members, const graph_t& knng)
+{
+	const checkpoint_header_t& header = _header();
+	uint32_t k = header.k;
+
+	uint8_t* saved = _section<uint8_t>(header.saved_offset);
+	uint32_t* rows = _section<uint32_t>(header.rows_offset);
+	float* distances = _section<float>(header.distances_offset);
+
+	for (uint32_t point_id : members) {
+		copy(knng.row(point_id), knng.row(point_id) + k, rows + (size_t)point_id * k);
+
+		if (header.with_distances)
+			copy(knng.distances(point_id), knng.distances(point_id) + k,
+					distances + (size_t)point_id * k);
+
+		saved[point_id] = 1;
+	}
+
+	// Done only once its rows are in.
+	uint8_t* flags = _section<uint8_t>(header.flags_offset);
+	__atomic_store_n(&flags[_first_flags[c_partition] + c_cluster], 1, __ATOMIC_RELEASE);
+
+	if (omp_get_wtime() - _last_flush < _interval) return;
+
+	// A single thread flushes, the others don't wait for it.
+	unique_lock<mutex> guard(_flush_lock, try_to_lock);
+
+	if (guard.owns_lock() && omp_get_wtime() - _last_flush >= _interval) {
+		flush(false);
+		_last_flush = omp_get_wtime();
+	}
+}
+
+uint32_t checkpoint_t::restore_rows(graph_t& knng) const
+{
+	const checkpoint_header_t& header = _header();
+	uint32_t k = header.k;
+	bool with_distances = header.with_distances && knng.has_distances();
+
+	const uint8_t* saved = _section<uint8_t>(header.saved_offset);
+	const uint32_t* rows = _section<uint32_t>(header.rows_offset);
+	const float* distances = _section<float>(header.distances_offset);
+
+	uint32_t n_restored = 0;
+
+	#pragma omp parallel for schedule(dynamic, 1024) reduction(+: n_restored)
+	for (uint32_t point_id = 0; point_id < header.n_points; ++point_id) {
+		if (!saved[point_id]) continue;
+
+		copy(rows + (size_t)point_id * k, rows + (size_t)(point_id + 1) * k, knng.row(point_id));
+
+		if (with_distances)
+			copy(distances + (size_t)point_id * k, distances + (size_t)(point_id + 1) * k,
+					knng.distances(point_id));
+
+		++n_restored;
+	}
+
+	return n_restored;
+}
+
+void checkpoint_t::flush(bool wait)
+{
+	msync(_base, _n_bytes, wait ? MS_SYNC : MS_ASYNC);
+}
+
+checkpoint_generator_t::checkpoint_generator_t(const checkpoint_t& checkpoint,
+		uint32_t n_dims, vector<point_t>& points)
+: _checkpoint(checkpoint), _n_dims(n_dims), _points(points)
+{
+	/* Empty. */
+}
+
+void checkpoint_generator_t::run()
+{
+	const float* centroids = _checkpoint.centroids();
+	const uint32_t* assignments = _checkpoint.assignments();
+	uint32_t n_points = _checkpoint.n_points();
+	uint32_t n_clusters = _checkpoint.n_clusters();
+
+	_clusters.clear();
+	for (uint32_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster)
+		_clusters.push_back(cluster_t(c_cluster + 1, centroids + (size_t)c_cluster * _n_dims,
+				_n_dims));
+
+	for (uint32_t point_id = 0; point_id < n_points; ++point_id) {
+		_clusters[assignments[point_id]].add_point(point_id);
+		_points[point_id].cluster(&_clusters[assignments[point_id]]);
+	}
+}
+
+uint32_t checkpoint_generator_t::n_partitions() const
+{
+	return 1;
+}
+
+const vector<cluster_t>& checkpoint_generator_t::partition(uint32_t c_partition) const
+{
+	if (c_partition != 0)
+		throw out_of_range("a checkpoint has a single partition, not " + to_string(c_partition));
+
+	return _clusters;
+}
+
+void checkpoint_generator_t::describe(run_report_t& report) const
+{
+	// No iterations, they were before the checkpoint.
+	report.resumed = true;
+}
+
+uint64_t checkpoint_fingerprint(const config_t& config, const dataset_t& dataset,
+		uint32_t n_dims)
+{
+	// FNV-1a over the bytes of each value.
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	auto mix_bytes = [&](const void* data, size_t n_bytes) {
+		const unsigned char* bytes = (const unsigned char*)data;
+
+		for (size_t c_byte = 0; c_byte < n_bytes; ++c_byte) {
+			hash ^= bytes[c_byte];
+			hash *= 0x100000001b3ULL;
+		}
+	};
+
+	auto mix = [&](const auto& value) {
+		mix_bytes(&value, sizeof(value));
+	};
+
+	uint32_t n_points = dataset.n_points();
+	uint32_t dataset_dims = dataset.n_dims();
+
+	mix(n_points);
+	mix(dataset_dims);
+	mix(n_dims);
+
+	// A sample of the rows, an edited or another dataset of the same size
+	// gets another fingerprint without reading all of it.
+	uint32_t n_rows = min(n_points, fingerprint_rows);
+	for (uint32_t c_row = 0; c_row < n_rows; ++c_row) {
+		uint32_t point_id = (n_rows == 1) ? 0 :
+			(uint32_t)((uint64_t)c_row * (n_points - 1) / (n_rows - 1));
+
+		mix_bytes(dataset.row(point_id), (size_t)dataset_dims * sizeof(float));
+	}
+
+	mix(config.k);
+	mix(config.seed);
+	mix(config.engine);
+	mix(config.kmeans_params.n_clusters);
+	mix(config.kmeans_params.n_iters);
+	mix(config.kmeans_params.accelerated);
+	mix(config.kmeans_params.init);
+	mix(config.kmeans_params.sample_size);
+	mix(config.kmeans_params.batch_size);
+	mix(config.max_cluster_size);
+	mix(config.branching);
+	mix(config.balance);
+	mix(config.rpforest_params.n_trees);
+	mix(config.rpforest_params.leaf_size);
+	mix(config.pca_params.enabled);
+	mix(config.pca_params.n_leading);
+	mix(config.pca_params.variance);
+	mix(config.pca_params.clustering);
+	mix(config.symmetric);
+	mix(config.quantization);
+	mix(config.n_probes);
+	mix(config.overlap_ratio);
+	mix(config.refine);
+
+	return hash;
+}
@@ -1,8 +1,9 @@
+#include <algorithm>
 #include "cluster.hpp"
 #include "helpers.hpp"
 
-cluster_t::cluster_t(uint32_t cluster_id, const point_t& centroid)
-: _cluster_id(cluster_id), _centroid(centroid)
+cluster_t::cluster_t(uint32_t cluster_id, const float* centroid, uint32_t n_dims)
+: _cluster_id(cluster_id), _centroid(centroid, centroid + n_dims)
 {
 	/* Empty. */
 }
@@ -12,49 +13,47 @@ uint32_t cluster_t::id() const
 	return _cluster_id;
 }
 
-const point_t& cluster_t::centroid() const
+const float* cluster_t::centroid() const
 {
-	return _centroid;
+	return _centroid.data();
 }
 
-void cluster_t::centroid(const point_t& centroid)
+void cluster_t::centroid(const float* centroid)
 {
-	_centroid = centroid;
+	copy(centroid, centroid + _centroid.size(), _centroid.begin());
 }
 
-void cluster_t::recenter()
+void cluster_t::recenter(const dataset_t& dataset)
 {
 	// We don't have any points to use for the computation of centroid.
 	if (_points.empty()) return;
 
-	size_t n_dims = _points.front().coords().size();
+	size_t n_dims = _centroid.size();
 
-	// The coordinates of the new centroid.
-	vector<float> centroid(n_dims);
+	// The coordinates of the new centroid. Accumulate in double.
+	vector<double> centroid(n_dims, 0.0);
 
-	for (size_t c_dim = 0; c_dim < n_dims; ++c_dim) {
-		double dim_value = 0.0;
-
-		#pragma omp parallel for reduction(+: dim_value)
-		for (const auto& point : _points)
-			dim_value += point.coords().at(c_dim);
+	// Stream over the rows of the members, one row at a time.
+	for (uint32_t point_id : _points) {
+		const float* coords = dataset.row(point_id);
 
-		centroid[c_dim] = dim_value / _points.size();
+		for (size_t c_dim = 0; c_dim < n_dims; ++c_dim)
+			centroid[c_dim] += coords[c_dim];
 	}
 
-	_centroid = point_t(0, centroid);
+	for (size_t c_dim = 0; c_dim < n_dims; ++c_dim)
+		_centroid[c_dim] = centroid[c_dim] / _points.size();
 }
 
-void cluster_t::add_point(const point_t& point)
+void cluster_t::add_point(uint32_t point_id)
 {
-	#pragma omp critical
-	_points.push_back(point);
+	_points.push_back(point_id);
 }
 
 bool cluster_t::remove_point(uint32_t point_id)
 {
 	for (auto iter = _points.begin(); iter != _points.end(); ++iter) {
-		if (iter->id() != point_id) continue;
+		if (*iter != point_id) continue;
 
 		_points.erase(iter);
 		return true;
@@ -63,11 +62,16 @@ bool cluster_t::remove_point(uint32_t point_id)
 	return false;
 }
 
-const vector<point_t>& cluster_t::points() const
+const vector<uint32_t>& cluster_t::points() const
 {
 	return _points;
 }
 
+void cluster_t::points(const uint32_t* point_ids, size_t n_points)
+{
+	_points.assign(point_ids, point_ids + n_points);
+}
+
 void cluster_t::clear()
 {
 	_points.clear();
@@ -75,12 +79,23 @@ void cluster_t::clear()
 
 void cluster_t::print(ostream& outstream, string indent) const
 {
+	size_t n_dims = _centroid.size();
+
 	outstream << indent << "Cluster:" << endl;
 	outstream << indent << "\tID = " << _cluster_id << endl;
 	outstream << indent << "\tCentroid:" << endl;
-	_centroid.print(outstream, indent + "\t\t");
+	for (size_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+		if (c_dim % 10 == 0)
+			outstream << indent + "\t\t";
+
+		outstream << _centroid[c_dim] << ' ';
+
+		if (c_dim % 10 == 9)
+			outstream << endl;
+	}
+	outstream << endl;
 	outstream << indent << "\tPoints:" << endl;
 	outstream << indent << "\t# points = " << _points.size() << endl;
-	for (const point_t& point : _points)
-		point.print(outstream, indent + "\t\t");
+	for (uint32_t point_id : _points)
+		outstream << indent << "\t\t" << point_id << endl;
 }
@@ -0,0 +1,287 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "config.hpp"
+
+using namespace std;
+
+bool parse_config(int argc, char** argv, config_t& config)
+{
+	// The positional arguments seen so far.
+	uint32_t n_positional = 0;
+
+	for (int c_arg = 1; c_arg < argc; ++c_arg) {
+		string arg = argv[c_arg];
+
+		if (arg == "--help" || arg == "-h") return false;
+
+		// Flags without a value.
+		if (arg == "--refine") {
+			config.refine = true;
+			continue;
+		}
+
+		if (arg == "--perf") {
+			config.hardware_counters = true;
+			continue;
+		}
+
+		if (arg == "--symmetric") {
+			config.symmetric = true;
+			continue;
+		}
+
+		if (arg == "--pca") {
+			config.pca_params.enabled = true;
+			continue;
+		}
+
+		if (arg == "--pca-cluster") {
+			config.pca_params.enabled = true;
+			config.pca_params.clustering = true;
+			continue;
+		}
+
+		if (arg == "--resume") {
+			config.checkpoint_params.resume = true;
+			continue;
+		}
+
+		if (arg == "--kmeans-accel") {
+			config.kmeans_params.accelerated = true;
+			continue;
+		}
+
+		if (arg.compare(0, 2, "--") != 0) {
+			if (n_positional == 0)
+				config.dataset_path = arg;
+			else if (n_positional == 1)
+				config.kmeans_params.n_clusters = atoll(arg.c_str());
+			else {
+				cerr << "Unexpected argument " << arg << endl;
+				return false;
+			}
+
+			++n_positional;
+			continue;
+		}
+
+		// Every other option takes a value.
+		if (c_arg + 1 == argc) {
+			cerr << "Missing value of " << arg << endl;
+			return false;
+		}
+
+		const char* value = argv[++c_arg];
+
+		if (arg == "--output")
+			config.output_path = value;
+		else if (arg == "--report")
+			config.report_path = value;
+		else if (arg == "--engine") {
+			if (string(value) == "kmeans")
+				config.engine = engine_t::kmeans;
+			else if (string(value) == "rpforest")
+				config.engine = engine_t::rpforest;
+			else {
+				cerr << "Unknown engine " << value << endl;
+				return false;
+			}
+		}
+		else if (arg == "--trees")
+			config.rpforest_params.n_trees = atoll(value);
+		else if (arg == "--leaf-size")
+			config.rpforest_params.leaf_size = atoll(value);
+		else if (arg == "--clusters")
+			config.kmeans_params.n_clusters = atoll(value);
+		else if (arg == "--kmeans-iters")
+			config.kmeans_params.n_iters = atoll(value);
+		else if (arg == "--kmeans-init") {
+			if (string(value) == "random")
+				config.kmeans_params.init = kmeans_init_t::random;
+			else if (string(value) == "kmeans++")
+				config.kmeans_params.init = kmeans_init_t::plusplus;
+			else {
+				cerr << "Unknown K-Means initialization " << value << endl;
+				return false;
+			}
+		}
+		else if (arg == "--kmeans-sample")
+			config.kmeans_params.sample_size = atoll(value);
+		else if (arg == "--kmeans-batch")
+			config.kmeans_params.batch_size = atoll(value);
+		else if (arg == "--max-cluster-size")
+			config.max_cluster_size = atoll(value);
+		else if (arg == "--branching")
+			config.branching = atoll(value);
+		else if (arg == "--balance")
+			config.balance = atof(value);
+		else if (arg == "--quantize") {
+			if (string(value) == "none")
+				config.quantization = quantization_t::none;
+			else if (string(value) == "int8")
+				config.quantization = quantization_t::int8;
+			else if (string(value) == "fp16")
+				config.quantization = quantization_t::fp16;
+			else {
+				cerr << "Unknown quantization " << value << endl;
+				return false;
+			}
+		}
+		else if (arg == "--rerank")
+			config.rerank = atoll(value);
+		else if (arg == "--pq")
+			config.pq_params.n_subspaces = atoll(value);
+		else if (arg == "--pq-bits")
+			config.pq_params.n_bits = atoll(value);
+		else if (arg == "--pq-sample")
+			config.pq_params.sample_size = atoll(value);
+		else if (arg == "--pca-dims")
+			config.pca_params.n_leading = atoll(value);
+		else if (arg == "--pca-variance")
+			config.pca_params.variance = atof(value);
+		else if (arg == "--probes")
+			config.n_probes = atoll(value);
+		else if (arg == "--overlap")
+			config.overlap_ratio = atof(value);
+		else if (arg == "--refine-iters")
+			config.refine_params.n_iters = atoll(value);
+		else if (arg == "--refine-sample")
+			config.refine_params.sample_rate = atof(value);
+		else if (arg == "--refine-random")
+			config.refine_params.n_random = atoll(value);
+		else if (arg == "--refine-delta")
+			config.refine_params.delta = atof(value);
+		else if (arg == "--refine-time")
+			config.refine_params.time_budget = atof(value);
+		else if (arg == "--save-index")
+			config.index_path = value;
+		else if (arg == "--append") {
+			config.index_path = value;
+			config.append = true;
+		}
+		else if (arg == "--stream") {
+			config.streaming_params.enabled = true;
+			config.streaming_params.spill_dir = value;
+		}
+		else if (arg == "--stream-memory")
+			config.streaming_params.memory_gb = atof(value);
+		else if (arg == "--stream-sample")
+			config.streaming_params.sample_size = atoll(value);
+		else if (arg == "--stream-overlap")
+			config.streaming_params.overlap = atof(value);
+		else if (arg == "--checkpoint")
+			config.checkpoint_params.path = value;
+		else if (arg == "--checkpoint-interval")
+			config.checkpoint_params.interval = atof(value);
+		else if (arg == "--time-budget")
+			config.time_budget = atof(value);
+		else if (arg == "--seed")
+			config.seed = strtoull(value, NULL, 10);
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return false;
+		}
+	}
+
+	if (config.branching < 2) {
+		cerr << "The branching factor must be at least 2" << endl;
+		return false;
+	}
+
+	if (config.pq_params.n_bits != 4 && config.pq_params.n_bits != 8) {
+		cerr << "The bits of a product quantization code must be 4 or 8" << endl;
+		return false;
+	}
+
+	if (config.streaming_params.enabled && !config.index_path.empty()) {
+		cerr << "An index can't be saved or appended to out of core" << endl;
+		return false;
+	}
+
+	if (config.overlap_ratio > 0.0f && config.n_probes <= 1) {
+		cerr << "--overlap needs --probes above 1" << endl;
+		return false;
+	}
+
+	if (config.checkpoint_params.resume && config.checkpoint_params.path.empty()) {
+		cerr << "Nothing to resume without --checkpoint" << endl;
+		return false;
+	}
+
+	if (!config.checkpoint_params.path.empty()
+			&& (config.streaming_params.enabled || config.append)) {
+		cerr << "Only an in-memory build can be checkpointed" << endl;
+		return false;
+	}
+
+	if (config.kmeans_params.n_clusters == 0) {
+		cerr << "The number of clusters must be positive" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+void print_usage(ostream& outstream, const char* program)
+{
+	outstream << "Usage: " << program << " [dataset] [# clusters] [options]" << endl;
+	outstream << endl;
+	outstream << "Options:" << endl;
+	outstream << "\t--output PATH          Where to write the knng." << endl;
+	outstream << "\t--report PATH          Write a JSON report of the run's phases." << endl;
+	outstream << "\t--perf                 Add hardware counters to the report." << endl;
+	outstream << "\t--engine ENGINE        Cut the points with kmeans or rpforest." << endl;
+	outstream << "\t--trees N              The trees of the random projection forest." << endl;
+	outstream << "\t--leaf-size N          The maximum points of a leaf." << endl;
+	outstream << "\t--clusters N           The number of clusters to create." << endl;
+	outstream << "\t--kmeans-iters N       The maximum iterations of K-Means." << endl;
+	outstream << "\t--kmeans-accel         Skip K-Means distances with Hamerly's bounds." << endl;
+	outstream << "\t--kmeans-init INIT     Seed K-Means with random or kmeans++." << endl;
+	outstream << "\t--kmeans-sample N      Train K-Means on N sampled points." << endl;
+	outstream << "\t--kmeans-batch N       Train K-Means with mini-batches of N points." << endl;
+	outstream << "\t--max-cluster-size N   Split clusters hierarchically until they" << endl;
+	outstream << "\t                       have at most N points." << endl;
+	outstream << "\t--branching N          The maximum children of a split." << endl;
+	outstream << "\t--balance F            Limit children to F times a fair share." << endl;
+	outstream << "\t--symmetric            Evaluate each pair of a cluster once." << endl;
+	outstream << "\t--quantize TYPE        Scan candidates as none, int8 or fp16 codes." << endl;
+	outstream << "\t--rerank R             Re-rank R * k scanned candidates in float." << endl;
+	outstream << "\t--pq M                 Filter the candidates with product" << endl;
+	outstream << "\t                       quantization, M groups of dimensions." << endl;
+	outstream << "\t--pq-bits B            The bits of a group's code, 4 or 8." << endl;
+	outstream << "\t--pq-sample N          Train the codebooks on N points." << endl;
+	outstream << "\t--pca                  Rotate the points onto their principal" << endl;
+	outstream << "\t                       axes, abandon candidates early. Keeps a" << endl;
+	outstream << "\t                       rotated copy, twice the dataset's memory." << endl;
+	outstream << "\t--pca-dims D           Abandon on the D leading dimensions." << endl;
+	outstream << "\t--pca-variance F       Or on those that explain F of the variance." << endl;
+	outstream << "\t--pca-cluster          Also cluster on the leading dimensions." << endl;
+	outstream << "\t--probes N             Search the N nearest clusters per point." << endl;
+	outstream << "\t                       Packs every cluster up front, a second" << endl;
+	outstream << "\t                       copy of the dataset." << endl;
+	outstream << "\t--overlap R            Instead, copy points into those of their" << endl;
+	outstream << "\t                       N nearest clusters within R times the" << endl;
+	outstream << "\t                       distance to their nearest cluster. Needs" << endl;
+	outstream << "\t                       --probes N > 1." << endl;
+	outstream << "\t--refine               Refine the knng with NN-Descent." << endl;
+	outstream << "\t--refine-iters N       The maximum iterations of NN-Descent." << endl;
+	outstream << "\t--refine-sample R      The fraction of k sampled per point." << endl;
+	outstream << "\t--refine-random N      Random points joined per point." << endl;
+	outstream << "\t--refine-delta D       Stop below D * n * k updates." << endl;
+	outstream << "\t--refine-time SECS     The time budget of NN-Descent." << endl;
+	outstream << "\t--save-index PATH      Save the knng and its clusters as an index." << endl;
+	outstream << "\t--append PATH          Add the new points of the dataset to the" << endl;
+	outstream << "\t                       index, write its knng if --output isn't empty." << endl;
+	outstream << "\t--stream DIR           Build out of core, spill buckets to DIR." << endl;
+	outstream << "\t--stream-memory GB     The memory for the buckets." << endl;
+	outstream << "\t--stream-sample N      Train the buckets on N sampled points." << endl;
+	outstream << "\t--stream-overlap R     Copy points into buckets within R times" << endl;
+	outstream << "\t                       the distance to their own." << endl;
+	outstream << "\t--checkpoint PATH      Checkpoint the clustering and the search." << endl;
+	outstream << "\t--checkpoint-interval SECS" << endl;
+	outstream << "\t                       The least seconds between two flushes." << endl;
+	outstream << "\t--resume               Continue from the checkpoint of this run." << endl;
+	outstream << "\t--seed N               The seed of the random choices." << endl;
+	outstream << "\t--time-budget SECS     Write the best knng found in SECS." << endl;
+}
@@ -0,0 +1,191 @@
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dataset.hpp"
+
+using namespace std;
+
+// Transparent huge pages are 2MB on x86-64.
+static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+/*
+ * @brief Round @n_bytes up to the next multiple of @multiple.
+ */
+static inline size_t _round_up(size_t n_bytes, size_t multiple)
+{
+	return (n_bytes + multiple - 1) / multiple * multiple;
+}
+
+dataset_t::dataset_t()
+: _n_points(0), _n_dims(0), _base(NULL), _data(NULL), _n_bytes(0), _mapped(false)
+{
+	/* Empty. */
+}
+
+dataset_t::dataset_t(uint32_t n_points, uint32_t n_dims, bool huge_pages)
+: _n_points(n_points), _n_dims(n_dims), _base(NULL), _data(NULL), _n_bytes(0),
+  _mapped(false)
+{
+	size_t n_bytes = (size_t)n_points * n_dims * sizeof(float);
+
+	if (n_bytes == 0) return;
+
+	/*
+	 * Huge pages only pay off for large matrices. mmap returns page aligned
+	 * memory, which also satisfies our alignment. If the mapping fails we
+	 * fall back to the regular allocator.
+	 */
+	if (huge_pages && n_bytes >= huge_page_size) {
+		_n_bytes = _round_up(n_bytes, huge_page_size);
+
+		void* data = mmap(NULL, _n_bytes, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (data != MAP_FAILED) {
+			madvise(data, _n_bytes, MADV_HUGEPAGE);
+
+			_base = data;
+			_data = (float*)data;
+			_mapped = true;
+
+			return;
+		}
+	}
+
+	// aligned_alloc requires the size to be a multiple of the alignment.
+	_n_bytes = _round_up(n_bytes, alignment);
+	_base = aligned_alloc(alignment, _n_bytes);
+	_data = (float*)_base;
+
+	if (_data == NULL) throw bad_alloc();
+}
+
+dataset_t::dataset_t(const string& path, uint32_t n_dims)
+: _n_points(0), _n_dims(n_dims), _base(NULL), _data(NULL), _n_bytes(0), _mapped(true)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw runtime_error("cannot open " + path);
+
+	struct stat status;
+	if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(uint32_t)) {
+		close(fd);
+		throw runtime_error("cannot stat " + path);
+	}
+
+	_n_bytes = status.st_size;
+
+	/*
+	 * Read-only, the rows are the page cache's pages and nothing is copied.
+	 * Writable, MAP_POPULATE would write-fault every page into a private
+	 * copy. No stage writes a loaded dataset, they all build new ones.
+	 * MAP_POPULATE reads the whole file now, in large sequential requests,
+	 * instead of faulting one page at a time.
+	 */
+	void* base = mmap(NULL, _n_bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+
+	// The mapping keeps its own reference to the file.
+	close(fd);
+
+	if (base == MAP_FAILED) throw runtime_error("cannot map " + path);
+
+	madvise(base, _n_bytes, MADV_WILLNEED);
+
+	_base = base;
+	_data = (float*)((char*)base + sizeof(uint32_t));
+
+	// Trust the header only as far as the file actually goes.
+	uint32_t n_points = *(const uint32_t*)base;
+	size_t n_complete = (_n_bytes - sizeof(uint32_t)) / (n_dims * sizeof(float));
+
+	_n_points = (n_points < n_complete) ? n_points : n_complete;
+}
+
+dataset_t::dataset_t(dataset_t&& other) noexcept
+: _n_points(other._n_points), _n_dims(other._n_dims), _base(other._base),
+  _data(other._data), _n_bytes(other._n_bytes), _mapped(other._mapped)
+{
+	other._base = NULL;
+	other._data = NULL;
+	other._n_bytes = 0;
+	other._n_points = 0;
+}
+
+dataset_t& dataset_t::operator=(dataset_t&& other) noexcept
+{
+	if (this == &other) return *this;
+
+	_release();
+
+	_n_points = other._n_points;
+	_n_dims = other._n_dims;
+	_base = other._base;
+	_data = other._data;
+	_n_bytes = other._n_bytes;
+	_mapped = other._mapped;
+
+	other._base = NULL;
+	other._data = NULL;
+	other._n_bytes = 0;
+	other._n_points = 0;
+
+	return *this;
+}
+
+dataset_t::~dataset_t()
+{
+	_release();
+}
+
+void dataset_t::_release()
+{
+	if (_base == NULL) return;
+
+	if (_mapped)
+		munmap(_base, _n_bytes);
+	else
+		free(_base);
+
+	_base = NULL;
+	_data = NULL;
+}
+
+uint32_t dataset_t::n_points() const
+{
+	return _n_points;
+}
+
+uint32_t dataset_t::n_dims() const
+{
+	return _n_dims;
+}
+
+const float* dataset_t::data() const
+{
+	return _data;
+}
+
+float* dataset_t::data()
+{
+	return _data;
+}
+
+void dataset_t::truncate(uint32_t n_points)
+{
+	if (n_points < _n_points) _n_points = n_points;
+}
+
+vector<point_t> dataset_t::points() const
+{
+	vector<point_t> points;
+	points.reserve(_n_points);
+
+	for (uint32_t c_point = 0; c_point < _n_points; ++c_point)
+		points.push_back(point_t(c_point, row(c_point), _n_dims));
+
+	return points;
+}
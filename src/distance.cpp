@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <immintrin.h>
+#include "distance.hpp"
+
+using namespace std;
+
+float l2_sqr_scalar(const float* coords1, const float* coords2, uint32_t n_dims)
+{
+	// Four independent sums, so consecutive additions don't wait each other.
+	float sums[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	uint32_t c_dim = 0;
+
+	for (; c_dim + 4 <= n_dims; c_dim += 4)
+		for (uint32_t c_lane = 0; c_lane < 4; ++c_lane) {
+			float diff = coords1[c_dim + c_lane] - coords2[c_dim + c_lane];
+			sums[c_lane] += diff * diff;
+		}
+
+	for (; c_dim < n_dims; ++c_dim) {
+		float diff = coords1[c_dim] - coords2[c_dim];
+		sums[0] += diff * diff;
+	}
+
+	return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+__attribute__((target("avx2,fma")))
+float l2_sqr_avx2(const float* coords1, const float* coords2, uint32_t n_dims)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	uint32_t c_dim = 0;
+
+	// Two accumulators to hide the latency of the FMAs.
+	for (; c_dim + 16 <= n_dims; c_dim += 16) {
+		__m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(coords1 + c_dim),
+				_mm256_loadu_ps(coords2 + c_dim));
+		__m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(coords1 + c_dim + 8),
+				_mm256_loadu_ps(coords2 + c_dim + 8));
+
+		sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+		sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+	}
+
+	for (; c_dim + 8 <= n_dims; c_dim += 8) {
+		__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(coords1 + c_dim),
+				_mm256_loadu_ps(coords2 + c_dim));
+
+		sum0 = _mm256_fmadd_ps(diff, diff, sum0);
+	}
+
+	// Horizontal sum of the eight lanes.
+	__m256 sum = _mm256_add_ps(sum0, sum1);
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_add_ss(half, _mm_movehdup_ps(half));
+
+	float distance = _mm_cvtss_f32(half);
+
+	// The remaining dimensions, fewer than eight.
+	for (; c_dim < n_dims; ++c_dim) {
+		float diff = coords1[c_dim] - coords2[c_dim];
+		distance += diff * diff;
+	}
+
+	return distance;
+}
+
+__attribute__((target("avx512f")))
+float l2_sqr_avx512(const float* coords1, const float* coords2, uint32_t n_dims)
+{
+	__m512 sum0 = _mm512_setzero_ps();
+	__m512 sum1 = _mm512_setzero_ps();
+	uint32_t c_dim = 0;
+
+	for (; c_dim + 32 <= n_dims; c_dim += 32) {
+		__m512 diff0 = _mm512_sub_ps(_mm512_loadu_ps(coords1 + c_dim),
+				_mm512_loadu_ps(coords2 + c_dim));
+		__m512 diff1 = _mm512_sub_ps(_mm512_loadu_ps(coords1 + c_dim + 16),
+				_mm512_loadu_ps(coords2 + c_dim + 16));
+
+		sum0 = _mm512_fmadd_ps(diff0, diff0, sum0);
+		sum1 = _mm512_fmadd_ps(diff1, diff1, sum1);
+	}
+
+	for (; c_dim + 16 <= n_dims; c_dim += 16) {
+		__m512 diff = _mm512_sub_ps(_mm512_loadu_ps(coords1 + c_dim),
+				_mm512_loadu_ps(coords2 + c_dim));
+
+		sum0 = _mm512_fmadd_ps(diff, diff, sum0);
+	}
+
+	// The remaining dimensions with a masked load, no scalar tail.
+	if (c_dim < n_dims) {
+		__mmask16 mask = (__mmask16)((1u << (n_dims - c_dim)) - 1);
+		__m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, coords1 + c_dim),
+				_mm512_maskz_loadu_ps(mask, coords2 + c_dim));
+
+		sum1 = _mm512_fmadd_ps(diff, diff, sum1);
+	}
+
+	return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+}
+
+/*
+ * @brief Pick the fastest kernel the running CPU supports.
+ *
+ * @return The selected kernel.
+ */
+static l2_sqr_kernel_t _select_l2_sqr()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+		return l2_sqr_avx512;
+
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return l2_sqr_avx2;
+
+	return l2_sqr_scalar;
+}
+
+const l2_sqr_kernel_t l2_sqr = _select_l2_sqr();
+
+const char* distance_isa()
+{
+	if (l2_sqr == l2_sqr_avx512) return "avx512";
+	if (l2_sqr == l2_sqr_avx2) return "avx2";
+
+	return "scalar";
+}
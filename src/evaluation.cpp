@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "evaluation.hpp"
+#include "batch-distance.hpp"
+#include "topk.hpp"
+
+using namespace std;
+
+// The candidates packed at a time by the brute force search.
+static constexpr uint32_t exact_chunk = 4096;
+
+vector<uint32_t> sample_queries(uint32_t n_points, uint32_t n_queries, uint64_t seed)
+{
+	mt19937_64 rng(seed);
+
+	vector<uint32_t> ids(n_points);
+	for (uint32_t c_point = 0; c_point < n_points; ++c_point)
+		ids[c_point] = c_point;
+
+	n_queries = min(n_queries, n_points);
+
+	// Partial Fisher-Yates, the first @n_queries ids are the sample.
+	for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+		swap(ids[c_query], ids[uniform_int_distribution<uint32_t>(c_query, n_points - 1)(rng)]);
+
+	ids.resize(n_queries);
+	sort(ids.begin(), ids.end());
+
+	return ids;
+}
+
+graph_t exact_knn(const dataset_t& dataset, const vector<uint32_t>& queries, uint32_t k)
+{
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_queries = queries.size();
+
+	vector<topk_t> topks;
+	for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+		topks.emplace_back(k);
+
+	graph_t truth(n_queries, k, true);
+
+	#pragma omp parallel
+	{
+		vector<topk_t> topks_thr;
+		for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+			topks_thr.emplace_back(k);
+
+		vector<uint32_t> chunk(exact_chunk);
+
+		#pragma omp for schedule(dynamic)
+		for (uint32_t first = 0; first < n_points; first += exact_chunk) {
+			uint32_t n_cands = min(exact_chunk, n_points - first);
+
+			for (uint32_t c_cand = 0; c_cand < n_cands; ++c_cand)
+				chunk[c_cand] = first + c_cand;
+
+			packed_block_t packed(dataset, chunk.data(), n_cands);
+			knn_search_block(dataset, queries.data(), n_queries, packed, topks_thr.data());
+		}
+
+		// Merge the knn of the threads, one thread at a time.
+		vector<uint32_t> ids(k);
+		vector<float> distances(k);
+
+		#pragma omp critical
+		for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+			uint32_t n_found = topks_thr[c_query].write(ids.data(), distances.data());
+
+			for (uint32_t c_found = 0; c_found < n_found; ++c_found)
+				topks[c_query].push(distances[c_found], ids[c_found]);
+		}
+	}
+
+	for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+		uint32_t n_found = topks[c_query].write(truth.row(c_query), truth.distances(c_query));
+
+		if (n_found < k) truth.pad_row(c_query, n_found);
+	}
+
+	return truth;
+}
+
+double recall(const graph_t& knng, const vector<uint32_t>& queries, const graph_t& truth)
+{
+	uint32_t k = knng.k();
+	size_t n_hits = 0;
+
+	#pragma omp parallel for reduction(+: n_hits)
+	for (size_t c_query = 0; c_query < queries.size(); ++c_query) {
+		// Padded rows repeat neighbors, count each one once.
+		vector<uint32_t> found(knng.row(queries[c_query]), knng.row(queries[c_query]) + k);
+		vector<uint32_t> exact(truth.row(c_query), truth.row(c_query) + k);
+
+		sort(found.begin(), found.end());
+		found.erase(unique(found.begin(), found.end()), found.end());
+		sort(exact.begin(), exact.end());
+		exact.erase(unique(exact.begin(), exact.end()), exact.end());
+
+		vector<uint32_t> hits;
+		set_intersection(found.begin(), found.end(), exact.begin(), exact.end(),
+				back_inserter(hits));
+
+		n_hits += hits.size();
+	}
+
+	return queries.empty() ? 0.0 : (double)n_hits / ((double)queries.size() * k);
+}
@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "generator.hpp"
+
+using namespace std;
+
+kmeans_generator_t::kmeans_generator_t(const kmeans_params_t& params,
+		uint32_t max_cluster_size, uint32_t branching, float balance,
+		const dataset_t& dataset, vector<point_t>& points)
+: _max_cluster_size(max_cluster_size), _kmeans(params, dataset, points),
+  _hkmeans(max_cluster_size, branching, balance, params, dataset, points)
+{
+	/* Empty. */
+}
+
+void kmeans_generator_t::run()
+{
+	/*
+	 * Keep splitting clusters until they are small enough. The search cost
+	 * of a cluster is quadratic in its size, bounding the size bounds the
+	 * cost of the largest one.
+	 */
+	if (_max_cluster_size > 0)
+		_hkmeans.run();
+	else
+		_kmeans.run();
+}
+
+uint32_t kmeans_generator_t::n_partitions() const
+{
+	return 1;
+}
+
+const vector<cluster_t>& kmeans_generator_t::partition(uint32_t c_partition) const
+{
+	if (c_partition != 0)
+		throw out_of_range("K-Means has a single partition, not " + to_string(c_partition));
+
+	return (_max_cluster_size > 0) ? _hkmeans.clusters() : _kmeans.clusters();
+}
+
+void kmeans_generator_t::describe(run_report_t& report) const
+{
+	if (_max_cluster_size > 0) {
+		report.kmeans_iters = _hkmeans.iterations();
+		report.n_splits = _hkmeans.n_splits();
+	} else {
+		report.kmeans_iters = _kmeans.iterations();
+		report.kmeans_moved = _kmeans.moved();
+	}
+}
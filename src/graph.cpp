@@ -0,0 +1,47 @@
+#include <cstdint>
+#include <limits>
+#include "graph.hpp"
+
+using namespace std;
+
+graph_t::graph_t(uint32_t n_points, uint32_t k, bool with_distances)
+: _n_points(n_points), _k(k), _neighbors(new uint32_t[(size_t)n_points * k])
+{
+	if (with_distances)
+		_distances.reset(new float[(size_t)n_points * k]);
+}
+
+uint32_t graph_t::n_points() const
+{
+	return _n_points;
+}
+
+uint32_t graph_t::k() const
+{
+	return _k;
+}
+
+const uint32_t* graph_t::data() const
+{
+	return _neighbors.get();
+}
+
+bool graph_t::has_distances() const
+{
+	return _distances != nullptr;
+}
+
+void graph_t::pad_row(uint32_t point_id, uint32_t n_found)
+{
+	uint32_t* neighbors = row(point_id);
+
+	for (uint32_t c_slot = n_found; c_slot < _k; ++c_slot) {
+		if (n_found > 0)
+			neighbors[c_slot] = neighbors[c_slot % n_found];
+		else
+			neighbors[c_slot] = (point_id + 1 + c_slot) % _n_points;
+
+		if (has_distances())
+			distances(point_id)[c_slot] = numeric_limits<float>::infinity();
+	}
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "hkmeans.hpp"
+#include "kmeans.hpp"
+#include "helpers.hpp"
+
+using namespace std;
+
+hkmeans_t::hkmeans_t(uint32_t max_size, uint32_t branching, float balance,
+		const kmeans_params_t& params, const dataset_t& dataset,
+		vector<point_t>& points)
+: _max_size(max_size), _min_size(max_size / branching), _branching(branching),
+  _balance(balance), _params(params), _dataset(dataset), _points(points)
+{
+	/* Empty. */
+}
+
+/*
+ * @brief Split @members in two or more children with K-Means.
+ *
+ * A split creates as many children as needed for them to be leaves, but no
+ * more than @_branching. Children below @_min_size fold into their nearest
+ * sibling. If K-Means cannot separate the points, e.g. they are all
+ * duplicates, they are cut in equal chunks instead.
+ *
+ * @param members The ids of the points to split.
+ *
+ * @return The ids of the points of each child.
+ */
+vector<vector<uint32_t>> hkmeans_t::_split(const vector<uint32_t>& members)
+{
+	uint32_t n_dims = _dataset.n_dims();
+	size_t n_members = members.size();
+
+	size_t n_leaves = (n_members + _max_size - 1) / _max_size;
+	uint32_t n_children = max((size_t)2, min((size_t)_branching, n_leaves));
+
+	// Views of the members only. K-Means keeps their global ids.
+	vector<point_t> points;
+	points.reserve(n_members);
+	for (uint32_t point_id : members)
+		points.push_back(point_t(point_id, _dataset.row(point_id), n_dims));
+
+	kmeans_params_t params = _params;
+	params.n_clusters = n_children;
+
+	kmeans_t kmeans(params, _dataset, points);
+	kmeans.run();
+
+	++_n_splits;
+	_iterations += kmeans.iterations();
+
+	vector<vector<uint32_t>> children(n_children);
+	for (const point_t& point : points)
+		children[point.cluster()->id() - 1].push_back(point.id());
+
+	if (_balance > 0.0f)
+		_rebalance(children, kmeans.clusters());
+
+	_fold(children, kmeans.clusters());
+
+	// Drop the empty children. If a single one is left K-Means failed.
+	children.erase(remove_if(children.begin(), children.end(),
+			[](const vector<uint32_t>& child) { return child.empty(); }),
+			children.end());
+
+	if (children.size() > 1) return children;
+
+	size_t chunk = (n_members + n_children - 1) / n_children;
+
+	children.assign(n_children, vector<uint32_t>());
+	for (size_t c_member = 0; c_member < n_members; ++c_member)
+		children[c_member / chunk].push_back(members[c_member]);
+
+	return children;
+}
+
+/*
+ * @brief Enforce the size limit of the children of a split.
+ *
+ * The points of a child over the limit that are furthest from its centroid
+ * move to the nearest child with room left.
+ *
+ * @param children The ids of the points of each child. Updated in place.
+ * @param clusters The clusters of the split, same order as @children.
+ *
+ * @return None.
+ */
+void hkmeans_t::_rebalance(vector<vector<uint32_t>>& children,
+		const vector<cluster_t>& clusters) const
+{
+	uint32_t n_dims = _dataset.n_dims();
+	size_t n_members = 0;
+
+	for (const vector<uint32_t>& child : children)
+		n_members += child.size();
+
+	// A capacity below the fair share could never be satisfied.
+	size_t capacity = max(1.0f, _balance) * n_members / children.size() + 1;
+
+	for (size_t c_child = 0; c_child < children.size(); ++c_child) {
+		vector<uint32_t>& child = children[c_child];
+
+		if (child.size() <= capacity) continue;
+
+		// Nearest to the centroid first, so the furthest are at the back.
+		vector<pair<float, uint32_t>> ranking;
+		ranking.reserve(child.size());
+		for (uint32_t point_id : child)
+			ranking.push_back({euclidean_distance_aprox(clusters[c_child].centroid(),
+					_dataset.row(point_id), n_dims), point_id});
+
+		sort(ranking.begin(), ranking.end());
+
+		child.clear();
+		for (size_t c_rank = 0; c_rank < capacity; ++c_rank)
+			child.push_back(ranking[c_rank].second);
+
+		for (size_t c_rank = capacity; c_rank < ranking.size(); ++c_rank) {
+			uint32_t point_id = ranking[c_rank].second;
+			size_t best_child = c_child;
+			float best_distance = 0.0f;
+
+			for (size_t c_other = 0; c_other < children.size(); ++c_other) {
+				if (c_other == c_child || children[c_other].size() >= capacity)
+					continue;
+
+				float distance = euclidean_distance_aprox(clusters[c_other].centroid(),
+						_dataset.row(point_id), n_dims);
+
+				if (best_child == c_child || distance < best_distance) {
+					best_child = c_other;
+					best_distance = distance;
+				}
+			}
+
+			children[best_child].push_back(point_id);
+		}
+	}
+}
+
+/*
+ * @brief Enforce the minimum size of the children of a split.
+ *
+ * Each child below @_min_size moves whole to the child large enough whose
+ * centroid is nearest to its own. The average child has more than @_min_size
+ * points, so there is always one.
+ *
+ * @param children The ids of the points of each child. Updated in place, the
+ * folded ones are left empty.
+ * @param clusters The clusters of the split, same order as @children.
+ *
+ * @return None.
+ */
+void hkmeans_t::_fold(vector<vector<uint32_t>>& children,
+		const vector<cluster_t>& clusters) const
+{
+	uint32_t n_dims = _dataset.n_dims();
+
+	// Decided up front, a folded child doesn't make its sibling eligible.
+	vector<bool> large(children.size());
+	for (size_t c_child = 0; c_child < children.size(); ++c_child)
+		large[c_child] = (children[c_child].size() >= _min_size);
+
+	for (size_t c_child = 0; c_child < children.size(); ++c_child) {
+		if (large[c_child] || children[c_child].empty()) continue;
+
+		size_t best_child = c_child;
+		float best_distance = 0.0f;
+
+		for (size_t c_other = 0; c_other < children.size(); ++c_other) {
+			if (!large[c_other]) continue;
+
+			float distance = euclidean_distance_aprox(clusters[c_child].centroid(),
+					clusters[c_other].centroid(), n_dims);
+
+			if (best_child == c_child || distance < best_distance) {
+				best_child = c_other;
+				best_distance = distance;
+			}
+		}
+
+		if (best_child == c_child) continue;
+
+		vector<uint32_t>& sibling = children[best_child];
+		sibling.insert(sibling.end(), children[c_child].begin(), children[c_child].end());
+		children[c_child].clear();
+	}
+}
+
+void hkmeans_t::run()
+{
+	uint32_t n_dims = _dataset.n_dims();
+
+	_n_splits = 0;
+	_iterations = 0;
+
+	// The clusters that are still too large, and the finished ones.
+	vector<vector<uint32_t>> pending(1), leaves;
+
+	pending.front().reserve(_points.size());
+	for (const point_t& point : _points)
+		pending.front().push_back(point.id());
+
+	while (!pending.empty()) {
+		vector<uint32_t> members = move(pending.back());
+		pending.pop_back();
+
+		if (members.size() <= _max_size) {
+			leaves.push_back(move(members));
+			continue;
+		}
+
+		for (vector<uint32_t>& child : _split(members))
+			pending.push_back(move(child));
+	}
+
+	// Points keep pointers into @_clusters, it must never reallocate.
+	_clusters.clear();
+	_clusters.reserve(leaves.size());
+
+	// The ids of the points are their index in @_points.
+	for (uint32_t c_leaf = 0; c_leaf < leaves.size(); ++c_leaf) {
+		_clusters.push_back(cluster_t(c_leaf + 1, _dataset.row(leaves[c_leaf].front()), n_dims));
+		cluster_t& cluster = _clusters.back();
+
+		for (uint32_t point_id : leaves[c_leaf]) {
+			cluster.add_point(point_id);
+			_points[point_id].cluster(&cluster);
+		}
+
+		cluster.recenter(_dataset);
+	}
+}
+
+const vector<cluster_t>& hkmeans_t::clusters() const
+{
+	return _clusters;
+}
+
+uint32_t hkmeans_t::n_splits() const
+{
+	return _n_splits;
+}
+
+uint32_t hkmeans_t::iterations() const
+{
+	return _iterations;
+}
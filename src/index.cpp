@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "index.hpp"
+#include "batch-distance.hpp"
+#include "distance.hpp"
+#include "input-output.hpp"
+#include "topk.hpp"
+
+using namespace std;
+
+// The magic bytes of an index file.
+static constexpr char index_magic[8] = "KNNGIDX";
+
+// Sections start on a page.
+static constexpr size_t page_size = 4096;
+
+// Queries per tile of the search of new points.
+static constexpr uint32_t query_tile = 64;
+
+/*
+ * @brief Round @n_bytes up to the next multiple of @multiple.
+ */
+static inline size_t _round_up(size_t n_bytes, size_t multiple)
+{
+	return (n_bytes + multiple - 1) / multiple * multiple;
+}
+
+/*
+ * @brief The header of an empty index, with its sections laid out.
+ */
+static index_header_t
+_layout(uint32_t n_dims, uint32_t k, uint32_t n_clusters, uint32_t capacity)
+{
+	index_header_t header;
+	memset(&header, 0, sizeof(header));
+
+	memcpy(header.magic, index_magic, sizeof(header.magic));
+	header.version = index_t::version;
+	header.n_dims = n_dims;
+	header.k = k;
+	header.n_clusters = n_clusters;
+	header.n_points = 0;
+	header.capacity = capacity;
+
+	header.centroids_offset = page_size;
+	header.sizes_offset = _round_up(header.centroids_offset
+			+ (size_t)n_clusters * n_dims * sizeof(float), page_size);
+	header.assignments_offset = _round_up(header.sizes_offset
+			+ (size_t)n_clusters * sizeof(uint64_t), page_size);
+	header.neighbors_offset = _round_up(header.assignments_offset
+			+ (size_t)capacity * sizeof(uint32_t), page_size);
+	header.distances_offset = _round_up(header.neighbors_offset
+			+ (size_t)capacity * k * sizeof(uint32_t), page_size);
+
+	return header;
+}
+
+// The size of an index file laid out as in @header.
+static size_t
+_file_size(const index_header_t& header)
+{
+	return header.distances_offset + (size_t)header.capacity * header.k * sizeof(float);
+}
+
+index_t::index_t(const string& path, bool writable)
+: _path(path), _base(NULL), _n_bytes(0), _writable(writable)
+{
+	_map();
+}
+
+index_t::index_t(index_t&& other) noexcept
+: _path(move(other._path)), _base(other._base), _n_bytes(other._n_bytes),
+  _writable(other._writable)
+{
+	other._base = NULL;
+	other._n_bytes = 0;
+}
+
+index_t::~index_t()
+{
+	_unmap();
+}
+
+void index_t::_map()
+{
+	int fd = open(_path.c_str(), _writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) throw runtime_error("cannot open " + _path);
+
+	struct stat status;
+	if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(index_header_t)) {
+		close(fd);
+		throw runtime_error(_path + " is not an index");
+	}
+
+	// Shared when writable, appended points reach the file.
+	void* base = mmap(NULL, status.st_size, PROT_READ | (_writable ? PROT_WRITE : 0),
+			_writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+
+	// The mapping keeps its own reference to the file.
+	close(fd);
+
+	if (base == MAP_FAILED) throw runtime_error("cannot map " + _path);
+
+	_base = (char*)base;
+	_n_bytes = status.st_size;
+
+	const index_header_t& header = _header();
+	string error;
+
+	if (memcmp(header.magic, index_magic, sizeof(header.magic)) != 0)
+		error = _path + " is not an index";
+	else if (header.version != version)
+		error = _path + " is an index of version " + to_string(header.version)
+			+ ", not " + to_string(version);
+	else if (header.n_points > header.capacity || _file_size(header) > _n_bytes)
+		error = _path + " is truncated";
+
+	if (!error.empty()) {
+		_unmap();
+		throw runtime_error(error);
+	}
+}
+
+void index_t::_unmap()
+{
+	if (_base == NULL) return;
+
+	munmap(_base, _n_bytes);
+
+	_base = NULL;
+	_n_bytes = 0;
+}
+
+index_t index_t::create(const string& path, uint32_t n_dims, uint32_t k,
+		uint32_t n_clusters, uint32_t capacity)
+{
+	index_header_t header = _layout(n_dims, k, n_clusters, capacity);
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) throw runtime_error("cannot create " + path);
+
+	// The sections are holes until written, the sizes are zero.
+	bool failed = (ftruncate(fd, _file_size(header)) < 0)
+		|| (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header));
+
+	close(fd);
+
+	if (failed) throw runtime_error("cannot write " + path);
+
+	return index_t(path, true);
+}
+
+uint32_t index_t::n_dims() const
+{
+	return _header().n_dims;
+}
+
+uint32_t index_t::k() const
+{
+	return _header().k;
+}
+
+uint32_t index_t::n_clusters() const
+{
+	return _header().n_clusters;
+}
+
+uint32_t index_t::n_points() const
+{
+	return _header().n_points;
+}
+
+uint32_t index_t::capacity() const
+{
+	return _header().capacity;
+}
+
+void index_t::reserve(uint32_t n_points)
+{
+	if (n_points <= capacity()) return;
+
+	uint32_t n_old = this->n_points();
+	uint32_t n_capacity = max(n_points, 2 * capacity());
+
+	// Written aside, then moved over, the index is never half grown.
+	string grown_path = _path + ".tmp";
+
+	{
+		index_t grown = create(grown_path, n_dims(), k(), n_clusters(), n_capacity);
+
+		memcpy(grown.centroid(0), centroid(0), (size_t)n_clusters() * n_dims() * sizeof(float));
+		memcpy(grown.sizes(), sizes(), (size_t)n_clusters() * sizeof(uint64_t));
+		memcpy(grown.assignments(), assignments(), (size_t)n_old * sizeof(uint32_t));
+		memcpy(grown.row(0), row(0), (size_t)n_old * k() * sizeof(uint32_t));
+		memcpy(grown.distances(0), distances(0), (size_t)n_old * k() * sizeof(float));
+
+		grown.commit(n_old);
+	}
+
+	_unmap();
+
+	if (rename(grown_path.c_str(), _path.c_str()) < 0)
+		throw runtime_error("cannot replace " + _path);
+
+	_map();
+}
+
+void index_t::commit(uint32_t n_points)
+{
+	// The points first, then the header that counts them.
+	msync(_base, _n_bytes, MS_SYNC);
+
+	((index_header_t*)_base)->n_points = n_points;
+
+	msync(_base, page_size, MS_SYNC);
+}
+
+void save_index(const string& path, const dataset_t& dataset, const graph_t& knng,
+		const vector<uint32_t>& assignments, uint32_t n_clusters)
+{
+	uint32_t n_points = knng.n_points();
+	uint32_t n_dims = dataset.n_dims();
+	uint32_t k = knng.k();
+
+	index_t index = index_t::create(path, n_dims, k, n_clusters, n_points);
+
+	// The points of each cluster, by counting sort.
+	vector<size_t> starts(n_clusters + 1, 0);
+	for (uint32_t point_id = 0; point_id < n_points; ++point_id)
+		++starts[assignments[point_id] + 1];
+
+	for (uint32_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster)
+		starts[c_cluster + 1] += starts[c_cluster];
+
+	vector<uint32_t> members(n_points);
+	vector<size_t> next(starts.begin(), starts.end() - 1);
+
+	for (uint32_t point_id = 0; point_id < n_points; ++point_id)
+		members[next[assignments[point_id]]++] = point_id;
+
+	#pragma omp parallel
+	{
+		vector<double> sum(n_dims);
+		vector<pair<float, uint32_t>> neighbors(k);
+
+		#pragma omp for schedule(dynamic) nowait
+		for (uint32_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+			size_t n_members = starts[c_cluster + 1] - starts[c_cluster];
+
+			fill(sum.begin(), sum.end(), 0.0);
+
+			for (size_t c_member = starts[c_cluster]; c_member < starts[c_cluster + 1]; ++c_member) {
+				const float* coords = dataset.row(members[c_member]);
+
+				for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+					sum[c_dim] += coords[c_dim];
+			}
+
+			float* centroid = index.centroid(c_cluster);
+
+			for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+				centroid[c_dim] = n_members > 0 ? sum[c_dim] / n_members : 0.0f;
+
+			index.sizes()[c_cluster] = n_members;
+		}
+
+		// The rows, nearest first by their recomputed distances.
+		#pragma omp for schedule(dynamic, 1024) nowait
+		for (uint32_t point_id = 0; point_id < n_points; ++point_id) {
+			const float* coords = dataset.row(point_id);
+			const uint32_t* row = knng.row(point_id);
+
+			for (uint32_t c_neighbor = 0; c_neighbor < k; ++c_neighbor)
+				neighbors[c_neighbor] = {l2_sqr(coords, dataset.row(row[c_neighbor]), n_dims),
+					row[c_neighbor]};
+
+			sort(neighbors.begin(), neighbors.end());
+
+			for (uint32_t c_neighbor = 0; c_neighbor < k; ++c_neighbor) {
+				index.row(point_id)[c_neighbor] = neighbors[c_neighbor].second;
+				index.distances(point_id)[c_neighbor] = neighbors[c_neighbor].first;
+			}
+
+			index.assignments()[point_id] = assignments[point_id];
+		}
+	}
+
+	index.commit(n_points);
+}
+
+/*
+ * @brief Merge the knn among new points in @nearest_neighbors into a row.
+ *
+ * New points are never in the row already, so unlike the merge of several
+ * partitions there is nothing to deduplicate.
+ *
+ * @param row The neighbors, nearest first, updated in place.
+ * @param row_distances Their distances, updated in place.
+ * @param k The number of neighbors of the row.
+ * @param nearest_neighbors The knn to merge, reset.
+ * @param ids Scratch space, 2k slots.
+ * @param distances Scratch space, 2k slots.
+ *
+ * @return None.
+ */
+static void
+_merge_new(uint32_t* row, float* row_distances, uint32_t k, topk_t& nearest_neighbors,
+		uint32_t* ids, float* distances)
+{
+	uint32_t n_found = nearest_neighbors.write(ids, distances);
+
+	// Most old points have no new point among their k nearest.
+	if (n_found == 0 || distances[0] >= row_distances[k - 1]) return;
+
+	uint32_t* merged = ids + k;
+	float* merged_distances = distances + k;
+	uint32_t c_row = 0, c_found = 0;
+
+	for (uint32_t c_merged = 0; c_merged < k; ++c_merged) {
+		if (c_found < n_found && distances[c_found] < row_distances[c_row]) {
+			merged[c_merged] = ids[c_found];
+			merged_distances[c_merged] = distances[c_found++];
+		} else {
+			merged[c_merged] = row[c_row];
+			merged_distances[c_merged] = row_distances[c_row++];
+		}
+	}
+
+	copy(merged, merged + k, row);
+	copy(merged_distances, merged_distances + k, row_distances);
+}
+
+void append_to_index(index_t& index, const dataset_t& dataset, run_report_t* report)
+{
+	uint32_t n_old = index.n_points();
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_dims = index.n_dims();
+	uint32_t n_clusters = index.n_clusters();
+	uint32_t k = index.k();
+
+	if (dataset.n_dims() != n_dims)
+		throw runtime_error("the dataset has " + to_string(dataset.n_dims())
+				+ " dimensions, the index " + to_string(n_dims));
+
+	if (n_points < n_old)
+		throw runtime_error("the dataset has fewer points than the index");
+
+	if (n_points == n_old) return;
+
+	index.reserve(n_points);
+
+	/*
+	 * Every new point goes to its nearest cluster, then the centroids move
+	 * to the mean of their old and new points.
+	 */
+	profile_phase_t clustering_phase("clustering", report);
+
+	uint32_t* assignments = index.assignments();
+	uint64_t* sizes = index.sizes();
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		#pragma omp for schedule(dynamic, 256) nowait
+		for (uint32_t point_id = n_old; point_id < n_points; ++point_id) {
+			const float* coords = dataset.row(point_id);
+			float nearest = numeric_limits<float>::infinity();
+
+			assignments[point_id] = 0;
+
+			// Empty clusters have no centroid.
+			for (uint32_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+				if (sizes[c_cluster] == 0) continue;
+
+				float distance = l2_sqr(coords, index.centroid(c_cluster), n_dims);
+
+				if (distance < nearest) {
+					nearest = distance;
+					assignments[point_id] = c_cluster;
+				}
+			}
+		}
+	}
+
+	profile_distances((uint64_t)(n_points - n_old) * n_clusters);
+
+	vector<vector<uint32_t>> new_members(n_clusters);
+	for (uint32_t point_id = n_old; point_id < n_points; ++point_id)
+		new_members[assignments[point_id]].push_back(point_id);
+
+	vector<uint32_t> touched;
+	for (uint32_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster)
+		if (!new_members[c_cluster].empty()) touched.push_back(c_cluster);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t c_touched = 0; c_touched < touched.size(); ++c_touched) {
+		uint32_t c_cluster = touched[c_touched];
+		const vector<uint32_t>& members = new_members[c_cluster];
+		float* centroid = index.centroid(c_cluster);
+		double n_total = sizes[c_cluster] + members.size();
+
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+			double sum = (double)centroid[c_dim] * sizes[c_cluster];
+
+			for (uint32_t point_id : members)
+				sum += dataset.row(point_id)[c_dim];
+
+			centroid[c_dim] = sum / n_total;
+		}
+
+		sizes[c_cluster] += members.size();
+	}
+
+	clustering_phase.end();
+
+	/*
+	 * The new points are searched among all the points of their cluster,
+	 * the old points among the new ones only. Clusters without new points
+	 * are left as they are.
+	 */
+	profile_phase_t search_phase("search", report);
+
+	vector<vector<uint32_t>> old_members(n_clusters);
+	for (uint32_t point_id = 0; point_id < n_old; ++point_id)
+		if (!new_members[assignments[point_id]].empty())
+			old_members[assignments[point_id]].push_back(point_id);
+
+	// The largest first, the threads end together.
+	sort(touched.begin(), touched.end(), [&](uint32_t cluster1, uint32_t cluster2) {
+		return old_members[cluster1].size() > old_members[cluster2].size();
+	});
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		vector<topk_t> topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+			topks.emplace_back(k);
+
+		vector<uint32_t> scratch_ids(2 * k);
+		vector<float> scratch_distances(2 * k);
+
+		#pragma omp for schedule(dynamic) nowait
+		for (size_t c_touched = 0; c_touched < touched.size(); ++c_touched) {
+			uint32_t c_cluster = touched[c_touched];
+			const vector<uint32_t>& new_ids = new_members[c_cluster];
+			const vector<uint32_t>& old_ids = old_members[c_cluster];
+
+			vector<uint32_t> all_ids(old_ids);
+			all_ids.insert(all_ids.end(), new_ids.begin(), new_ids.end());
+
+			packed_block_t all_packed(dataset, all_ids.data(), all_ids.size());
+			packed_block_t new_packed(dataset, new_ids.data(), new_ids.size());
+
+			for (size_t tile = 0; tile < new_ids.size(); tile += query_tile) {
+				uint32_t n_queries = min((size_t)query_tile, new_ids.size() - tile);
+
+				knn_search_block(dataset, &new_ids[tile], n_queries, all_packed, topks.data());
+
+				for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+					uint32_t point_id = new_ids[tile + c_query];
+					uint32_t* row = index.row(point_id);
+					float* row_distances = index.distances(point_id);
+
+					uint32_t n_found = topks[c_query].write(row, row_distances);
+
+					// Clusters smaller than k + 1 can't fill the row, like
+					// graph_t::pad_row().
+					for (uint32_t c_slot = n_found; c_slot < k; ++c_slot) {
+						row[c_slot] = n_found > 0 ? row[c_slot % n_found]
+							: (point_id + 1 + c_slot) % n_points;
+						row_distances[c_slot] = numeric_limits<float>::infinity();
+					}
+				}
+			}
+
+			for (size_t tile = 0; tile < old_ids.size(); tile += query_tile) {
+				uint32_t n_queries = min((size_t)query_tile, old_ids.size() - tile);
+
+				knn_search_block(dataset, &old_ids[tile], n_queries, new_packed, topks.data());
+
+				for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+					uint32_t point_id = old_ids[tile + c_query];
+
+					_merge_new(index.row(point_id), index.distances(point_id), k,
+							topks[c_query], scratch_ids.data(), scratch_distances.data());
+				}
+			}
+		}
+	}
+
+	index.commit(n_points);
+}
+
+void export_knng(const index_t& index, const string& path)
+{
+	write_knng(index.row(0), index.n_points(), index.k(), path);
+}
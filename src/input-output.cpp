@@ -2,47 +2,108 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 #include "input-output.hpp"
 #include "helpers.hpp"
 
 using namespace std;
 
-vector<point_t> read_dataset(const string& path, const uint32_t& n_dims)
+// The bytes each thread writes at a time when saving the knng.
+static constexpr size_t write_chunk = 16 * 1024 * 1024;
+
+dataset_t read_dataset(const string& path, const uint32_t& n_dims, bool huge_pages)
 {
+	// Zero-copy, the file's payload is the dataset matrix.
+	try {
+		return dataset_t(path, n_dims);
+	} catch (const runtime_error&) {
+		// Fall back to reading the file.
+	}
+
 	ifstream ifs(path, ios::binary);
 
 	// Read the number of points in the dataset.
-	uint32_t n_points;
+	uint32_t n_points = 0;
 	ifs.read((char*)&n_points, sizeof(uint32_t));
 
-	vector<point_t> points;
-	points.reserve(n_points);
+	dataset_t dataset(n_points, n_dims, huge_pages);
 
-	// A buffer to read each point before writing to @points.
-	vector<float> buffer(n_dims);
-	// The i-th point we are reading from the file.
-	uint32_t c_point = 0;
+	// Read all the points at once, directly into their rows.
+	ifs.read((char*)dataset.data(), (streamsize)n_points * n_dims * sizeof(float));
 
-	// Read the points.
-	while (ifs.read((char*)buffer.data(), 100 * sizeof(float)))
-		points.push_back(point_t(++c_point, buffer));
+	// Keep only the points that were fully read, if the file is short.
+	dataset.truncate(ifs.gcount() / (n_dims * sizeof(float)));
 
 	ifs.close();
 
-	return points;
+	return dataset;
+}
+
+void write_knng(const graph_t& knng, const string& path)
+{
+	write_knng(knng.data(), knng.n_points(), knng.k(), path);
 }
 
-void write_knng(const vector<vector<uint32_t>>& knng, uint32_t k, string path)
+void write_knng(const uint32_t* rows, uint32_t n_points, uint32_t k, const string& path)
 {
-	ofstream ofs(path, ios::out | ios::binary);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) throw runtime_error("cannot create " + path);
+
+	size_t n_bytes = (size_t)n_points * k * sizeof(uint32_t);
+
+	// Size the file once, so the chunks can be written in any order.
+	if (ftruncate(fd, n_bytes) < 0) {
+		close(fd);
+		throw runtime_error("cannot resize " + path);
+	}
+
+	const char* data = (const char*)rows;
+	size_t n_chunks = (n_bytes + write_chunk - 1) / write_chunk;
+	bool failed = false;
+
+	#pragma omp parallel for schedule(dynamic) reduction(||: failed)
+	for (size_t c_chunk = 0; c_chunk < n_chunks; ++c_chunk) {
+		size_t offset = c_chunk * write_chunk;
+		size_t end = min(offset + write_chunk, n_bytes);
 
-	for (size_t c_point = 0; c_point < knng.size(); ++c_point) {
-		// The knn of the current point.
-		auto const &knn = knng[c_point];
+		// pwrite may write less than asked, continue where it stopped.
+		while (offset < end) {
+			ssize_t n_written = pwrite(fd, data + offset, end - offset, offset);
 
-		// Write the knn of the current point.
-		ofs.write(reinterpret_cast<char const *>(&knn[0]), k * sizeof(uint32_t));
+			if (n_written <= 0) {
+				failed = true;
+				break;
+			}
+
+			offset += n_written;
+		}
 	}
 
-	ofs.close();
+	close(fd);
+
+	if (failed) throw runtime_error("cannot write " + path);
+}
+
+graph_t read_knng(const string& path, uint32_t n_points, uint32_t k)
+{
+	ifstream ifs(path, ios::binary | ios::ate);
+	if (!ifs) throw runtime_error("cannot open " + path);
+
+	size_t n_bytes = (size_t)n_points * k * sizeof(uint32_t);
+
+	if ((size_t)ifs.tellg() != n_bytes)
+		throw runtime_error(path + " is not a knng of " + to_string(n_points)
+				+ " points and " + to_string(k) + " neighbors");
+
+	graph_t knng(n_points, k);
+
+	ifs.seekg(0);
+	ifs.read((char*)knng.row(0), n_bytes);
+
+	if ((size_t)ifs.gcount() != n_bytes) throw runtime_error("cannot read " + path);
+
+	return knng;
 }
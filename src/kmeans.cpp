@@ -1,23 +1,147 @@
 #include <cstdint>
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+#include <omp.h>
 #include "kmeans.hpp"
+#include "profile.hpp"
 
 using namespace std;
 
 /*
- * @brief Initialize K-Means algorithm with the number of
- * clusters to create and the number of iterations to perform.
+ * @brief Initialize K-Means algorithm with all its hyperparameters.
  *
- * @param n_clusters The number of clusters to create.
- * @param n_iters The maximum number of iterations to perform.
+ * @param params The number of clusters and iterations, the seeding and the
+ * training mode.
+ * @param dataset The coordinates of @points.
+ * @param points The points to cluster, views into @dataset.
  */
-kmeans_t::kmeans_t(uint32_t n_clusters, uint32_t n_iters, vector<point_t>& points)
-: _n_clusters(n_clusters), _n_iters(n_iters), _points(points)
+kmeans_t::kmeans_t(const kmeans_params_t& params, const dataset_t& dataset,
+		vector<point_t>& points)
+: _params(params), _dataset(dataset), _points(points)
 {
 	// Empty.
 }
 
+/*
+ * @brief Pick @n_samples distinct indexes out of [0, @n_items).
+ *
+ * @param n_items The number of items to pick from.
+ * @param n_samples The number of indexes to pick. At most @n_items.
+ * @param rng The random generator.
+ *
+ * @return The picked indexes, in random order.
+ */
+static vector<uint32_t>
+_sample_indexes(size_t n_items, size_t n_samples, mt19937_64& rng)
+{
+	// Partial Fisher-Yates. Floyd's algorithm if the sample is tiny.
+	if (n_samples * 64 < n_items) {
+		unordered_set<uint32_t> picked;
+		vector<uint32_t> indexes;
+
+		for (size_t c_item = n_items - n_samples; c_item < n_items; ++c_item) {
+			uint32_t index = uniform_int_distribution<size_t>(0, c_item)(rng);
+
+			if (!picked.insert(index).second) index = c_item;
+
+			picked.insert(index);
+			indexes.push_back(index);
+		}
+
+		return indexes;
+	}
+
+	vector<uint32_t> indexes(n_items);
+	iota(indexes.begin(), indexes.end(), 0);
+
+	for (size_t c_sample = 0; c_sample < n_samples; ++c_sample)
+		swap(indexes[c_sample],
+			indexes[uniform_int_distribution<size_t>(c_sample, n_items - 1)(rng)]);
+
+	indexes.resize(n_samples);
+
+	return indexes;
+}
+
+/*
+ * @brief Pick the indexes of the initial centroids with k-means++.
+ *
+ * Each next centroid is a point picked with probability proportional to its
+ * squared distance to the nearest centroid so far. The distances are updated
+ * and summed in parallel, the pick is a search over per-block sums.
+ *
+ * @param points The points to pick from.
+ * @param n_clusters The number of centroids to pick.
+ * @param rng The random generator.
+ *
+ * @return The indexes in @points of the initial centroids.
+ */
+static vector<uint32_t>
+_kmeanspp_indexes(const vector<point_t>& points, uint32_t n_clusters, mt19937_64& rng)
+{
+	// The points of a block, whose distances are summed together.
+	static constexpr size_t block_size = 4096;
+
+	size_t n_points = points.size();
+	size_t n_blocks = (n_points + block_size - 1) / block_size;
+	uint32_t n_dims = points.front().n_dims();
+
+	vector<uint32_t> indexes;
+	indexes.push_back(uniform_int_distribution<size_t>(0, n_points - 1)(rng));
+
+	// The squared distance of each point to its nearest centroid so far.
+	vector<float> distances(n_points, numeric_limits<float>::infinity());
+	vector<double> block_sums(n_blocks);
+
+	while (indexes.size() < n_clusters) {
+		const float* centroid = points[indexes.back()].coords();
+
+		#pragma omp parallel for
+		for (size_t c_block = 0; c_block < n_blocks; ++c_block) {
+			size_t last = min((c_block + 1) * block_size, n_points);
+			double sum = 0.0;
+
+			for (size_t c_point = c_block * block_size; c_point < last; ++c_point) {
+				distances[c_point] = min(distances[c_point], euclidean_distance_aprox(
+						centroid, points[c_point].coords(), n_dims));
+				sum += distances[c_point];
+			}
+
+			block_sums[c_block] = sum;
+		}
+
+		profile_distances(n_points);
+
+		double total = accumulate(block_sums.begin(), block_sums.end(), 0.0);
+
+		// Every point is a centroid already, e.g. all duplicates.
+		if (total <= 0.0) break;
+
+		double target = uniform_real_distribution<double>(0.0, total)(rng);
+
+		size_t c_block = 0;
+		for (; c_block + 1 < n_blocks && target >= block_sums[c_block]; ++c_block)
+			target -= block_sums[c_block];
+
+		size_t c_point = c_block * block_size;
+		size_t last = min((c_block + 1) * block_size, n_points);
+		for (; c_point + 1 < last && target >= distances[c_point]; ++c_point)
+			target -= distances[c_point];
+
+		// Rounding may land on a point with zero weight, i.e. a centroid.
+		while (distances[c_point] == 0.0f && c_point > 0) --c_point;
+
+		indexes.push_back(c_point);
+	}
+
+	return indexes;
+}
+
 /*
  * @brief Find the nearest cluster of @assortee.
  *
@@ -30,32 +154,22 @@ static inline const cluster_t*
 _find_nearest_cluster(const vector<cluster_t>& clusters, const point_t& assortee)
 {
 	// Initialize the best cluster.
-	double best_distance = euclidean_distance_aprox(clusters[0].centroid(), assortee);
+	uint32_t n_dims = assortee.n_dims();
+	float best_distance = euclidean_distance_aprox(clusters[0].centroid(),
+			assortee.coords(), n_dims);
 	const cluster_t* best_cluster = &clusters[0];
 
-	// Iterate over the rest clusters and find the nearest one.
-	#pragma omp parallel
+	// Iterate over the rest clusters and find the nearest one. Callers
+	// run in parallel over the points already, this stays serial.
+	for (size_t c_cluster = 1; c_cluster < clusters.size(); ++c_cluster)
 	{
-		double best_distance_thr = best_distance;
-		const cluster_t* best_cluster_thr = best_cluster;
+		float distance = euclidean_distance_aprox(clusters[c_cluster].centroid(),
+				assortee.coords(), n_dims);
 
-		#pragma omp for nowait
-		for (const cluster_t& cluster : clusters)
+		if (distance < best_distance)
 		{
-			double distance = euclidean_distance_aprox(cluster.centroid(), assortee);
-
-			if (distance < best_distance_thr)
-			{
-				best_distance_thr = distance;
-				best_cluster_thr = &cluster;
-			}
-		}
-
-		#pragma omp critical
-		if (best_distance_thr < best_distance)
-		{
-			best_distance = best_distance_thr;
-			best_cluster = best_cluster_thr;
+			best_distance = distance;
+			best_cluster = &clusters[c_cluster];
 		}
 	}
 
@@ -68,7 +182,9 @@ _find_nearest_cluster(const vector<cluster_t>& clusters, const point_t& assortee
  * The number of iterations to perform and the number of
  * clusters to create has been provided in the constructor.
  *
- * @param points The points to cluster.
+ * If a sample size or a mini-batch size is set, the centroids are trained on
+ * a sample of the points or with mini-batches, and then all the points are
+ * assigned to their nearest centroid once.
  *
  * @return Void. Each point gets assigned to a cluster.
  */
@@ -77,48 +193,49 @@ void kmeans_t::run()
 	// The number of points we need to cluster.
 	size_t n_points = _points.size();
 	// The n-dimensional space the points live.
-	size_t n_dims = _points.front().coords().size();
+	size_t n_dims = _dataset.n_dims();
+
+	// Seeded, so that runs are reproducible.
+	mt19937_64 rng(_params.seed);
+
+	// There can't be more clusters than points.
+	uint32_t n_clusters = min((size_t)_params.n_clusters, n_points);
+
+	// The points the centroids are trained on, all of them by default.
+	vector<point_t> sample;
+	vector<point_t>& training = (_params.sample_size > 0 && _params.sample_size < n_points) ?
+		sample : _points;
+
+	if (&training == &sample) {
+		for (uint32_t index : _sample_indexes(n_points,
+				max(_params.sample_size, n_clusters), rng))
+			sample.push_back(_points[index]);
+	}
 
 	/*
 	 * Initialize clusters.
 	 *
-	 * Each cluster is initialized to a different point.
-	 * Therefore we need to store which points have been used such that
-	 * no two clusters are initialized with the same point. That means
-	 * that they would share the same centroid, and in essense we would
+	 * Each cluster is initialized to a different point, either picked
+	 * uniformly at random or with k-means++. No two clusters share a point,
+	 * otherwise they would share the same centroid, and in essense we would
 	 * have duplicate clusters.
 	 */
 
-	// The IDs of the used points.
-	vector<uint32_t> used_points;
-
-	// Iterate over the cluster IDs and initialize each cluster.
-	for (uint32_t c_cluster = 1; c_cluster <= _n_clusters;) {
-		// Pick a random point to initialize current cluster.
-		uint32_t index = rand() % n_points;
-
-		// Retry if the same point has been used as centroid for another cluster.
-		if (find(used_points.begin(), used_points.end(), index) != used_points.end())
-			continue;
-
-		// Create a cluster with this point as centroid.
-		cluster_t cluster(c_cluster, _points[index]);
-		// Store the cluster in the vector with the other clusters.
-		_clusters.push_back(cluster);
-
-		// Add point to cluster.
-		cluster.add_point(_points[index]);
-		// Assign cluster to point. The point now belongs to a cluster.
-		_points[index].cluster(&_clusters[c_cluster - 1]);
+	vector<uint32_t> used_points = (_params.init == kmeans_init_t::plusplus) ?
+		_kmeanspp_indexes(training, n_clusters, rng) :
+		_sample_indexes(training.size(), n_clusters, rng);
 
-		// Mark the used point's ID.
-		used_points.push_back(index + 1);
+	_iterations = 0;
+	_moved.clear();
 
-		//cout << "Printing the cluster initializer point:" << endl;
-		//_points[index].print(cerr);
+	// Points keep pointers into @_clusters, it must never reallocate.
+	_clusters.clear();
+	_clusters.reserve(used_points.size());
 
-		++c_cluster;
-	}
+	// Create a cluster with each point as centroid. The first iteration
+	// assigns every point, including these ones, to its cluster.
+	for (uint32_t index : used_points)
+		_clusters.push_back(cluster_t(_clusters.size() + 1, training[index].coords(), n_dims));
 
 	//cout << "Initialized clusters with these point IDs:" << endl;
 	//for (uint32_t id : used_points)
@@ -130,70 +247,433 @@ void kmeans_t::run()
 	 * Start improving the clusters and update each point's cluster.
 	 *
 	 * We either stop if we can no longer improve the clusters,
-	 * or if maximum iterations @_n_iters have been performed.
+	 * or if maximum iterations have been performed.
 	 */
 
-	for (uint32_t c_iter = 0; c_iter < _n_iters; ++c_iter)
+	if (_params.batch_size > 0)
+		_run_minibatch(training, rng);
+	else if (_params.accelerated)
+		_run_hamerly(training);
+	else
+		_run_lloyd(training);
+
+	// Trained on a subset or on batches, do one full assignment.
+	if (&training == &_points && _params.batch_size == 0) return;
+
+	#pragma omp parallel
 	{
+		busy_timer_t busy;
+
+		#pragma omp for schedule(dynamic, 1024) nowait
+		for (point_t& point : _points)
+			point.cluster(_find_nearest_cluster(_clusters, point));
+	}
+
+	profile_distances(_points.size() * _clusters.size());
+
+	_update(_points);
+}
+
+bool kmeans_t::_out_of_time(uint32_t c_iter) const
+{
+	return c_iter > 0 && _params.deadline > 0.0 && omp_get_wtime() >= _params.deadline;
+}
+
+/*
+ * @brief Plain Lloyd's iterations over @points.
+ *
+ * @return None.
+ */
+void kmeans_t::_run_lloyd(vector<point_t>& points)
+{
+	for (uint32_t c_iter = 0; c_iter < _params.n_iters; ++c_iter)
+	{
+		if (_out_of_time(c_iter)) break;
+
 		//cout << "K-Means iteration = " << c_iter << endl;
 
-		// We stop when we can no longer improve any cluster.
-		bool done = true;
+		// The points that changed cluster.
+		uint64_t n_moved = 0;
 
 		// Add all points to their nearest cluster.
-		#pragma omp parallel for reduction(&&: done)
-		for (point_t& point : _points)
+		#pragma omp parallel reduction(+: n_moved)
 		{
-			uint32_t curr_cluster_id = (point.cluster()) ? point.cluster()->id() : 0;
-			const cluster_t* best_cluster = _find_nearest_cluster(_clusters, point);
+			busy_timer_t busy;
 
-			//printf("Best cluster ID = %d\n", best_cluster->id());
+			#pragma omp for nowait
+			for (point_t& point : points)
+			{
+				uint32_t curr_cluster_id = (point.cluster()) ? point.cluster()->id() : 0;
+				const cluster_t* best_cluster = _find_nearest_cluster(_clusters, point);
 
-			// Update the point's cluster if the current one isn't the best.
-			if (curr_cluster_id == best_cluster->id())
-				continue;
+				//printf("Best cluster ID = %d\n", best_cluster->id());
 
-			//cout << "here" << endl;
-			point.cluster(best_cluster);
+				// Update the point's cluster if the current one isn't the best.
+				if (curr_cluster_id == best_cluster->id())
+					continue;
 
-			// TODO: Remove point from @curr_cluster_id and add it
-			// to @best_cluster_id. A race could occur where two
-			// points need to be removed from the same cluster or
-			// added to the same cluster.
+				point.cluster(best_cluster);
 
-			// At least one cluster has been improved.
-			done = false;
+				// At least one cluster has been improved.
+				++n_moved;
+			}
 		}
 
+		profile_distances(points.size() * _clusters.size());
+
+		++_iterations;
+		_moved.push_back(n_moved);
+
 		// If no cluster was improved then we are done.
-		if (done) return;
+		if (n_moved == 0) return;
+
+		_update(points);
+	}
+}
+
+/*
+ * @brief Mini-batch K-Means iterations over @points.
+ *
+ * Each iteration assigns a random batch of points to their nearest centroid
+ * and moves each centroid towards the mean of its batch points, by the share
+ * of all the points it got so far that came in this batch. The sums are
+ * accumulated per thread and merged once per batch.
+ *
+ * @return None.
+ */
+void kmeans_t::_run_minibatch(vector<point_t>& points, mt19937_64& rng)
+{
+	size_t n_clusters = _clusters.size();
+	uint32_t n_dims = _dataset.n_dims();
+	size_t batch_size = min((size_t)_params.batch_size, points.size());
+
+	// How many points each centroid got over all batches so far.
+	vector<uint64_t> counts(n_clusters, 0);
+
+	for (uint32_t c_iter = 0; c_iter < _params.n_iters; ++c_iter)
+	{
+		if (_out_of_time(c_iter)) break;
 
-		/*
-		 * Readd all the points to their clusters
-		 * and recalculate each cluster's centroid.
-		 */
+		vector<uint32_t> batch = _sample_indexes(points.size(), batch_size, rng);
+
+		vector<double> sums(n_clusters * n_dims, 0.0);
+		vector<uint64_t> batch_counts(n_clusters, 0);
 
 		#pragma omp parallel
 		{
-			// Clear all existing clusters.
-			#pragma omp for
-			for (auto& cluster : _clusters)
-				cluster.clear();
-
-			// Add each point to the cluster it belongs.
-			#pragma omp for
-			for (const auto& point : _points)
+			vector<double> sums_thr(n_clusters * n_dims, 0.0);
+			vector<uint64_t> counts_thr(n_clusters, 0);
+
+			{
+				busy_timer_t busy;
+
+				#pragma omp for nowait
+				for (size_t c_batch = 0; c_batch < batch.size(); ++c_batch) {
+					const point_t& point = points[batch[c_batch]];
+					size_t nearest = _find_nearest_cluster(_clusters, point)->id() - 1;
+					const float* coords = point.coords();
+
+					for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+						sums_thr[nearest * n_dims + c_dim] += coords[c_dim];
+					++counts_thr[nearest];
+				}
+			}
+
+			#pragma omp critical
+			{
+				for (size_t c_sum = 0; c_sum < sums.size(); ++c_sum)
+					sums[c_sum] += sums_thr[c_sum];
+				for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster)
+					batch_counts[c_cluster] += counts_thr[c_cluster];
+			}
+		}
+
+		profile_distances(batch.size() * n_clusters);
+		++_iterations;
+
+		vector<float> centroid(n_dims);
+
+		for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+			if (batch_counts[c_cluster] == 0) continue;
+
+			counts[c_cluster] += batch_counts[c_cluster];
+
+			// The per-center learning rate of mini-batch K-Means.
+			double rate = (double)batch_counts[c_cluster] / counts[c_cluster];
+			const float* current = _clusters[c_cluster].centroid();
+
+			for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+				double mean = sums[c_cluster * n_dims + c_dim] / batch_counts[c_cluster];
+				centroid[c_dim] = current[c_dim] + rate * (mean - current[c_dim]);
+			}
+
+			_clusters[c_cluster].centroid(centroid.data());
+		}
+	}
+}
+
+/*
+ * @brief Readd all the @points to their clusters and recalculate each
+ * cluster's centroid.
+ *
+ * Each thread takes a contiguous range of @points, counts and sums the
+ * coordinates of its points per cluster. The counts give every thread its
+ * offsets in each cluster's members (a counting sort over the cluster ids),
+ * so the threads scatter the ids without locks, in the order of @points. The
+ * sums of the threads are then merged per cluster into the new centroids.
+ *
+ * @return None.
+ */
+void kmeans_t::_update(const vector<point_t>& points)
+{
+	size_t n_points = points.size();
+	size_t n_clusters = _clusters.size();
+	uint32_t n_dims = _dataset.n_dims();
+	size_t n_threads = omp_get_max_threads();
+
+	// The points and coordinate sums of each thread per cluster.
+	vector<vector<uint32_t>> counts(n_threads);
+	vector<vector<double>> sums(n_threads);
+
+	// The ids of the members of each cluster, clusters one after another.
+	vector<uint32_t> members(n_points);
+	vector<size_t> starts(n_clusters + 1, 0);
+
+	#pragma omp parallel num_threads(n_threads)
+	{
+		size_t thread = omp_get_thread_num();
+		size_t n_team = omp_get_num_threads();
+		size_t first = n_points * thread / n_team;
+		size_t last = n_points * (thread + 1) / n_team;
+
+		vector<uint32_t>& counts_thr = counts[thread];
+		vector<double>& sums_thr = sums[thread];
+
+		counts_thr.assign(n_clusters, 0);
+		sums_thr.assign(n_clusters * n_dims, 0.0);
+
+		{
+			busy_timer_t busy;
+
+			for (size_t c_point = first; c_point < last; ++c_point) {
 				// Cluster's index is its id - 1.
-				_clusters[point.cluster()->id() - 1].add_point(point);
+				size_t cluster = points[c_point].cluster()->id() - 1;
+				const float* coords = points[c_point].coords();
+				double* sum = &sums_thr[cluster * n_dims];
+
+				for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+					sum[c_dim] += coords[c_dim];
+
+				++counts_thr[cluster];
+			}
+		}
+
+		#pragma omp barrier
+
+		// Turn the counts into the offset of each thread in each cluster.
+		#pragma omp single
+		{
+			size_t offset = 0;
+
+			for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+				starts[c_cluster] = offset;
+
+				for (size_t c_thread = 0; c_thread < n_team; ++c_thread) {
+					uint32_t count = counts[c_thread][c_cluster];
+					counts[c_thread][c_cluster] = offset;
+					offset += count;
+				}
+			}
+
+			starts[n_clusters] = offset;
+		}
+
+		for (size_t c_point = first; c_point < last; ++c_point)
+			members[counts_thr[points[c_point].cluster()->id() - 1]++] = points[c_point].id();
+
+		#pragma omp barrier
+
+		// Merge the sums of the threads into the centroids.
+		vector<float> centroid(n_dims);
+
+		#pragma omp for schedule(dynamic, 16)
+		for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+			size_t n_members = starts[c_cluster + 1] - starts[c_cluster];
+
+			_clusters[c_cluster].points(&members[starts[c_cluster]], n_members);
+
+			// No points, the centroid stays where it is.
+			if (n_members == 0) continue;
+
+			for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+				double sum = 0.0;
+
+				for (size_t c_thread = 0; c_thread < n_team; ++c_thread)
+					sum += sums[c_thread][c_cluster * n_dims + c_dim];
+
+				centroid[c_dim] = sum / n_members;
+			}
+
+			_clusters[c_cluster].centroid(centroid.data());
+		}
+	}
+}
+
+/*
+ * @brief Lloyd's iterations, accelerated with Hamerly's bounds.
+ *
+ * Each point keeps an upper bound of the distance to its cluster's centroid
+ * and a lower bound of the distance to any other centroid. If the upper bound
+ * is below both the lower bound and half the distance of its centroid to the
+ * nearest other centroid, the triangle inequality guarantees the point keeps
+ * its cluster and no distance is computed. Bounds loosen by how much the
+ * centroids move. The assignments match those of the plain iterations, up to
+ * ties between equally distant centroids.
+ *
+ * Bounds hold true (not squared) euclidean distances.
+ *
+ * @return None.
+ */
+void kmeans_t::_run_hamerly(vector<point_t>& points)
+{
+	size_t n_points = points.size();
+	size_t n_clusters = _clusters.size();
+	uint32_t n_dims = _dataset.n_dims();
+
+	// The bounds of each point.
+	vector<float> upper(n_points), lower(n_points);
+
+	// Half the distance of each centroid to its nearest other centroid.
+	vector<float> half_gap(n_clusters);
+
+	// How much each centroid moved in the last update.
+	vector<float> drift(n_clusters);
+	vector<float> old_centroids(n_clusters * n_dims);
+
+	for (uint32_t c_iter = 0; c_iter < _params.n_iters; ++c_iter)
+	{
+		if (_out_of_time(c_iter)) break;
+
+		#pragma omp parallel for
+		for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+			float gap = numeric_limits<float>::infinity();
+
+			for (size_t c_other = 0; c_other < n_clusters; ++c_other) {
+				if (c_other == c_cluster) continue;
+
+				gap = min(gap, euclidean_distance_aprox(_clusters[c_cluster].centroid(),
+						_clusters[c_other].centroid(), n_dims));
+			}
 
-			// Recenter clusters because they contain new points.
-			#pragma omp for
-			for (auto& cluster : _clusters)
-				cluster.recenter();
+			half_gap[c_cluster] = sqrt(gap) / 2;
+		}
+
+		// The points that changed cluster, and the distances evaluated.
+		uint64_t n_moved = 0, n_distances = 0;
+
+		#pragma omp parallel reduction(+: n_moved, n_distances)
+		{
+			busy_timer_t busy;
+
+			#pragma omp for schedule(dynamic, 1024) nowait
+			for (size_t c_point = 0; c_point < n_points; ++c_point)
+			{
+				point_t& point = points[c_point];
+				const float* coords = point.coords();
+
+				// Points without a cluster yet, i.e. the first iteration, scan.
+				if (point.cluster()) {
+					size_t current = point.cluster()->id() - 1;
+					float bound = max(half_gap[current], lower[c_point]);
+
+					if (upper[c_point] <= bound) continue;
+
+					// Tighten the upper bound and try again.
+					upper[c_point] = sqrt(euclidean_distance_aprox(
+							_clusters[current].centroid(), coords, n_dims));
+					++n_distances;
+
+					if (upper[c_point] <= bound) continue;
+				}
+
+				// The nearest and second nearest centroids.
+				float best = numeric_limits<float>::infinity();
+				float second = numeric_limits<float>::infinity();
+				size_t best_cluster = 0;
+
+				for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+					float distance = euclidean_distance_aprox(
+							_clusters[c_cluster].centroid(), coords, n_dims);
+
+					if (distance < best) {
+						second = best;
+						best = distance;
+						best_cluster = c_cluster;
+					} else if (distance < second) {
+						second = distance;
+					}
+				}
+
+				n_distances += n_clusters;
+
+				upper[c_point] = sqrt(best);
+				lower[c_point] = sqrt(second);
+
+				if (point.cluster() == &_clusters[best_cluster]) continue;
+
+				point.cluster(&_clusters[best_cluster]);
+
+				// At least one cluster has been improved.
+				++n_moved;
+			}
+		}
+
+		profile_distances(n_distances + n_clusters * n_clusters);
+
+		++_iterations;
+		_moved.push_back(n_moved);
+
+		// If no cluster was improved then we are done.
+		if (n_moved == 0) return;
+
+		for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster)
+			copy(_clusters[c_cluster].centroid(), _clusters[c_cluster].centroid() + n_dims,
+					old_centroids.begin() + c_cluster * n_dims);
+
+		_update(points);
+
+		float max_drift = 0.0f;
+
+		for (size_t c_cluster = 0; c_cluster < n_clusters; ++c_cluster) {
+			drift[c_cluster] = sqrt(euclidean_distance_aprox(_clusters[c_cluster].centroid(),
+					&old_centroids[c_cluster * n_dims], n_dims));
+			max_drift = max(max_drift, drift[c_cluster]);
+		}
+
+		// The centroids moved, loosen the bounds by as much.
+		#pragma omp parallel for
+		for (size_t c_point = 0; c_point < n_points; ++c_point) {
+			upper[c_point] += drift[points[c_point].cluster()->id() - 1];
+			lower[c_point] -= max_drift;
 		}
 	}
 }
 
+const vector<cluster_t>& kmeans_t::clusters() const
+{
+	return _clusters;
+}
+
+uint32_t kmeans_t::iterations() const
+{
+	return _iterations;
+}
+
+const vector<uint64_t>& kmeans_t::moved() const
+{
+	return _moved;
+}
+
 void kmeans_t::print_clusters(ostream& outstream, string indent) const
 {
 	for (const cluster_t& cluster : _clusters)
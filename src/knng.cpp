@@ -1,100 +1,961 @@
 #include <iostream>
 #include <algorithm>
-#include <queue>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <random>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
+#include <omp.h>
 
 #include "knng.hpp"
 #include "point.hpp"
 #include "cluster.hpp"
 #include "helpers.hpp"
 #include "kmeans.hpp"
+#include "hkmeans.hpp"
+#include "generator.hpp"
+#include "rpforest.hpp"
+#include "batch-distance.hpp"
+#include "distance.hpp"
+#include "quantization.hpp"
+#include "pq.hpp"
+#include "pca.hpp"
+#include "topk.hpp"
+#include "nndescent.hpp"
+#include "profile.hpp"
+#include "scheduler.hpp"
+#include "checkpoint.hpp"
 
 using namespace std;
 
+// Queries per task of the intra-cluster search.
+static constexpr uint32_t query_tile = 64;
+
+// Points per tile of the symmetric search. A multiple of @batch_cols.
+static constexpr uint32_t symmetric_tile = 64;
+
+// On a time budget, the least points of a window of the first, quick search.
+// Windows have at least k + 1 points, enough to fill the rows.
+static constexpr uint32_t fill_window = 64;
+
+// On a time budget, the share of it K-Means may use.
+static constexpr double clustering_share = 0.25;
+
+// On a time budget, a conservative rate of writing the knng, bytes per
+// second. The construction stops early enough to write it at this rate.
+static constexpr double write_rate = 250e6;
+
+/*
+ * @brief Write the knn in @nearest_neighbors to the row of @point_id.
+ *
+ * @return None. @nearest_neighbors is reset.
+ */
+static inline void
+_write_row(graph_t& knng, uint32_t point_id, topk_t& nearest_neighbors)
+{
+	float* distances = knng.has_distances() ? knng.distances(point_id) : NULL;
+	uint32_t n_found = nearest_neighbors.write(knng.row(point_id), distances);
+
+	// Clusters smaller than k + 1 can't fill the row.
+	if (n_found < knng.k()) knng.pad_row(point_id, n_found);
+}
+
 /*
- * @brief Find the k nearest neighbors of the @point from the cluster it belongs.
+ * @brief Merge the knn in @nearest_neighbors into the row of @point_id.
+ *
+ * The row must have its distances, sorted. The k nearest of both are kept,
+ * a neighbor in both only once.
  *
- * @param point The point to find its k nearest neighbors.
- * @param k How many nearest neighbors to find.
+ * @param knng The knng whose row to update, in place.
+ * @param point_id The point whose row to update.
+ * @param nearest_neighbors The knn to merge, reset.
+ * @param ids Scratch space, reused across calls.
+ * @param distances Scratch space, reused across calls.
  *
- * @return Vector with k points, which are the knn of @point in its cluster.
+ * @return None.
  */
-static inline vector<uint32_t>
-knn_of_point(const point_t& point, uint32_t k)
+static inline void
+_merge_row(graph_t& knng, uint32_t point_id, topk_t& nearest_neighbors,
+		vector<uint32_t>& ids, vector<float>& distances)
 {
-	// Max heap. This way we know which is the furthest point from @id.
-	priority_queue<pair<double, uint32_t>> nearest_neighbors;
+	uint32_t k = knng.k();
 
-	/*
-	 * Initialize the @nearest_neighbors of @point by adding a
-	 * point from its cluster, but be careful, ignore itself.
-	 */
+	// The knn to merge, then the merged row.
+	ids.resize(2 * k);
+	distances.resize(2 * k);
 
-	// The @point's cluster.
-	//if (point.cluster() == NULL) {
-	//	cout << "fatal internal: found a point with null cluster." << endl;
-	//	point.print(cout, "");
+	uint32_t n_found = nearest_neighbors.write(ids.data(), distances.data());
+	uint32_t* merged = ids.data() + k;
+	float* merged_distances = distances.data() + k;
 
-	//	exit(1);
-	//}
+	const uint32_t* row = knng.row(point_id);
+	const float* row_distances = knng.distances(point_id);
+
+	uint32_t c_row = 0, c_found = 0, n_merged = 0;
+
+	while (n_merged < k && (c_row < k || c_found < n_found)) {
+		bool from_row = (c_found == n_found)
+			|| (c_row < k && row_distances[c_row] <= distances[c_found]);
+
+		uint32_t id = from_row ? row[c_row] : ids[c_found];
+		float distance = from_row ? row_distances[c_row++] : distances[c_found++];
+
+		// A neighbor found twice may not have the same distance both times,
+		// e.g. re-ranked exactly in one search and not in the other, so it is
+		// looked up by id. Rows are short, the scan is cheap.
+		if (find(merged, merged + n_merged, id) != merged + n_merged) continue;
+
+		merged[n_merged] = id;
+		merged_distances[n_merged++] = distance;
+	}
+
+	copy(merged, merged + n_merged, knng.row(point_id));
+	copy(merged_distances, merged_distances + n_merged, knng.distances(point_id));
+
+	// Padding repeats neighbors, those repeated again are dropped.
+	if (n_merged < k) knng.pad_row(point_id, n_merged);
+}
+
+/*
+ * @brief Order @ids by the first coordinate of their points.
+ *
+ * With leading dimensions, a tile of queries then starts with the candidates
+ * nearest to it, see knn_search_block().
+ *
+ * @return None.
+ */
+static void
+_sort_by_first_coord(const dataset_t& dataset, vector<uint32_t>& ids)
+{
+	sort(ids.begin(), ids.end(), [&](uint32_t point1, uint32_t point2) {
+		return dataset.row(point1)[0] < dataset.row(point2)[0];
+	});
+}
+
+/*
+ * @brief Find the k nearest neighbors of every point of @queries from the
+ * points of @candidates, using the blocked distance engine.
+ *
+ * The candidates are packed once. Tiles of @query_tile queries are then
+ * searched in parallel against them. Each thread reuses its own knn.
+ *
+ * @param dataset The coordinates of the points.
+ * @param queries The points to find their knn. Usually a cluster.
+ * @param candidates The points to search. The cluster, with or without guests.
+ * @param n_leading The leading dimensions to abandon candidates on, 0 for
+ * none. See packed_block_t.
+ * @param knng Where to write the knn of each point of @queries, in place.
+ * @param deadline Tiles that would start after this time are skipped, their
+ * rows are left as they are.
+ *
+ * @return None.
+ */
+static void
+knn_of_cluster(const dataset_t& dataset, const vector<uint32_t>& queries,
+		const vector<uint32_t>& candidates, uint32_t n_leading, graph_t& knng,
+		double deadline)
+{
+	uint32_t k = knng.k();
+
+	if (queries.empty()) return;
+
+	vector<uint32_t> sorted_queries, sorted_candidates;
+
+	if (n_leading > 0) {
+		sorted_queries = queries;
+		sorted_candidates = candidates;
+		_sort_by_first_coord(dataset, sorted_queries);
+		_sort_by_first_coord(dataset, sorted_candidates);
+	}
 
-	const vector<point_t>& candidates = point.cluster()->points();
+	const vector<uint32_t>& tile_queries = (n_leading > 0) ? sorted_queries : queries;
+	const vector<uint32_t>& tile_candidates = (n_leading > 0) ? sorted_candidates : candidates;
 
-	size_t c_cand = 0;
+	packed_block_t packed(dataset, tile_candidates.data(), tile_candidates.size(), n_leading);
 
-	for (; c_cand < candidates.size(); ++c_cand) {
-		// Skip itself. A point isn't a neighbor of itself.
-		if (candidates[c_cand].id() == point.id())
-			continue;
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
 
-		const point_t& candidate = candidates[c_cand];
-		double distance = euclidean_distance_aprox(point, candidate);
+		vector<topk_t> topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+			topks.emplace_back(k);
 
-		if (nearest_neighbors.size() < k)
-			nearest_neighbors.push({distance, candidate.id() - 1});
-		else if (nearest_neighbors.top().first > distance) {
-			nearest_neighbors.pop();
-			nearest_neighbors.push({distance, candidate.id() - 1});
+		#pragma omp for schedule(dynamic) nowait
+		for (size_t tile = 0; tile < queries.size(); tile += query_tile) {
+			if (omp_get_wtime() >= deadline) continue;
+
+			uint32_t n_queries = min((size_t)query_tile, queries.size() - tile);
+
+			knn_search_block(dataset, &tile_queries[tile], n_queries, packed, topks.data());
+
+			for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+				_write_row(knng, tile_queries[tile + c_query], topks[c_query]);
 		}
 	}
+}
 
-	//if (nearest_neighbors.size() < 100) {
-	//	cerr << "fatal internal: point without 100 nn." << endl;
-	//	exit(1);
-	//}
+/*
+ * The points of a cluster, sorted as needed, and their packed coordinates.
+ * Shared by the tasks searching its tiles, freed with the last one.
+ */
+struct packed_cluster_t {
+	// The cluster, its index in the partition.
+	uint32_t c_cluster;
+
+	// The points, in the order of @packed.
+	vector<uint32_t> members;
+
+	// The coordinates of @members, packed.
+	packed_block_t packed;
 
-	// Write the nns of the current point @id.
-	vector<uint32_t> knn;
-	knn.reserve(k);
+	// The tiles not searched yet, the last one checkpoints the cluster.
+	mutable atomic<size_t> n_left;
 
-	while (!nearest_neighbors.empty()) {
-		knn.push_back(nearest_neighbors.top().second);
-		nearest_neighbors.pop();
+	packed_cluster_t(const dataset_t& dataset, uint32_t c_cluster, vector<uint32_t> ids,
+			uint32_t n_leading)
+	: c_cluster(c_cluster), members(move(ids)),
+	  packed(dataset, members.data(), members.size(), n_leading), n_left(0)
+	{
+		/* Empty. */
 	}
+};
 
-	/*
-	 * @nearest_neighbors is max heap. The @knn contains the nearest
-	 * neighbors from within the cluster but in reverse order i.e. the first
-	 * neighbor is the furstest one from the k neighbors. We could reverse
-	 * @knn but it's not mandatory because recall is the the true number of
-	 * nearest neighbors in @knn despite their order.
-	 */
+/*
+ * A task of _search_partition(): pack a cluster, or search a tile of its
+ * points against all of them.
+ */
+struct search_task_t {
+	// The cluster to pack, if @block is null.
+	uint32_t c_cluster = 0;
+
+	// The packed cluster of the tile.
+	shared_ptr<const packed_cluster_t> block;
+
+	// The tile, as positions in the members of @block.
+	size_t first_query = 0;
+	uint32_t n_queries = 0;
+};
+
+/*
+ * @brief Find the k nearest neighbors of every point of each cluster of
+ * @clusters among the points of its cluster.
+ *
+ * The search cost of a cluster is quadratic in its size, and sizes can vary
+ * a hundredfold, so the clusters are dealt to the threads by that cost: in
+ * the order of @order, each one to the thread with the least cost so far. A
+ * thread packs a cluster, then searches it whole if it's cheap, or queues
+ * its tiles of queries at the front of its deque otherwise. Threads that run
+ * out of work steal clusters and tiles from the others, see steal_queues_t,
+ * so none idles while a large cluster is being searched.
+ *
+ * @param dataset The coordinates of the points.
+ * @param clusters The clusters, e.g. a partition of a candidate generator.
+ * @param order The indexes of the clusters to search. Largest first balances
+ * the threads best.
+ * @param n_leading The leading dimensions to abandon candidates on, 0 for
+ * none. See packed_block_t.
+ * @param merge Merge the knn into the rows instead of overwriting them, see
+ * _merge_row().
+ * @param knng Where to write the knn of each point, in place.
+ * @param deadline Clusters and tiles that would start after this time are
+ * skipped, their rows are left as they are.
+ * @param checkpoint If not NULL, clusters it has done are skipped, and every
+ * cluster searched is saved in it.
+ * @param c_partition The index of @clusters in the candidate generator.
+ *
+ * @return None.
+ */
+static void
+_search_partition(const dataset_t& dataset, const vector<cluster_t>& clusters,
+		const vector<uint32_t>& order, uint32_t n_leading, bool merge, graph_t& knng,
+		double deadline, checkpoint_t* checkpoint = NULL, uint32_t c_partition = 0)
+{
+	uint32_t k = knng.k();
+	uint32_t n_threads = omp_get_max_threads();
+
+	auto cost = [&](size_t n_points) { return (double)n_points * n_points; };
+
+	// Clusters costing more than a fraction of a thread's share are split
+	// into tiles, the others are searched by a single thread.
+	double total_cost = 0.0;
+	for (uint32_t c_cluster : order)
+		total_cost += cost(clusters[c_cluster].points().size());
+
+	double grain = total_cost / (8.0 * n_threads);
+
+	steal_queues_t<search_task_t> queues(n_threads);
+	vector<double> loads(n_threads, 0.0);
+
+	for (uint32_t c_cluster : order) {
+		size_t n_members = clusters[c_cluster].points().size();
+
+		if (n_members == 0) continue;
+		if (checkpoint != NULL && checkpoint->done(c_partition, c_cluster)) continue;
+
+		uint32_t c_thread = min_element(loads.begin(), loads.end()) - loads.begin();
+		loads[c_thread] += cost(n_members);
+
+		search_task_t task;
+		task.c_cluster = c_cluster;
+		queues.push_back(c_thread, task);
+	}
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+		uint32_t c_thread = omp_get_thread_num();
+
+		vector<topk_t> topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+			topks.emplace_back(k);
+
+		vector<uint32_t> scratch_ids;
+		vector<float> scratch_distances;
+
+		auto search_tile = [&](const packed_cluster_t& block, size_t first_query,
+				uint32_t n_queries) {
+			const uint32_t* queries = &block.members[first_query];
+
+			knn_search_block(dataset, queries, n_queries, block.packed, topks.data());
+
+			for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+				if (merge)
+					_merge_row(knng, queries[c_query], topks[c_query], scratch_ids,
+							scratch_distances);
+				else
+					_write_row(knng, queries[c_query], topks[c_query]);
+			}
+		};
+
+		queues.work(c_thread, [&](const search_task_t& task) {
+			if (omp_get_wtime() >= deadline) return;
+
+			if (task.block) {
+				search_tile(*task.block, task.first_query, task.n_queries);
+
+				if (checkpoint != NULL && --task.block->n_left == 0)
+					checkpoint->cluster_done(c_partition, task.block->c_cluster,
+							task.block->members, knng);
+
+				return;
+			}
+
+			vector<uint32_t> members = clusters[task.c_cluster].points();
+
+			if (n_leading > 0) _sort_by_first_coord(dataset, members);
+
+			auto block = make_shared<const packed_cluster_t>(dataset, task.c_cluster,
+					move(members), n_leading);
+			size_t n_members = block->members.size();
+
+			if (cost(n_members) <= grain || n_members <= query_tile) {
+				for (size_t tile = 0; tile < n_members; tile += query_tile)
+					search_tile(*block, tile, min((size_t)query_tile, n_members - tile));
+
+				if (checkpoint != NULL)
+					checkpoint->cluster_done(c_partition, task.c_cluster, block->members, knng);
+
+				return;
+			}
+
+			// The last tile first, the thread then runs them in order.
+			size_t last_tile = (n_members - 1) / query_tile * query_tile;
+			block->n_left = last_tile / query_tile + 1;
+
+			for (size_t tile = last_tile + query_tile; tile > 0; tile -= query_tile) {
+				search_task_t tile_task;
+				tile_task.block = block;
+				tile_task.first_query = tile - query_tile;
+				tile_task.n_queries = min((size_t)query_tile, n_members - tile_task.first_query);
+				queues.push_front(c_thread, tile_task);
+			}
+		});
+	}
+}
+
+/*
+ * @brief Like knn_of_cluster(), scanning the codes of the candidates instead
+ * of their coordinates.
+ *
+ * The codes are encoded once, before the search, so the scan never reads the
+ * candidates' floats. It keeps the @rerank * k nearest candidates of each
+ * query by their approximate distances. Only those are re-ranked with their
+ * rows in @dataset, and the k nearest are written, with exact distances.
+ *
+ * @param dataset The coordinates of the points.
+ * @param quantizer How the candidates were encoded.
+ * @param rerank How many times k candidates to re-rank per query.
+ * @param queries The points to find their knn. Usually a cluster.
+ * @param packed The codes of the points to search. The cluster, with or
+ * without guests.
+ * @param knng Where to write the knn of each point of @queries, in place.
+ * @param deadline Tiles that would start after this time are skipped, their
+ * rows are left as they are.
+ *
+ * @return None.
+ */
+static void
+knn_of_cluster_quantized(const dataset_t& dataset, const quantizer_t& quantizer,
+		uint32_t rerank, const vector<uint32_t>& queries,
+		const quantized_block_t& packed, graph_t& knng, double deadline)
+{
+	uint32_t k = knng.k();
+	uint32_t n_dims = dataset.n_dims();
+	uint32_t n_kept = max(rerank, 1u) * k;
+
+	if (queries.empty()) return;
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		vector<topk_t> topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+			topks.emplace_back(n_kept);
+
+		// The ids of the candidates kept for a query, and their exact knn.
+		vector<uint32_t> kept(n_kept);
+		topk_t exact(k);
+
+		#pragma omp for schedule(dynamic) nowait
+		for (size_t tile = 0; tile < queries.size(); tile += query_tile) {
+			if (omp_get_wtime() >= deadline) continue;
+
+			uint32_t n_queries = min((size_t)query_tile, queries.size() - tile);
+
+			knn_search_quantized(dataset, quantizer, &queries[tile], n_queries, packed,
+					topks.data());
+
+			uint64_t n_reranked = 0;
+
+			for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+				uint32_t query_id = queries[tile + c_query];
+				const float* coords = dataset.row(query_id);
+				uint32_t n_found = topks[c_query].write(kept.data(), NULL);
+
+				for (uint32_t c_kept = 0; c_kept < n_found; ++c_kept)
+					exact.push(l2_sqr(coords, dataset.row(kept[c_kept]), n_dims), kept[c_kept]);
+
+				n_reranked += n_found;
+
+				_write_row(knng, query_id, exact);
+			}
+
+			profile_distances(n_reranked);
+		}
+	}
+}
+
+/*
+ * @brief Find the k nearest neighbors of every point of @cluster, filtering
+ * the candidates with product quantization.
+ *
+ * Each point scans the codes of its @n_probes nearest clusters, or of its
+ * own cluster if @probes is empty. It keeps the @rerank * k nearest codes,
+ * re-ranks them with their float coordinates and writes the k nearest.
+ *
+ * @param dataset The coordinates of the points.
+ * @param pq The codebooks.
+ * @param rerank How many times k candidates to re-rank per point.
+ * @param cluster The cluster whose points to search for.
+ * @param blocks The codes of every cluster, same order as the clusters.
+ * @param probes The nearest clusters of each point, see _nearest_clusters().
+ * Empty to scan the point's own cluster only.
+ * @param n_probes The number of nearest clusters per point in @probes.
+ * @param knng Where to write the knn of each point of @cluster, in place.
+ * @param deadline Points that would start after this time are skipped,
+ * their rows are left as they are.
+ *
+ * @return None.
+ */
+static void
+knn_of_cluster_pq(const dataset_t& dataset, const pq_t& pq, uint32_t rerank,
+		const cluster_t& cluster, const vector<pq_block_t>& blocks,
+		const vector<uint32_t>& probes, uint32_t n_probes, graph_t& knng, double deadline)
+{
+	uint32_t k = knng.k();
+	uint32_t n_dims = dataset.n_dims();
+	uint32_t n_kept = max(rerank, 1u) * k;
+	const vector<uint32_t>& members = cluster.points();
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		pq_table_t table;
+		topk_t approx(n_kept), exact(k);
+		vector<uint32_t> kept(n_kept);
+
+		#pragma omp for schedule(dynamic, query_tile) nowait
+		for (size_t c_member = 0; c_member < members.size(); ++c_member) {
+			if (omp_get_wtime() >= deadline) continue;
+
+			uint32_t point_id = members[c_member];
+			const float* coords = dataset.row(point_id);
+			uint64_t n_scanned = 0;
+
+			pq.prepare(coords, table);
+
+			if (probes.empty()) {
+				blocks[cluster.id() - 1].scan(table, point_id, approx);
+				n_scanned += blocks[cluster.id() - 1].size();
+			} else {
+				for (uint32_t c_probe = 0; c_probe < n_probes; ++c_probe) {
+					const pq_block_t& block = blocks[probes[(size_t)point_id * n_probes + c_probe]];
+
+					block.scan(table, point_id, approx);
+					n_scanned += block.size();
+				}
+			}
+
+			uint32_t n_found = approx.write(kept.data(), NULL);
+
+			for (uint32_t c_kept = 0; c_kept < n_found; ++c_kept)
+				exact.push(l2_sqr(coords, dataset.row(kept[c_kept]), n_dims), kept[c_kept]);
+
+			profile_distances(n_scanned + n_found);
+
+			_write_row(knng, point_id, exact);
+		}
+	}
+}
+
+/*
+ * @brief Find the k nearest neighbors of every point of @members among them,
+ * evaluating each pair of points once.
+ *
+ * The members are cut in tiles of @symmetric_tile points and every pair of
+ * tiles is searched once, offering each distance to both points. The pairs of
+ * tiles are scheduled in rounds (round-robin tournament), no two pairs of a
+ * round share a tile. So each task owns the knn of its two tiles and they
+ * need no locks. Each round is a parallel loop.
+ *
+ * @param dataset The coordinates of the points.
+ * @param members The points to find their knn among them. Usually a cluster.
+ * @param topks The knn of each member, reused across clusters. Grown as needed.
+ * @param knng Where to write the knn of each point of @members, in place.
+ *
+ * @return None.
+ */
+static void
+knn_of_cluster_symmetric(const dataset_t& dataset, const vector<uint32_t>& members,
+		vector<topk_t>& topks, graph_t& knng)
+{
+	uint32_t k = knng.k();
+	size_t n_members = members.size();
+
+	if (members.empty()) return;
+
+	packed_block_t packed(dataset, members.data(), n_members);
+
+	while (topks.size() < n_members)
+		topks.emplace_back(k);
+
+	size_t n_tiles = (n_members + symmetric_tile - 1) / symmetric_tile;
+
+	// An odd number of tiles gets a dummy one, its pairs are skipped.
+	size_t n_slots = n_tiles + (n_tiles & 1);
+	size_t n_rounds = max(n_slots - 1, (size_t)1);
+
+	auto search_pair = [&](size_t tile1, size_t tile2) {
+		busy_timer_t busy;
+
+		size_t first1 = tile1 * symmetric_tile;
+		size_t first2 = tile2 * symmetric_tile;
+
+		knn_search_symmetric(dataset, packed,
+				first1, min((size_t)symmetric_tile, n_members - first1),
+				first2, min((size_t)symmetric_tile, n_members - first2),
+				topks.data());
+	};
+
+	#pragma omp parallel
+	{
+		// Each tile with itself, the tiles are independent.
+		#pragma omp for schedule(dynamic)
+		for (size_t c_tile = 0; c_tile < n_tiles; ++c_tile)
+			search_pair(c_tile, c_tile);
+
+		// The last slot stays put, the others rotate by one every round.
+		for (size_t c_round = 0; c_round + 1 < n_slots; ++c_round) {
+			#pragma omp for schedule(dynamic)
+			for (size_t c_pair = 0; c_pair < n_slots / 2; ++c_pair) {
+				size_t tile1 = (c_pair == 0) ? n_slots - 1 : (c_round + c_pair) % n_rounds;
+				size_t tile2 = (c_round + n_rounds - c_pair) % n_rounds;
+
+				if (tile1 >= n_tiles || tile2 >= n_tiles) continue;
+
+				search_pair(tile1, tile2);
+			}
+		}
+
+		#pragma omp for
+		for (size_t c_member = 0; c_member < n_members; ++c_member)
+			_write_row(knng, members[c_member], topks[c_member]);
+	}
+}
+
+/*
+ * @brief The order to search the clusters of @clusters in, by size.
+ *
+ * Largest first lets _search_partition() balance the threads best. On a time
+ * budget, smallest first improves the most rows per distance by the deadline.
+ *
+ * @param smallest_first Order by increasing size instead.
+ *
+ * @return The indexes of the clusters, in order.
+ */
+static vector<uint32_t>
+_search_order(const vector<cluster_t>& clusters, bool smallest_first)
+{
+	vector<uint32_t> order(clusters.size());
+	iota(order.begin(), order.end(), 0);
+
+	stable_sort(order.begin(), order.end(), [&](uint32_t cluster1, uint32_t cluster2) {
+		size_t size1 = clusters[cluster1].points().size();
+		size_t size2 = clusters[cluster2].points().size();
 
-	return knn;
+		return smallest_first ? size1 < size2 : size1 > size2;
+	});
+
+	return order;
 }
 
-vector<vector<uint32_t>> create_knng(vector<point_t>& points, uint32_t k,
-		uint32_t n_clusters, uint32_t n_iters)
+/*
+ * @brief Give every point some neighbors, at a fraction of the cost of the
+ * full search.
+ *
+ * The members of each cluster are cut in windows of k + 1 to twice as many
+ * points, and each point is searched among its window only. Used on a time
+ * budget before the full search, so that the rows the full search doesn't
+ * reach in time still hold real neighbors. The windows that would start
+ * after @deadline are only padded, see graph_t::pad_row().
+ *
+ * @param dataset The coordinates of the points.
+ * @param clusters The clusters to cut in windows.
+ * @param knng Where to write the knn of every point, in place.
+ * @param deadline When to stop searching windows.
+ *
+ * @return None.
+ */
+static void
+_fill_rows(const dataset_t& dataset, const vector<cluster_t>& clusters, graph_t& knng,
+		double deadline)
+{
+	uint32_t k = knng.k();
+	size_t window = max((size_t)fill_window, (size_t)k + 1);
+
+	// The windows, as (cluster index, first member, last member + 1).
+	vector<tuple<uint32_t, size_t, size_t>> windows;
+	for (uint32_t c_cluster = 0; c_cluster < clusters.size(); ++c_cluster) {
+		size_t n_members = clusters[c_cluster].points().size();
+		size_t n_windows = max(n_members / window, (size_t)1);
+
+		for (size_t c_window = 0; c_window < n_windows; ++c_window)
+			windows.emplace_back(c_cluster, c_window * n_members / n_windows,
+					(c_window + 1) * n_members / n_windows);
+	}
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		vector<topk_t> topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+			topks.emplace_back(k);
+
+		#pragma omp for schedule(dynamic) nowait
+		for (size_t c_window = 0; c_window < windows.size(); ++c_window) {
+			const vector<uint32_t>& members = clusters[get<0>(windows[c_window])].points();
+			const uint32_t* ids = members.data() + get<1>(windows[c_window]);
+			size_t n_ids = get<2>(windows[c_window]) - get<1>(windows[c_window]);
+
+			if (n_ids == 0) continue;
+
+			if (omp_get_wtime() >= deadline) {
+				for (size_t c_id = 0; c_id < n_ids; ++c_id)
+					knng.pad_row(ids[c_id], 0);
+
+				continue;
+			}
+
+			packed_block_t packed(dataset, ids, n_ids);
+
+			for (size_t tile = 0; tile < n_ids; tile += query_tile) {
+				uint32_t n_queries = min((size_t)query_tile, n_ids - tile);
+
+				knn_search_block(dataset, ids + tile, n_queries, packed, topks.data());
+
+				for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+					_write_row(knng, ids[tile + c_query], topks[c_query]);
+			}
+		}
+	}
+}
+
+/*
+ * @brief Find the @n_nearest clusters of every point.
+ *
+ * @param dataset The coordinates of the points.
+ * @param clusters The clusters, their index is their id - 1.
+ * @param n_nearest How many clusters to find per point.
+ * @param nearest The indexes of each point's nearest clusters, nearest first,
+ * as a flat (n_points x n_nearest) array.
+ * @param distances The distance to each of @nearest, same layout.
+ *
+ * @return None.
+ */
+static void
+_nearest_clusters(const dataset_t& dataset, const vector<cluster_t>& clusters,
+		uint32_t n_nearest, vector<uint32_t>& nearest, vector<float>& distances)
+{
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_dims = dataset.n_dims();
+
+	n_nearest = min(n_nearest, (uint32_t)clusters.size());
+
+	nearest.resize((size_t)n_points * n_nearest);
+	distances.resize((size_t)n_points * n_nearest);
+
+	profile_distances((uint64_t)n_points * clusters.size());
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		vector<pair<float, uint32_t>> ranking(clusters.size());
+
+		#pragma omp for nowait
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			const float* coords = dataset.row(c_point);
+
+			for (uint32_t c_cluster = 0; c_cluster < clusters.size(); ++c_cluster)
+				ranking[c_cluster] = {euclidean_distance_aprox(
+						clusters[c_cluster].centroid(), coords, n_dims), c_cluster};
+
+			partial_sort(ranking.begin(), ranking.begin() + n_nearest, ranking.end());
+
+			for (uint32_t c_near = 0; c_near < n_nearest; ++c_near) {
+				nearest[(size_t)c_point * n_nearest + c_near] = ranking[c_near].second;
+				distances[(size_t)c_point * n_nearest + c_near] = ranking[c_near].first;
+			}
+		}
+	}
+}
+
+/*
+ * @brief Search every point of @cluster against the points of its @n_probes
+ * nearest clusters.
+ *
+ * Each tile of queries gathers the clusters its queries probe. Each of them
+ * is searched only by the queries of the tile that probe it, and the knn
+ * carry over from one probed cluster to the next.
+ *
+ * @param dataset The coordinates of the points.
+ * @param cluster The cluster whose points to search for.
+ * @param clusters All the clusters, their index is their id - 1.
+ * @param packed All the clusters, packed, same order as @clusters.
+ * @param probes The nearest clusters of each point, see _nearest_clusters().
+ * @param n_probes The number of nearest clusters per point in @probes.
+ * @param knng Where to write the knn of each point of @cluster, in place.
+ * @param deadline Tiles that would start after this time are skipped, their
+ * rows are left as they are.
+ *
+ * @return None.
+ */
+static void
+knn_of_cluster_probes(const dataset_t& dataset, const cluster_t& cluster,
+		const vector<packed_block_t>& packed, const vector<uint32_t>& probes,
+		uint32_t n_probes, graph_t& knng, double deadline)
+{
+	uint32_t k = knng.k();
+	const vector<uint32_t>& members = cluster.points();
+
+	#pragma omp parallel
+	{
+		busy_timer_t busy;
+
+		// The knn of the tile's queries and of those that probe the
+		// current cluster. Swapped between them, never reallocated.
+		vector<topk_t> topks, sub_topks;
+		for (uint32_t c_query = 0; c_query < query_tile; ++c_query) {
+			topks.emplace_back(k);
+			sub_topks.emplace_back(k);
+		}
+
+		// The clusters the queries of a tile probe, and the queries that
+		// probe the current cluster.
+		vector<uint32_t> probed, sub_queries, sub_slots;
+
+		#pragma omp for schedule(dynamic) nowait
+		for (size_t tile = 0; tile < members.size(); tile += query_tile) {
+			if (omp_get_wtime() >= deadline) continue;
+
+			uint32_t n_queries = min((size_t)query_tile, members.size() - tile);
+
+			probed.clear();
+			for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+				const uint32_t* point_probes = &probes[(size_t)members[tile + c_query] * n_probes];
+				probed.insert(probed.end(), point_probes, point_probes + n_probes);
+			}
+
+			sort(probed.begin(), probed.end());
+			probed.erase(unique(probed.begin(), probed.end()), probed.end());
+
+			for (uint32_t c_cluster : probed) {
+				sub_queries.clear();
+				sub_slots.clear();
+
+				for (uint32_t c_query = 0; c_query < n_queries; ++c_query) {
+					uint32_t point_id = members[tile + c_query];
+					const uint32_t* point_probes = &probes[(size_t)point_id * n_probes];
+
+					if (find(point_probes, point_probes + n_probes, c_cluster)
+							== point_probes + n_probes)
+						continue;
+
+					swap(sub_topks[sub_queries.size()], topks[c_query]);
+					sub_queries.push_back(point_id);
+					sub_slots.push_back(c_query);
+				}
+
+				knn_search_block(dataset, sub_queries.data(), sub_queries.size(),
+						packed[c_cluster], sub_topks.data());
+
+				for (size_t c_sub = 0; c_sub < sub_slots.size(); ++c_sub)
+					swap(topks[sub_slots[c_sub]], sub_topks[c_sub]);
+			}
+
+			for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+				_write_row(knng, members[tile + c_query], topks[c_query]);
+		}
+	}
+}
+
+graph_t create_knng(const dataset_t& dataset, vector<point_t>& points,
+		const config_t& config, run_report_t* report, vector<uint32_t>* assignments)
 {
 	/*
-	 * Run K-Means clustering. Using this method we exhaustively search
-	 * for the k nearest neighbors of a point in the cluster it belongs.
+	 * On a time budget, every phase stops early enough to leave the time
+	 * to write the knng, so that a complete one is always written.
+	 */
+	bool budgeted = (config.time_budget > 0.0);
+	double start = omp_get_wtime();
+	double deadline = numeric_limits<double>::infinity();
+
+	if (budgeted)
+		deadline = start + config.time_budget
+			- (double)points.size() * config.k * sizeof(uint32_t) / write_rate;
+
+	/*
+	 * Optionally, rotate the points onto their principal axes. Distances
+	 * don't change, but their leading dimensions now bound them from below,
+	 * and the search abandons the candidates these already rule out. The
+	 * search reads the rotated copy, it lives as long as the dataset.
+	 */
+	dataset_t rotated, projected;
+	vector<point_t> projected_points;
+	uint32_t n_leading = 0;
+
+	if (config.pca_params.enabled) {
+		profile_phase_t pca_phase("pca", report);
+
+		pca_t pca(dataset);
+
+		uint32_t n_dims = dataset.n_dims();
+		uint32_t n_projected = (config.pca_params.n_leading > 0) ?
+			min(config.pca_params.n_leading, n_dims) :
+			pca.leading_dims(config.pca_params.variance);
+
+		// Abandoning after most of the dimensions saves too little.
+		n_leading = (n_projected <= n_dims / 2) ? n_projected : 0;
+
+		rotated = pca.rotate(dataset, n_dims);
+
+		// Clustering on the leading dimensions only is cheaper per distance.
+		if (config.pca_params.clustering) {
+			projected = pca.rotate(dataset, n_projected);
+			projected_points = projected.points();
+		}
+	}
+
+	// After the PCA, phases don't nest.
+	profile_phase_t clustering_phase("clustering", report);
+
+	// The coordinates the search reads, and those the clustering reads. The
+	// centroids live in the latter.
+	bool projected_clustering = config.pca_params.enabled && config.pca_params.clustering;
+	const dataset_t& search_dataset = config.pca_params.enabled ? rotated : dataset;
+	const dataset_t& cluster_dataset = projected_clustering ? projected : dataset;
+	vector<point_t>& cluster_points = projected_clustering ? projected_points : points;
+
+	/*
+	 * Run K-Means clustering, or build a random projection forest. Using
+	 * this method we exhaustively search for the k nearest neighbors of a
+	 * point in the cluster it belongs, in each partition.
 	 */
 	//cout << "In create_knng: Running K-Means." << endl;
-	kmeans_t kmeans(n_clusters, n_iters, points);
-	kmeans.run();
+	kmeans_params_t kmeans_params = config.kmeans_params;
+	kmeans_params.seed = config.seed;
+
+	// Leave most of the budget to the search.
+	if (budgeted)
+		kmeans_params.deadline = start + clustering_share * max(deadline - start, 0.0);
+
+	// Leaves get at least half of their maximum size, enough to fill rows.
+	rpforest_params_t rpforest_params = config.rpforest_params;
+	rpforest_params.seed = config.seed;
+	rpforest_params.leaf_size = max(rpforest_params.leaf_size, 2 * (config.k + 1));
+
+	/*
+	 * Resuming, K-Means is skipped, the clusters are those of the
+	 * checkpoint. A forest is deterministic and cheap, it is built again.
+	 */
+	const checkpoint_params_t& checkpoint_params = config.checkpoint_params;
+	uint64_t fingerprint = checkpoint_fingerprint(config, dataset, cluster_dataset.n_dims());
+	unique_ptr<checkpoint_t> checkpoint;
+
+	if (checkpoint_params.resume) {
+		try {
+			checkpoint.reset(new checkpoint_t(checkpoint_params, fingerprint));
+		} catch (const runtime_error& error) {
+			cerr << error.what() << ", starting over" << endl;
+		}
+	}
+
+	unique_ptr<candidate_generator_t> generator;
+
+	if (config.engine == engine_t::rpforest)
+		generator.reset(new rpforest_t(rpforest_params, cluster_dataset, cluster_points));
+	else if (checkpoint)
+		generator.reset(new checkpoint_generator_t(*checkpoint, cluster_dataset.n_dims(),
+				cluster_points));
+	else
+		generator.reset(new kmeans_generator_t(kmeans_params, config.max_cluster_size,
+				config.branching, config.balance, cluster_dataset, cluster_points));
+
+	generator->run();
+
+	if (checkpoint && !checkpoint->matches(*generator)) {
+		cerr << checkpoint_params.path << " doesn't match the clusters, starting over" << endl;
+		checkpoint.reset();
+	}
+
+	// The checkpoint is taken once the clusters are known.
+	if (!checkpoint && !checkpoint_params.path.empty()) {
+		try {
+			checkpoint.reset(new checkpoint_t(checkpoint_params, fingerprint, *generator,
+					points.size(), cluster_dataset.n_dims(), config.k,
+					config.refine || generator->n_partitions() > 1));
+		} catch (const runtime_error& error) {
+			cerr << error.what() << ", running without a checkpoint" << endl;
+		}
+	}
 	//cout << "In create_knng: Done K-Means." << endl;
 
 	//cout << "In create_knng: Printing the clustering result." << endl;
@@ -107,13 +968,254 @@ vector<vector<uint32_t>> create_knng(vector<point_t>& points, uint32_t k,
 	//}
 
 	//cout << "Creating the knng." << endl;
-	vector<vector<uint32_t>> knng;
-	knng.resize(points.size());
+	clustering_phase.end();
+
+	// The other partitions, if any, are searched after this one.
+	const vector<cluster_t>& clusters = generator->partition(0);
+	uint32_t n_partitions = generator->n_partitions();
+
+	if (assignments) {
+		assignments->resize(points.size());
+
+		for (uint32_t c_cluster = 0; c_cluster < clusters.size(); ++c_cluster)
+			for (uint32_t point_id : clusters[c_cluster].points())
+				(*assignments)[point_id] = c_cluster;
+	}
+
+	if (report) {
+		generator->describe(*report);
+
+		for (const cluster_t& cluster : clusters)
+			report->cluster_sizes.push_back(cluster.points().size());
+	}
+
+	/*
+	 * Product quantization. Codes are cheap to scan, every point scans the
+	 * codes of its own cluster, or of its @n_probes nearest ones, and only
+	 * the nearest codes are evaluated in float. The codebooks are trained
+	 * and the clusters encoded first, in a phase of their own.
+	 */
+	unique_ptr<pq_t> pq;
+	vector<pq_block_t> pq_blocks;
+	vector<uint32_t> pq_probes;
+	uint32_t n_pq_probes = 0;
+
+	if (config.pq_params.n_subspaces > 0) {
+		profile_phase_t encoding_phase("encoding", report);
+
+		pq_params_t pq_params = config.pq_params;
+		pq_params.seed = config.seed;
+
+		pq.reset(new pq_t(search_dataset, pq_params));
+
+		pq_blocks.reserve(clusters.size());
+		for (const cluster_t& cluster : clusters)
+			pq_blocks.emplace_back(search_dataset, *pq, cluster.points().data(),
+					cluster.points().size());
+
+		if (config.n_probes > 1) {
+			vector<float> probe_distances;
+			_nearest_clusters(cluster_dataset, clusters, config.n_probes, pq_probes,
+					probe_distances);
+			n_pq_probes = pq_probes.size() / points.size();
+		}
+	}
+
+	profile_phase_t search_phase("search", report);
+
+	// The refinement needs the distance of every neighbor, so does merging
+	// the knn of several partitions.
+	graph_t knng(points.size(), config.k, config.refine || n_partitions > 1);
+
+	/*
+	 * On a budget, every row gets some neighbors first. The full search then
+	 * improves them, the smallest clusters first since they improve the
+	 * most rows per distance, until the deadline.
+	 */
+	vector<uint32_t> order = _search_order(clusters, budgeted);
+
+	// Optionally, the plain search scans codes and re-ranks in float. The
+	// codes of the candidates of each cluster are encoded once, up front.
+	quantizer_t quantizer(search_dataset, config.quantization);
+	bool quantized = (config.quantization != quantization_t::none);
+	vector<quantized_block_t> codes;
+
+	auto search_cluster = [&](uint32_t c_cluster, const vector<uint32_t>& queries,
+			const vector<uint32_t>& candidates) {
+		if (quantized)
+			knn_of_cluster_quantized(search_dataset, quantizer, config.rerank, queries,
+					codes[c_cluster], knng, deadline);
+		else
+			knn_of_cluster(search_dataset, queries, candidates, n_leading, knng, deadline);
+	};
+
+	/*
+	 * Every search below only writes the rows of the cluster's own points,
+	 * so a cluster of the first partition is checkpointed once searched,
+	 * unless the deadline may have cut it short, and skipped on a resume.
+	 */
+	auto cluster_restored = [&](uint32_t c_cluster) {
+		return checkpoint && checkpoint->done(0, c_cluster);
+	};
+
+	auto checkpoint_cluster = [&](uint32_t c_cluster) {
+		if (checkpoint && omp_get_wtime() < deadline)
+			checkpoint->cluster_done(0, c_cluster, clusters[c_cluster].points(), knng);
+	};
+
+	if (budgeted) _fill_rows(search_dataset, clusters, knng, deadline);
+
+	// The rows of the clusters searched before the run was killed.
+	if (checkpoint) checkpoint->restore_rows(knng);
+
+	if (pq) {
+		for (uint32_t c_cluster : order) {
+			if (omp_get_wtime() >= deadline) break;
+			if (cluster_restored(c_cluster)) continue;
+
+			knn_of_cluster_pq(search_dataset, *pq, config.rerank, clusters[c_cluster],
+					pq_blocks, pq_probes, n_pq_probes, knng, deadline);
+			checkpoint_cluster(c_cluster);
+		}
+	} else if (config.n_probes <= 1 && !config.symmetric
+			&& config.quantization == quantization_t::none) {
+		_search_partition(search_dataset, clusters, order, n_leading, false, knng, deadline,
+				checkpoint.get(), 0);
+	} else if (config.n_probes <= 1) {
+		// The knn of the members of a cluster, for the symmetric search.
+		vector<topk_t> topks;
+
+		if (quantized && !config.symmetric) {
+			codes.reserve(clusters.size());
+			for (const cluster_t& cluster : clusters)
+				codes.emplace_back(search_dataset, quantizer, cluster.points().data(),
+						cluster.points().size());
+		}
+
+		// Clusters one after the other, the points of each one in parallel.
+		// The symmetric search writes the rows of a cluster at its end, it
+		// can only stop between clusters.
+		for (uint32_t c_cluster : order) {
+			const cluster_t& cluster = clusters[c_cluster];
+
+			if (omp_get_wtime() >= deadline) break;
+			if (cluster_restored(c_cluster)) continue;
+
+			if (config.symmetric)
+				knn_of_cluster_symmetric(search_dataset, cluster.points(), topks, knng);
+			else
+				search_cluster(c_cluster, cluster.points(), cluster.points());
+
+			checkpoint_cluster(c_cluster);
+		}
+	} else if (config.overlap_ratio <= 0.0f) {
+		/*
+		 * Multi-probe. Each point is searched against its @n_probes
+		 * nearest clusters. They are packed once, up front, since every
+		 * cluster is probed by the points of several clusters.
+		 */
+		vector<uint32_t> probes;
+		vector<float> probe_distances;
+		_nearest_clusters(cluster_dataset, clusters, config.n_probes, probes, probe_distances);
+		uint32_t n_probes = probes.size() / points.size();
+
+		vector<packed_block_t> packed;
+		packed.reserve(clusters.size());
+		for (const cluster_t& cluster : clusters)
+			packed.emplace_back(search_dataset, cluster.points().data(),
+					cluster.points().size(), n_leading);
+
+		for (uint32_t c_cluster : order) {
+			if (omp_get_wtime() >= deadline) break;
+			if (cluster_restored(c_cluster)) continue;
+
+			knn_of_cluster_probes(search_dataset, clusters[c_cluster], packed, probes,
+					n_probes, knng, deadline);
+			checkpoint_cluster(c_cluster);
+		}
+	} else {
+		/*
+		 * Redundant assignment. Points near a boundary are also candidates
+		 * of the other clusters among their @n_probes nearest, if those are
+		 * at most @overlap_ratio times further than their nearest one. Each
+		 * point is still searched only in its own cluster, so no candidate
+		 * is offered to it twice.
+		 */
+		vector<uint32_t> probes;
+		vector<float> probe_distances;
+		_nearest_clusters(cluster_dataset, clusters, config.n_probes, probes, probe_distances);
+		uint32_t n_probes = probes.size() / points.size();
+
+		// The distances are squared, so is the ratio.
+		float max_ratio = config.overlap_ratio * config.overlap_ratio;
+
+		vector<vector<uint32_t>> candidates(clusters.size());
+		for (size_t c_cluster = 0; c_cluster < clusters.size(); ++c_cluster)
+			candidates[c_cluster] = clusters[c_cluster].points();
+
+		for (const point_t& point : cluster_points) {
+			uint32_t own = point.cluster()->id() - 1;
+			const uint32_t* point_probes = &probes[(size_t)point.id() * n_probes];
+			const float* point_distances = &probe_distances[(size_t)point.id() * n_probes];
+
+			for (uint32_t c_probe = 0; c_probe < n_probes; ++c_probe) {
+				if (point_probes[c_probe] == own) continue;
+				if (point_distances[c_probe] > max_ratio * point_distances[0]) break;
+
+				candidates[point_probes[c_probe]].push_back(point.id());
+			}
+		}
+
+		if (quantized) {
+			codes.reserve(clusters.size());
+			for (const vector<uint32_t>& cluster_candidates : candidates)
+				codes.emplace_back(search_dataset, quantizer, cluster_candidates.data(),
+						cluster_candidates.size());
+		}
+
+		for (uint32_t c_cluster : order) {
+			if (omp_get_wtime() >= deadline) break;
+			if (cluster_restored(c_cluster)) continue;
+
+			search_cluster(c_cluster, clusters[c_cluster].points(), candidates[c_cluster]);
+			checkpoint_cluster(c_cluster);
+		}
+	}
+
+	/*
+	 * The other partitions, e.g. the other trees of a forest, may not
+	 * separate a point from the neighbors the previous ones did. Their knn
+	 * are merged into the rows. They only get the plain search.
+	 */
+	for (uint32_t c_partition = 1; c_partition < n_partitions; ++c_partition) {
+		if (omp_get_wtime() >= deadline) break;
+
+		const vector<cluster_t>& partition = generator->partition(c_partition);
+
+		_search_partition(search_dataset, partition, _search_order(partition, budgeted),
+				n_leading, true, knng, deadline, checkpoint.get(), c_partition);
+	}
+
+	/*
+	 * Neighbors across cluster boundaries are missed by the search. Recover
+	 * them by refining the graph with NN-Descent.
+	 */
+	search_phase.end();
+
+	// On a budget, the refinement gets what is left of it, if anything.
+	double remaining = deadline - omp_get_wtime();
+
+	if (config.refine && remaining > 0.0) {
+		profile_phase_t refinement_phase("refinement", report);
+
+		nndescent_params_t params = config.refine_params;
+		params.seed = config.seed;
+
+		if (budgeted)
+			params.time_budget = (params.time_budget > 0.0) ?
+				min(params.time_budget, remaining) : remaining;
 
-	#pragma omp parallel for
-	for (size_t c_point = 0; c_point < points.size(); ++c_point) {
-		//printf("Calculating k-nn of %zu-th point.\n", c_point);
-		knng[c_point] = knn_of_point(points[c_point], k);
+		nndescent_refine(search_dataset, knng, params);
 	}
 
 	return knng;
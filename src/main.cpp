@@ -1,11 +1,21 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <string>
 #include <vector>
+#include <stdexcept>
 #include <omp.h>
 #include "knng.hpp"
 #include "point.hpp"
+#include "dataset.hpp"
 #include "helpers.hpp"
+#include "distance.hpp"
+#include "config.hpp"
 #include "input-output.hpp"
+#include "streaming.hpp"
+#include "index.hpp"
+#include "profile.hpp"
 
 using namespace std;
 
@@ -20,29 +30,105 @@ int main(int argc, char **argv)
 	omp_set_num_threads(omp_get_num_procs());
 	// TODO: Set OMP_PROC_BIND env var.
 
-	// The default hyperparameters of the program.
-	string dataset_path = "datasets/dummy-data.bin";
-	uint32_t n_clusters = 2;  // # of clusters to create.
-	uint32_t n_iters = 100;   // # of iterations of K-Means.
+	// The time budget, if any, counts from here.
+	double start = omp_get_wtime();
 
-	// Also accept other path for source data.
-	if (argc > 1) dataset_path = string(argv[1]);
-	if (argc > 2) n_clusters = atoll(argv[2]);
+	// The hyperparameters of the program, defaults unless specified.
+	config_t config;
 
-	cout << "Dataset path = " << dataset_path << endl;
-	cout << "# Clusters = " << n_clusters << endl;
+	if (!parse_config(argc, argv, config)) {
+		print_usage(cerr, argv[0]);
+		return 1;
+	}
 
-	// The number of neighbors to find per point.
-	const uint32_t k = 100;
+	cout << "Dataset path = " << config.dataset_path << endl;
+	cout << "# Clusters = " << config.kmeans_params.n_clusters << endl;
+	cout << "Distance kernels = " << distance_isa() << endl;
 
-	// Read dataset points.
-	vector<point_t> points = read_dataset(dataset_path, k);
+	// Where the phases are recorded, if a report was asked for.
+	run_report_t report;
+	run_report_t* report_ptr = config.report_path.empty() ? NULL : &report;
 
-	// Construct the knng.
-	vector<vector<uint32_t>> knng = create_knng(points, k, n_clusters, n_iters);
+	if (report_ptr && config.hardware_counters && !open_hardware_counters())
+		cerr << "Hardware counters are not available" << endl;
 
-	// Save to ouput.bin file.
-	write_knng(knng, k, "output.bin");
+	// Out of core, the buckets are read and their rows written one at a time.
+	if (config.streaming_params.enabled) {
+		try {
+			create_knng_streaming(config, report_ptr);
+		} catch (const runtime_error& error) {
+			cerr << error.what() << endl;
+			return 1;
+		}
+	} else {
+		// Read dataset points.
+		// Loading and writing are serial, the main thread is busy throughout.
+		profile_phase_t load_phase("load", report_ptr);
+		double load_start = omp_get_wtime();
+		dataset_t dataset = read_dataset(config.dataset_path, config.n_dims);
+		vector<point_t> points = dataset.points();
+		profile_busy(omp_get_wtime() - load_start);
+		load_phase.end();
+
+		if (dataset.n_points() == 0) {
+			cerr << "No points could be read from " << config.dataset_path << endl;
+			return 1;
+		}
+
+		if (config.append) {
+			// Only the new points are searched, the index has the rest.
+			try {
+				index_t index(config.index_path, true);
+				append_to_index(index, dataset, report_ptr);
+
+				if (!config.output_path.empty()) {
+					profile_phase_t write_phase("write", report_ptr);
+					busy_timer_t busy;
+					export_knng(index, config.output_path);
+				}
+			} catch (const runtime_error& error) {
+				cerr << error.what() << endl;
+				return 1;
+			}
+		} else {
+			// Loading took part of the budget, the construction gets the rest.
+			if (config.time_budget > 0.0)
+				config.time_budget = max(config.time_budget - (omp_get_wtime() - start), 1e-3);
+
+			// Construct the knng, and keep its clusters for an index.
+			vector<uint32_t> assignments;
+			graph_t knng = create_knng(dataset, points, config, report_ptr,
+					config.index_path.empty() ? NULL : &assignments);
+
+			// Save to the output file, ouput.bin by default.
+			try {
+				profile_phase_t write_phase("write", report_ptr);
+				busy_timer_t busy;
+				write_knng(knng, config.output_path);
+
+				if (!config.index_path.empty())
+					save_index(config.index_path, dataset, knng, assignments,
+							*max_element(assignments.begin(), assignments.end()) + 1);
+
+				// The knng is written, nothing is left to resume.
+				if (!config.checkpoint_params.path.empty())
+					remove(config.checkpoint_params.path.c_str());
+			} catch (const runtime_error& error) {
+				cerr << error.what() << endl;
+				return 1;
+			}
+		}
+	}
+
+	if (report_ptr) {
+		ofstream report_file(config.report_path);
+		write_report(report, report_file);
+
+		if (!report_file) {
+			cerr << "Cannot write the report to " << config.report_path << endl;
+			return 1;
+		}
+	}
 
 	return 0;
 }
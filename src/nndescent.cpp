@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <omp.h>
+#include "nndescent.hpp"
+#include "helpers.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// The bit of a neighbor id that marks it new, i.e. not joined yet.
+static constexpr uint32_t new_flag = 1u << 31;
+
+/*
+ * @brief splitmix64, a cheap hash used to seed each point's sampling.
+ */
+static inline uint64_t _mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+
+	return x ^ (x >> 31);
+}
+
+/*
+ * @brief Keep a random subset of at most @n_samples items of @items.
+ *
+ * @param items The items to sample, in place.
+ * @param n_samples The number of items to keep.
+ * @param state The random state, advanced by the call.
+ *
+ * @return None.
+ */
+static inline void _sample(vector<uint32_t>& items, uint32_t n_samples, uint64_t& state)
+{
+	if (items.size() <= n_samples) return;
+
+	// Partial Fisher-Yates, the first @n_samples items are the sample.
+	for (uint32_t c_item = 0; c_item < n_samples; ++c_item) {
+		state = _mix(state);
+		size_t other = c_item + state % (items.size() - c_item);
+		swap(items[c_item], items[other]);
+	}
+
+	items.resize(n_samples);
+}
+
+/*
+ * @brief Insert @neighbor_id in the row of @point_id, keeping it sorted.
+ *
+ * The caller holds the lock of the row. The inserted neighbor is marked new.
+ *
+ * @return Whether the row changed.
+ */
+static inline bool
+_insert(graph_t& knng, uint32_t point_id, uint32_t neighbor_id, float distance)
+{
+	uint32_t k = knng.k();
+	uint32_t* neighbors = knng.row(point_id);
+	float* distances = knng.distances(point_id);
+
+	if (distance >= distances[k - 1]) return false;
+
+	// Already a neighbor. Padded slots have infinite distance, ignore them.
+	for (uint32_t c_slot = 0; c_slot < k; ++c_slot)
+		if ((neighbors[c_slot] & ~new_flag) == neighbor_id
+				&& distances[c_slot] < numeric_limits<float>::infinity())
+			return false;
+
+	// Shift the further neighbors one slot, the furthest one drops out.
+	uint32_t slot = k - 1;
+	for (; slot > 0 && distances[slot - 1] > distance; --slot) {
+		neighbors[slot] = neighbors[slot - 1];
+		distances[slot] = distances[slot - 1];
+	}
+
+	neighbors[slot] = neighbor_id | new_flag;
+	distances[slot] = distance;
+
+	return true;
+}
+
+/*
+ * @brief Evaluate the pair (@point1, @point2) and offer each to the other.
+ *
+ * The furthest distance of a row is read without its lock. A stale value
+ * only costs a lock, the check is repeated under the lock.
+ *
+ * @return The number of rows that changed.
+ */
+static inline uint32_t
+_join(const dataset_t& dataset, graph_t& knng, vector<omp_lock_t>& locks,
+		uint32_t point1, uint32_t point2)
+{
+	uint32_t k = knng.k();
+	uint32_t n_updates = 0;
+
+	float distance = euclidean_distance_aprox(dataset.row(point1),
+			dataset.row(point2), dataset.n_dims());
+
+	if (distance < knng.distances(point1)[k - 1]) {
+		omp_set_lock(&locks[point1]);
+		n_updates += _insert(knng, point1, point2, distance);
+		omp_unset_lock(&locks[point1]);
+	}
+
+	if (distance < knng.distances(point2)[k - 1]) {
+		omp_set_lock(&locks[point2]);
+		n_updates += _insert(knng, point2, point1, distance);
+		omp_unset_lock(&locks[point2]);
+	}
+
+	return n_updates;
+}
+
+uint32_t nndescent_refine(const dataset_t& dataset, graph_t& knng,
+		const nndescent_params_t& params)
+{
+	uint32_t n_points = knng.n_points();
+	uint32_t k = knng.k();
+	uint32_t n_samples = max(1u, (uint32_t)(params.sample_rate * k));
+
+	double deadline = (params.time_budget > 0.0) ?
+		omp_get_wtime() + params.time_budget : numeric_limits<double>::infinity();
+
+	// Stop once an iteration changes fewer neighbors than this.
+	size_t min_updates = params.delta * n_points * k;
+
+	vector<omp_lock_t> locks(n_points);
+
+	// The sampled new and old neighbors of each point, then their reverse.
+	vector<vector<uint32_t>> new_lists(n_points), old_lists(n_points);
+	vector<vector<uint32_t>> new_reverse(n_points), old_reverse(n_points);
+
+	// Every neighbor found by the search is new. Padding is never joined.
+	#pragma omp parallel for
+	for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+		omp_init_lock(&locks[c_point]);
+
+		uint32_t* neighbors = knng.row(c_point);
+		const float* distances = knng.distances(c_point);
+
+		for (uint32_t c_slot = 0; c_slot < k; ++c_slot)
+			if (distances[c_slot] < numeric_limits<float>::infinity())
+				neighbors[c_slot] |= new_flag;
+	}
+
+	uint32_t c_iter = 0;
+
+	while (c_iter < params.n_iters && omp_get_wtime() < deadline) {
+		uint64_t iter_seed = _mix(params.seed + c_iter);
+
+		/*
+		 * Sample the new neighbors of each point, they become old. Only
+		 * the thread that handles a point touches its row here.
+		 */
+		#pragma omp parallel for schedule(dynamic, 1024)
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			uint32_t* neighbors = knng.row(c_point);
+			const float* distances = knng.distances(c_point);
+			uint64_t state = iter_seed ^ c_point;
+
+			vector<uint32_t>& new_list = new_lists[c_point];
+			vector<uint32_t>& old_list = old_lists[c_point];
+
+			new_list.clear();
+			old_list.clear();
+
+			for (uint32_t c_slot = 0; c_slot < k; ++c_slot) {
+				if (distances[c_slot] == numeric_limits<float>::infinity())
+					continue;
+
+				// Keep the slot of new neighbors to clear their flag.
+				if (neighbors[c_slot] & new_flag)
+					new_list.push_back(c_slot);
+				else
+					old_list.push_back(neighbors[c_slot]);
+			}
+
+			_sample(new_list, n_samples, state);
+			_sample(old_list, n_samples, state);
+
+			for (uint32_t& slot : new_list) {
+				neighbors[slot] &= ~new_flag;
+				slot = neighbors[slot];
+			}
+
+			/*
+			 * A graph built by searching clusters has no edge between
+			 * clusters, and neither do the neighbors of its neighbors.
+			 * Random points, joined like new neighbors, open the bridges.
+			 */
+			for (uint32_t c_random = 0; c_random < params.n_random; ++c_random) {
+				state = _mix(state);
+				uint32_t random_id = state % n_points;
+
+				if (random_id != c_point) new_list.push_back(random_id);
+			}
+		}
+
+		// Build the reverse lists.
+		#pragma omp parallel for
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			new_reverse[c_point].clear();
+			old_reverse[c_point].clear();
+		}
+
+		#pragma omp parallel for schedule(dynamic, 1024)
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			for (uint32_t neighbor : new_lists[c_point]) {
+				omp_set_lock(&locks[neighbor]);
+				new_reverse[neighbor].push_back(c_point);
+				omp_unset_lock(&locks[neighbor]);
+			}
+
+			for (uint32_t neighbor : old_lists[c_point]) {
+				omp_set_lock(&locks[neighbor]);
+				old_reverse[neighbor].push_back(c_point);
+				omp_unset_lock(&locks[neighbor]);
+			}
+		}
+
+		// Sample the reverse lists and merge them in the forward ones.
+		#pragma omp parallel for schedule(dynamic, 1024)
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			uint64_t state = _mix(iter_seed ^ ((uint64_t)c_point << 32));
+
+			vector<uint32_t>& new_list = new_lists[c_point];
+			vector<uint32_t>& old_list = old_lists[c_point];
+
+			_sample(new_reverse[c_point], n_samples, state);
+			_sample(old_reverse[c_point], n_samples, state);
+
+			new_list.insert(new_list.end(), new_reverse[c_point].begin(),
+					new_reverse[c_point].end());
+			old_list.insert(old_list.end(), old_reverse[c_point].begin(),
+					old_reverse[c_point].end());
+
+			sort(new_list.begin(), new_list.end());
+			new_list.erase(unique(new_list.begin(), new_list.end()), new_list.end());
+			sort(old_list.begin(), old_list.end());
+			old_list.erase(unique(old_list.begin(), old_list.end()), old_list.end());
+		}
+
+		/*
+		 * Local join. Each pair of new neighbors, and each new neighbor
+		 * with each old neighbor. Old pairs were joined in a past
+		 * iteration already.
+		 */
+		size_t n_updates = 0, n_joins = 0;
+
+		#pragma omp parallel reduction(+: n_updates, n_joins)
+		{
+			busy_timer_t busy;
+
+			#pragma omp for schedule(dynamic, 64) nowait
+			for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+				if (omp_get_wtime() >= deadline) continue;
+
+				const vector<uint32_t>& new_list = new_lists[c_point];
+				const vector<uint32_t>& old_list = old_lists[c_point];
+
+				for (size_t c_new = 0; c_new < new_list.size(); ++c_new) {
+					uint32_t point1 = new_list[c_new];
+
+					for (size_t c_other = c_new + 1; c_other < new_list.size(); ++c_other)
+						n_updates += _join(dataset, knng, locks, point1, new_list[c_other]);
+
+					for (uint32_t point2 : old_list)
+						if (point1 != point2)
+							n_updates += _join(dataset, knng, locks, point1, point2);
+				}
+
+				// An upper bound, old neighbors that are also new are skipped.
+				n_joins += new_list.size() * (new_list.size() - 1) / 2
+					+ new_list.size() * old_list.size();
+			}
+		}
+
+		profile_distances(n_joins);
+
+		++c_iter;
+
+		if (n_updates <= min_updates) break;
+	}
+
+	// The flags are internal, leave clean ids in the graph.
+	#pragma omp parallel for
+	for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+		uint32_t* neighbors = knng.row(c_point);
+
+		for (uint32_t c_slot = 0; c_slot < k; ++c_slot)
+			neighbors[c_slot] &= ~new_flag;
+
+		omp_destroy_lock(&locks[c_point]);
+	}
+
+	return c_iter;
+}
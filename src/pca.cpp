@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+#include "pca.hpp"
+
+using namespace std;
+
+// Points per tile of the covariance, accumulated in float before the sums.
+static constexpr uint32_t covariance_tile = 64;
+
+// The most sweeps of Jacobi rotations. It converges in far fewer.
+static constexpr uint32_t max_sweeps = 64;
+
+/*
+ * @brief Diagonalize the symmetric (n x n) matrix @matrix with cyclic
+ * Jacobi rotations.
+ *
+ * @param matrix The matrix. Left with its eigenvalues on the diagonal.
+ * @param vectors Where to write the eigenvectors, as the columns of an
+ * (n x n) matrix.
+ * @param n The order of the matrix.
+ *
+ * @return None.
+ */
+static void _jacobi(vector<double>& matrix, vector<double>& vectors, uint32_t n)
+{
+	vectors.assign((size_t)n * n, 0.0);
+	for (uint32_t c_row = 0; c_row < n; ++c_row)
+		vectors[(size_t)c_row * n + c_row] = 1.0;
+
+	double diagonal = 0.0;
+	for (uint32_t c_row = 0; c_row < n; ++c_row)
+		diagonal += matrix[(size_t)c_row * n + c_row] * matrix[(size_t)c_row * n + c_row];
+
+	for (uint32_t c_sweep = 0; c_sweep < max_sweeps; ++c_sweep) {
+		double off_diagonal = 0.0;
+		for (uint32_t p = 0; p < n; ++p)
+			for (uint32_t q = p + 1; q < n; ++q)
+				off_diagonal += matrix[(size_t)p * n + q] * matrix[(size_t)p * n + q];
+
+		if (off_diagonal <= 1e-24 * diagonal) break;
+
+		for (uint32_t p = 0; p < n; ++p) {
+			for (uint32_t q = p + 1; q < n; ++q) {
+				double apq = matrix[(size_t)p * n + q];
+				if (apq == 0.0) continue;
+
+				// The rotation that zeroes matrix[p][q], its smaller angle.
+				double theta = (matrix[(size_t)q * n + q] - matrix[(size_t)p * n + p]) / (2.0 * apq);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+
+				// matrix = J^T matrix J, columns then rows.
+				for (uint32_t k = 0; k < n; ++k) {
+					double akp = matrix[(size_t)k * n + p];
+					double akq = matrix[(size_t)k * n + q];
+					matrix[(size_t)k * n + p] = c * akp - s * akq;
+					matrix[(size_t)k * n + q] = s * akp + c * akq;
+				}
+
+				for (uint32_t k = 0; k < n; ++k) {
+					double apk = matrix[(size_t)p * n + k];
+					double aqk = matrix[(size_t)q * n + k];
+					matrix[(size_t)p * n + k] = c * apk - s * aqk;
+					matrix[(size_t)q * n + k] = s * apk + c * aqk;
+				}
+
+				// vectors = vectors J.
+				for (uint32_t k = 0; k < n; ++k) {
+					double vkp = vectors[(size_t)k * n + p];
+					double vkq = vectors[(size_t)k * n + q];
+					vectors[(size_t)k * n + p] = c * vkp - s * vkq;
+					vectors[(size_t)k * n + q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+}
+
+pca_t::pca_t(const dataset_t& dataset)
+: _n_dims(dataset.n_dims()), _mean(_n_dims, 0.0f)
+{
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_dims = _n_dims;
+
+	// The mean, per-thread sums merged once.
+	vector<double> sums(n_dims, 0.0);
+
+	#pragma omp parallel
+	{
+		vector<double> sums_thr(n_dims, 0.0);
+
+		#pragma omp for nowait
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			const float* coords = dataset.row(c_point);
+
+			for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+				sums_thr[c_dim] += coords[c_dim];
+		}
+
+		#pragma omp critical
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+			sums[c_dim] += sums_thr[c_dim];
+	}
+
+	for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+		_mean[c_dim] = (n_points > 0) ? sums[c_dim] / n_points : 0.0;
+
+	/*
+	 * The covariance of the centered points. Each thread sums the outer
+	 * products of a tile in float, whole rows so that the loop vectorizes,
+	 * and adds the tile's sum to its own in double.
+	 */
+	size_t n_entries = (size_t)n_dims * n_dims;
+	vector<double> covariance(n_entries, 0.0);
+	size_t n_tiles = ((size_t)n_points + covariance_tile - 1) / covariance_tile;
+
+	#pragma omp parallel
+	{
+		vector<double> covariance_thr(n_entries, 0.0);
+		vector<float> tile_sum(n_entries);
+		vector<float> centered(n_dims);
+
+		#pragma omp for nowait
+		for (size_t c_tile = 0; c_tile < n_tiles; ++c_tile) {
+			size_t first = c_tile * covariance_tile;
+			size_t last = min(first + covariance_tile, (size_t)n_points);
+
+			fill(tile_sum.begin(), tile_sum.end(), 0.0f);
+
+			for (size_t c_point = first; c_point < last; ++c_point) {
+				const float* coords = dataset.row(c_point);
+
+				for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+					centered[c_dim] = coords[c_dim] - _mean[c_dim];
+
+				for (uint32_t c_row = 0; c_row < n_dims; ++c_row) {
+					float scale = centered[c_row];
+					float* row = &tile_sum[(size_t)c_row * n_dims];
+
+					for (uint32_t c_col = 0; c_col < n_dims; ++c_col)
+						row[c_col] += scale * centered[c_col];
+				}
+			}
+
+			for (size_t c_entry = 0; c_entry < n_entries; ++c_entry)
+				covariance_thr[c_entry] += tile_sum[c_entry];
+		}
+
+		#pragma omp critical
+		for (size_t c_entry = 0; c_entry < n_entries; ++c_entry)
+			covariance[c_entry] += covariance_thr[c_entry];
+	}
+
+	for (double& entry : covariance)
+		entry /= max(n_points, (uint32_t)1);
+
+	vector<double> vectors;
+	_jacobi(covariance, vectors, n_dims);
+
+	// Largest variance first.
+	vector<uint32_t> order(n_dims);
+	iota(order.begin(), order.end(), 0);
+	sort(order.begin(), order.end(), [&](uint32_t axis1, uint32_t axis2) {
+		return covariance[(size_t)axis1 * n_dims + axis1]
+			> covariance[(size_t)axis2 * n_dims + axis2];
+	});
+
+	_axes.resize(n_entries);
+	_variances.resize(n_dims);
+
+	for (uint32_t c_axis = 0; c_axis < n_dims; ++c_axis) {
+		uint32_t axis = order[c_axis];
+
+		// Rounding leaves tiny negative eigenvalues of flat directions.
+		_variances[c_axis] = max(covariance[(size_t)axis * n_dims + axis], 0.0);
+
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+			_axes[(size_t)c_dim * n_dims + c_axis] = vectors[(size_t)c_dim * n_dims + axis];
+	}
+}
+
+const vector<float>& pca_t::variances() const
+{
+	return _variances;
+}
+
+uint32_t pca_t::leading_dims(float fraction) const
+{
+	double total = accumulate(_variances.begin(), _variances.end(), 0.0);
+	double explained = 0.0;
+
+	for (uint32_t c_axis = 0; c_axis < _n_dims; ++c_axis) {
+		explained += _variances[c_axis];
+
+		if (explained >= fraction * total) return c_axis + 1;
+	}
+
+	return max(_n_dims, (uint32_t)1);
+}
+
+void pca_t::rotate(const float* coords, float* rotated, uint32_t n_axes) const
+{
+	fill(rotated, rotated + n_axes, 0.0f);
+
+	for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+		float centered = coords[c_dim] - _mean[c_dim];
+		const float* axes = &_axes[(size_t)c_dim * _n_dims];
+
+		for (uint32_t c_axis = 0; c_axis < n_axes; ++c_axis)
+			rotated[c_axis] += centered * axes[c_axis];
+	}
+}
+
+dataset_t pca_t::rotate(const dataset_t& dataset, uint32_t n_axes) const
+{
+	uint32_t n_points = dataset.n_points();
+	dataset_t rotated(n_points, n_axes);
+
+	#pragma omp parallel for
+	for (uint32_t c_point = 0; c_point < n_points; ++c_point)
+		rotate(dataset.row(c_point), rotated.row(c_point), n_axes);
+
+	return rotated;
+}
@@ -6,8 +6,8 @@
 
 using namespace std;
 
-point_t::point_t(const uint32_t& id, const vector<float>& coordinates)
-: _id(id), _cluster(NULL), _coordinates(coordinates)
+point_t::point_t(const uint32_t& id, const float* coordinates, uint32_t n_dims)
+: _id(id), _n_dims(n_dims), _cluster(NULL), _coordinates(coordinates)
 {
 	/* Empty. */
 }
@@ -27,26 +27,29 @@ void point_t::cluster(const cluster_t* cluster)
 	_cluster = cluster;
 }
 
-const vector<float>& point_t::coords() const
+const float* point_t::coords() const
 {
 	return _coordinates;
 }
 
-void point_t::print(ostream& outstream, string indent) const
+uint32_t point_t::n_dims() const
 {
-	uint32_t n_dims = _coordinates.size();
+	return _n_dims;
+}
 
+void point_t::print(ostream& outstream, string indent) const
+{
 	outstream << indent << "Point:" << endl;
 	outstream << indent << "\tID = " << _id << endl;
 	outstream << indent << "\tCluster addr = " << _cluster << endl;
 	if (_cluster)
 		outstream << indent << "\tCluster ID through ptr = " << _cluster->id() << endl;
 	outstream << indent << "\tCoordinates:" << endl;
-	for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim) {
+	for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
 		if (c_dim % 10 == 0)
 			outstream << indent + "\t\t";
 
-		outstream << _coordinates.at(c_dim) << ' ';
+		outstream << _coordinates[c_dim] << ' ';
 
 		if (c_dim % 10 == 9)
 			outstream << endl;
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <unordered_set>
+#include <vector>
+#include <immintrin.h>
+#include "pq.hpp"
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Candidates per block of the 4-bit scan, the lanes of a 256-bit shuffle.
+static constexpr uint32_t scan_block = 32;
+
+/*
+ * Signature of a fast-scan kernel. Sums the quantized table lookups of the
+ * @scan_block candidates of a block of 4-bit @codes into @sums, and returns
+ * the mask of the candidates whose sum is below @threshold.
+ */
+typedef uint32_t (*fast_scan_kernel_t)(const uint8_t* codes, const uint8_t* table,
+		uint32_t n_subspaces, uint16_t threshold, uint16_t* sums);
+
+static uint32_t _fast_scan_scalar(const uint8_t* codes, const uint8_t* table,
+		uint32_t n_subspaces, uint16_t threshold, uint16_t* sums)
+{
+	fill(sums, sums + scan_block, 0);
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub) {
+		const uint8_t* group = codes + c_sub * 16;
+		const uint8_t* row = table + c_sub * 16;
+
+		for (uint32_t c_byte = 0; c_byte < 16; ++c_byte) {
+			sums[c_byte] += row[group[c_byte] & 0x0f];
+			sums[c_byte + 16] += row[group[c_byte] >> 4];
+		}
+	}
+
+	uint32_t below = 0;
+	for (uint32_t c_lane = 0; c_lane < scan_block; ++c_lane)
+		if (sums[c_lane] < threshold) below |= 1u << c_lane;
+
+	return below;
+}
+
+__attribute__((target("avx2")))
+static uint32_t _fast_scan_avx2(const uint8_t* codes, const uint8_t* table,
+		uint32_t n_subspaces, uint16_t threshold, uint16_t* sums)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+
+	// The sums of the first and the last 16 candidates.
+	__m256i low_sums = _mm256_setzero_si256();
+	__m256i high_sums = _mm256_setzero_si256();
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub) {
+		__m128i group = _mm_loadu_si128((const __m128i*)(codes + c_sub * 16));
+		__m128i row = _mm_loadu_si128((const __m128i*)(table + c_sub * 16));
+
+		__m128i low = _mm_and_si128(group, mask);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(group, 4), mask);
+
+		// One shuffle looks the group up for all 32 candidates.
+		__m256i found = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(row),
+				_mm256_set_m128i(high, low));
+
+		low_sums = _mm256_add_epi16(low_sums,
+				_mm256_cvtepu8_epi16(_mm256_castsi256_si128(found)));
+		high_sums = _mm256_add_epi16(high_sums,
+				_mm256_cvtepu8_epi16(_mm256_extracti128_si256(found, 1)));
+	}
+
+	_mm256_storeu_si256((__m256i*)sums, low_sums);
+	_mm256_storeu_si256((__m256i*)(sums + 16), high_sums);
+
+	// The sums are below 2^15, see pq_t::prepare(), they compare as signed.
+	__m256i limit = _mm256_set1_epi16(threshold);
+	__m256i low_below = _mm256_cmpgt_epi16(limit, low_sums);
+	__m256i high_below = _mm256_cmpgt_epi16(limit, high_sums);
+
+	// Packing the masks to bytes interleaves the lanes of the halves, fix
+	// the order of the 64-bit quarters back to candidate order.
+	__m256i below = _mm256_permute4x64_epi64(_mm256_packs_epi16(low_below, high_below),
+			0xd8);
+
+	return _mm256_movemask_epi8(below);
+}
+
+/*
+ * @brief Pick the fastest fast-scan kernel the running CPU supports.
+ */
+static fast_scan_kernel_t _select_fast_scan()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return _fast_scan_avx2;
+
+	return _fast_scan_scalar;
+}
+
+static const fast_scan_kernel_t _fast_scan = _select_fast_scan();
+
+pq_t::pq_t(const dataset_t& dataset, const pq_params_t& params)
+: _params(params), _n_dims(dataset.n_dims()), _n_centroids(1u << params.n_bits)
+{
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_subspaces = min(max(params.n_subspaces, 1u), _n_dims);
+
+	_params.n_subspaces = n_subspaces;
+
+	for (uint32_t c_sub = 0; c_sub <= n_subspaces; ++c_sub)
+		_bounds.push_back((uint64_t)c_sub * _n_dims / n_subspaces);
+
+	_codebooks.assign((size_t)_n_centroids * _n_dims, 0.0f);
+
+	// Sample distinct points with Floyd's algorithm, the same for every group.
+	mt19937_64 rng(params.seed);
+	uint32_t n_sample = min(params.sample_size, n_points);
+
+	vector<uint32_t> sample;
+	if (n_sample == n_points) {
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point)
+			sample.push_back(c_point);
+	} else {
+		unordered_set<uint32_t> picked;
+
+		for (uint32_t c_last = n_points - n_sample; c_last < n_points; ++c_last) {
+			uint32_t index = uniform_int_distribution<uint32_t>(0, c_last)(rng);
+			if (!picked.insert(index).second) picked.insert(index = c_last);
+
+			sample.push_back(index);
+		}
+	}
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub) {
+		uint32_t first = _bounds[c_sub];
+		uint32_t sub_dims = _bounds[c_sub + 1] - first;
+
+		// The sample's coordinates of the group.
+		dataset_t sub_dataset(sample.size(), sub_dims);
+
+		#pragma omp parallel for
+		for (size_t c_sample = 0; c_sample < sample.size(); ++c_sample)
+			copy(dataset.row(sample[c_sample]) + first,
+					dataset.row(sample[c_sample]) + first + sub_dims,
+					sub_dataset.row(c_sample));
+
+		vector<point_t> points = sub_dataset.points();
+
+		kmeans_params_t kmeans_params;
+		kmeans_params.n_clusters = _n_centroids;
+		kmeans_params.n_iters = params.n_iters;
+		kmeans_params.init = kmeans_init_t::plusplus;
+		kmeans_params.seed = params.seed + c_sub;
+
+		kmeans_t kmeans(kmeans_params, sub_dataset, points);
+		kmeans.run();
+
+		// With fewer points than centroids the others stay at the origin.
+		float* codebook = &_codebooks[(size_t)_n_centroids * first];
+		for (const cluster_t& cluster : kmeans.clusters())
+			copy(cluster.centroid(), cluster.centroid() + sub_dims,
+					codebook + (size_t)(cluster.id() - 1) * sub_dims);
+	}
+}
+
+uint32_t pq_t::n_subspaces() const
+{
+	return _params.n_subspaces;
+}
+
+uint32_t pq_t::n_bits() const
+{
+	return _params.n_bits;
+}
+
+void pq_t::encode(const float* coords, uint8_t* codes) const
+{
+	for (uint32_t c_sub = 0; c_sub < _params.n_subspaces; ++c_sub) {
+		uint32_t first = _bounds[c_sub];
+		uint32_t sub_dims = _bounds[c_sub + 1] - first;
+		const float* codebook = &_codebooks[(size_t)_n_centroids * first];
+
+		float best = numeric_limits<float>::infinity();
+
+		for (uint32_t c_centroid = 0; c_centroid < _n_centroids; ++c_centroid) {
+			const float* centroid = codebook + (size_t)c_centroid * sub_dims;
+			float distance = 0.0f;
+
+			for (uint32_t c_dim = 0; c_dim < sub_dims; ++c_dim) {
+				float diff = coords[first + c_dim] - centroid[c_dim];
+				distance += diff * diff;
+			}
+
+			if (distance < best) {
+				best = distance;
+				codes[c_sub] = c_centroid;
+			}
+		}
+	}
+}
+
+void pq_t::prepare(const float* coords, pq_table_t& table) const
+{
+	uint32_t n_subspaces = _params.n_subspaces;
+
+	table.distances.resize((size_t)n_subspaces * _n_centroids);
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub) {
+		uint32_t first = _bounds[c_sub];
+		uint32_t sub_dims = _bounds[c_sub + 1] - first;
+		const float* codebook = &_codebooks[(size_t)_n_centroids * first];
+		float* row = &table.distances[(size_t)c_sub * _n_centroids];
+
+		for (uint32_t c_centroid = 0; c_centroid < _n_centroids; ++c_centroid) {
+			const float* centroid = codebook + (size_t)c_centroid * sub_dims;
+			float distance = 0.0f;
+
+			for (uint32_t c_dim = 0; c_dim < sub_dims; ++c_dim) {
+				float diff = coords[first + c_dim] - centroid[c_dim];
+				distance += diff * diff;
+			}
+
+			row[c_centroid] = distance;
+		}
+	}
+
+	if (_params.n_bits != 4) return;
+
+	/*
+	 * Quantize the table to bytes. Each row is shifted to start at 0, which
+	 * shifts every sum alike, and all the rows share a scale so that their
+	 * sums stay comparable. The fast scan sums in 16 bits and compares them
+	 * as signed, so past 128 groups the levels shrink below 255 for the sums
+	 * of all the groups to stay below 2^15 - 1.
+	 */
+	vector<float> mins(n_subspaces);
+	float max_range = 0.0f;
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub) {
+		const float* row = &table.distances[c_sub * 16];
+
+		mins[c_sub] = *min_element(row, row + 16);
+		max_range = max(max_range, *max_element(row, row + 16) - mins[c_sub]);
+	}
+
+	float max_level = min(255u, 32766u / n_subspaces);
+	float scale = (max_range > 0.0f) ? max_level / max_range : 0.0f;
+
+	table.quantized.resize(n_subspaces * 16);
+
+	for (uint32_t c_sub = 0; c_sub < n_subspaces; ++c_sub)
+		for (uint32_t c_centroid = 0; c_centroid < 16; ++c_centroid)
+			table.quantized[c_sub * 16 + c_centroid] = min(max_level,
+					(table.distances[c_sub * 16 + c_centroid] - mins[c_sub]) * scale + 0.5f);
+}
+
+pq_block_t::pq_block_t(const dataset_t& dataset, const pq_t& pq, const uint32_t* ids,
+		size_t n_ids)
+: _n_subspaces(pq.n_subspaces()), _n_bits(pq.n_bits()), _ids(ids, ids + n_ids)
+{
+	// One byte per group first, interleaved below for 4 bits.
+	vector<uint8_t> codes(n_ids * _n_subspaces);
+
+	#pragma omp parallel for
+	for (size_t c_cand = 0; c_cand < n_ids; ++c_cand)
+		pq.encode(dataset.row(ids[c_cand]), &codes[c_cand * _n_subspaces]);
+
+	if (_n_bits != 4) {
+		_codes.swap(codes);
+		return;
+	}
+
+	size_t n_blocks = (n_ids + scan_block - 1) / scan_block;
+	_codes.assign(n_blocks * _n_subspaces * 16, 0);
+
+	for (size_t c_cand = 0; c_cand < n_ids; ++c_cand) {
+		size_t block = c_cand / scan_block;
+		uint32_t lane = c_cand % scan_block;
+
+		for (uint32_t c_sub = 0; c_sub < _n_subspaces; ++c_sub) {
+			uint8_t& byte = _codes[(block * _n_subspaces + c_sub) * 16 + lane % 16];
+			uint8_t code = codes[c_cand * _n_subspaces + c_sub];
+
+			byte |= (lane < 16) ? code : code << 4;
+		}
+	}
+}
+
+size_t pq_block_t::size() const
+{
+	return _ids.size();
+}
+
+void pq_block_t::scan(const pq_table_t& table, uint32_t query_id, topk_t& topk) const
+{
+	size_t n_cands = _ids.size();
+	float threshold = topk.threshold();
+
+	if (_n_bits != 4) {
+		const float* distances = table.distances.data();
+		uint32_t n_centroids = 1u << _n_bits;
+
+		for (size_t c_cand = 0; c_cand < n_cands; ++c_cand) {
+			const uint8_t* codes = &_codes[c_cand * _n_subspaces];
+			float distance = 0.0f;
+
+			for (uint32_t c_sub = 0; c_sub < _n_subspaces; ++c_sub)
+				distance += distances[c_sub * n_centroids + codes[c_sub]];
+
+			if (distance >= threshold || _ids[c_cand] == query_id) continue;
+
+			topk.push(distance, _ids[c_cand]);
+			threshold = topk.threshold();
+		}
+
+		return;
+	}
+
+	alignas(32) uint16_t sums[scan_block];
+
+	for (size_t first = 0; first < n_cands; first += scan_block) {
+		// The sums are below 2^15 - 1, see prepare(), unlike an infinite
+		// threshold.
+		uint16_t limit = min(threshold, 32767.0f);
+
+		uint32_t below = _fast_scan(&_codes[first / scan_block * _n_subspaces * 16],
+				table.quantized.data(), _n_subspaces, limit, sums);
+
+		// The padding of the last block.
+		if (n_cands - first < scan_block)
+			below &= (1u << (n_cands - first)) - 1;
+
+		// Only the few candidates below the threshold are visited.
+		for (; below; below &= below - 1) {
+			uint32_t c_lane = __builtin_ctz(below);
+
+			if (sums[c_lane] >= threshold || _ids[first + c_lane] == query_id) continue;
+
+			topk.push(sums[c_lane], _ids[first + c_lane]);
+			threshold = topk.threshold();
+		}
+	}
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "profile.hpp"
+
+using namespace std;
+
+// The threads with a slot of their own. Nested parallelism is disabled, so
+// thread numbers stay below the team size.
+static constexpr size_t max_profile_threads = 1024;
+
+/*
+ * The counts of one thread, alone in its cache line.
+ */
+struct alignas(64) thread_slot_t {
+	uint64_t n_distances;
+	double busy;
+};
+
+static thread_slot_t _slots[max_profile_threads];
+
+// Whether a phase is counting in the slots. Every phase resets them, so a
+// phase started inside another would corrupt the outer one's counts.
+static bool _phase_open = false;
+
+/*
+ * A hardware counter, and its name in the report.
+ */
+struct hardware_counter_t {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+};
+
+static const hardware_counter_t _hardware_counters[] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"cache_references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+	{"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+static constexpr size_t n_hardware_counters =
+	sizeof(_hardware_counters) / sizeof(_hardware_counters[0]);
+
+// The file descriptor of each counter of each thread, -1 if not open.
+static vector<int> _counter_fds;
+
+static inline thread_slot_t& _slot()
+{
+	return _slots[omp_get_thread_num() % max_profile_threads];
+}
+
+void profile_distances(uint64_t n_distances)
+{
+	_slot().n_distances += n_distances;
+}
+
+void profile_busy(double secs)
+{
+	_slot().busy += secs;
+}
+
+busy_timer_t::busy_timer_t()
+: _start(omp_get_wtime())
+{
+	/* Empty. */
+}
+
+busy_timer_t::~busy_timer_t()
+{
+	profile_busy(omp_get_wtime() - _start);
+}
+
+double run_report_t::wall(const string& name) const
+{
+	double wall = 0.0;
+
+	for (const phase_report_t& phase : phases)
+		if (phase.name == name) wall += phase.wall;
+
+	return wall;
+}
+
+double run_report_t::total_wall() const
+{
+	double wall = 0.0;
+
+	for (const phase_report_t& phase : phases)
+		wall += phase.wall;
+
+	return wall;
+}
+
+/*
+ * @brief The sum of each hardware counter over all the threads.
+ */
+static vector<uint64_t> _read_counters()
+{
+	vector<uint64_t> totals(n_hardware_counters, 0);
+
+	for (size_t c_fd = 0; c_fd < _counter_fds.size(); ++c_fd) {
+		uint64_t value = 0;
+
+		if (_counter_fds[c_fd] >= 0
+				&& read(_counter_fds[c_fd], &value, sizeof(value)) == sizeof(value))
+			totals[c_fd % n_hardware_counters] += value;
+	}
+
+	return totals;
+}
+
+bool open_hardware_counters()
+{
+	size_t n_threads = omp_get_max_threads();
+	_counter_fds.assign(n_threads * n_hardware_counters, -1);
+
+	// Each thread opens the counters of itself, the team is reused.
+	#pragma omp parallel num_threads(n_threads)
+	{
+		size_t thread = omp_get_thread_num();
+
+		for (size_t c_counter = 0; c_counter < n_hardware_counters; ++c_counter) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = _hardware_counters[c_counter].type;
+			attr.config = _hardware_counters[c_counter].config;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			_counter_fds[thread * n_hardware_counters + c_counter] =
+				syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+	}
+
+	return any_of(_counter_fds.begin(), _counter_fds.end(), [](int fd) { return fd >= 0; });
+}
+
+profile_phase_t::profile_phase_t(const string& name, run_report_t* report)
+: _report(report), _start(omp_get_wtime()), _ended(false)
+{
+	_phase.name = name;
+
+	if (!_report) return;
+
+	if (_phase_open) throw logic_error("phase " + name + " started inside another one");
+	_phase_open = true;
+
+	for (size_t c_thread = 0; c_thread < max_profile_threads; ++c_thread) {
+		_slots[c_thread].n_distances = 0;
+		_slots[c_thread].busy = 0.0;
+	}
+
+	// Subtracted at the end.
+	for (uint64_t value : _read_counters())
+		_phase.counters.push_back({"", value});
+}
+
+profile_phase_t::~profile_phase_t()
+{
+	end();
+}
+
+void profile_phase_t::end()
+{
+	if (_ended) return;
+	_ended = true;
+
+	if (!_report) return;
+
+	_phase_open = false;
+	_phase.wall = omp_get_wtime() - _start;
+
+	size_t n_threads = min((size_t)omp_get_max_threads(), max_profile_threads);
+
+	for (size_t c_thread = 0; c_thread < n_threads; ++c_thread) {
+		_phase.n_distances += _slots[c_thread].n_distances;
+		_phase.busy.push_back(_slots[c_thread].busy);
+	}
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		_phase.peak_rss = usage.ru_maxrss;
+
+	vector<uint64_t> counters = _read_counters();
+
+	if (any_of(_counter_fds.begin(), _counter_fds.end(), [](int fd) { return fd >= 0; })) {
+		for (size_t c_counter = 0; c_counter < n_hardware_counters; ++c_counter)
+			_phase.counters[c_counter] = {_hardware_counters[c_counter].name,
+				counters[c_counter] - _phase.counters[c_counter].second};
+	} else {
+		_phase.counters.clear();
+	}
+
+	_report->phases.push_back(_phase);
+}
+
+void write_report(const run_report_t& report, ostream& outstream)
+{
+	outstream << "{" << endl;
+	outstream << "\t\"phases\": [";
+
+	for (size_t c_phase = 0; c_phase < report.phases.size(); ++c_phase) {
+		const phase_report_t& phase = report.phases[c_phase];
+
+		double total_busy = 0.0, max_busy = 0.0;
+		for (double busy : phase.busy) {
+			total_busy += busy;
+			max_busy = max(max_busy, busy);
+		}
+
+		outstream << (c_phase ? "," : "") << endl;
+		outstream << "\t\t{" << endl;
+		outstream << "\t\t\t\"name\": \"" << phase.name << "\"," << endl;
+		outstream << "\t\t\t\"wall_secs\": " << phase.wall << "," << endl;
+		outstream << "\t\t\t\"distances\": " << phase.n_distances << "," << endl;
+		outstream << "\t\t\t\"peak_rss_kb\": " << phase.peak_rss << "," << endl;
+
+		outstream << "\t\t\t\"busy_secs\": [";
+		for (size_t c_thread = 0; c_thread < phase.busy.size(); ++c_thread)
+			outstream << (c_thread ? ", " : "") << phase.busy[c_thread];
+		outstream << "]," << endl;
+
+		// Idle time of the threads, relative to their wall time. Only
+		// meaningful for phases whose parallel loops are instrumented.
+		double idle = phase.busy.empty() || phase.wall <= 0.0 ? 0.0 :
+			1.0 - total_busy / (phase.wall * phase.busy.size());
+		double imbalance = (total_busy > 0.0) ?
+			max_busy * phase.busy.size() / total_busy : 1.0;
+
+		outstream << "\t\t\t\"idle_fraction\": " << max(idle, 0.0) << "," << endl;
+		outstream << "\t\t\t\"imbalance\": " << imbalance << "," << endl;
+
+		outstream << "\t\t\t\"counters\": {";
+		for (size_t c_counter = 0; c_counter < phase.counters.size(); ++c_counter)
+			outstream << (c_counter ? ", " : "") << "\"" << phase.counters[c_counter].first
+				<< "\": " << phase.counters[c_counter].second;
+		outstream << "}" << endl;
+		outstream << "\t\t}";
+	}
+
+	outstream << endl << "\t]," << endl;
+
+	outstream << "\t\"kmeans\": {" << endl;
+	outstream << "\t\t\"iterations\": " << report.kmeans_iters << "," << endl;
+	outstream << "\t\t\"splits\": " << report.n_splits << "," << endl;
+	outstream << "\t\t\"resumed\": " << (report.resumed ? "true" : "false") << "," << endl;
+	outstream << "\t\t\"moved\": [";
+	for (size_t c_iter = 0; c_iter < report.kmeans_moved.size(); ++c_iter)
+		outstream << (c_iter ? ", " : "") << report.kmeans_moved[c_iter];
+	outstream << "]" << endl;
+	outstream << "\t}," << endl;
+
+	outstream << "\t\"rpforest\": {" << endl;
+	outstream << "\t\t\"trees\": " << report.n_trees << "," << endl;
+	outstream << "\t\t\"leaf_size\": " << report.leaf_size << endl;
+	outstream << "\t}," << endl;
+
+	// Powers of two: the i-th bucket counts the clusters with fewer than
+	// 2^i points and at least 2^(i-1), the 0-th one the empty clusters.
+	vector<uint64_t> histogram;
+	uint32_t min_size = report.cluster_sizes.empty() ? 0 : UINT32_MAX, max_size = 0;
+	uint64_t n_points = 0;
+
+	for (uint32_t size : report.cluster_sizes) {
+		size_t bucket = 0;
+		while (bucket < 32 && (1ull << bucket) <= size) ++bucket;
+
+		if (histogram.size() <= bucket) histogram.resize(bucket + 1, 0);
+		++histogram[bucket];
+
+		min_size = min(min_size, size);
+		max_size = max(max_size, size);
+		n_points += size;
+	}
+
+	outstream << "\t\"clusters\": {" << endl;
+	outstream << "\t\t\"count\": " << report.cluster_sizes.size() << "," << endl;
+	outstream << "\t\t\"min_size\": " << min_size << "," << endl;
+	outstream << "\t\t\"max_size\": " << max_size << "," << endl;
+	outstream << "\t\t\"mean_size\": " << (report.cluster_sizes.empty() ? 0.0 :
+			(double)n_points / report.cluster_sizes.size()) << "," << endl;
+	outstream << "\t\t\"size_histogram\": [";
+	for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+		outstream << (bucket ? ", " : "") << "{\"below\": " << (1ull << bucket)
+			<< ", \"count\": " << histogram[bucket] << "}";
+	outstream << "]" << endl;
+	outstream << "\t}" << endl;
+	outstream << "}" << endl;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "quantization.hpp"
+
+using namespace std;
+
+quantizer_t::quantizer_t(const dataset_t& dataset, quantization_t type)
+: _type(type), _n_dims(dataset.n_dims())
+{
+	if (_type != quantization_t::int8) return;
+
+	uint32_t n_points = dataset.n_points();
+
+	vector<float> mins(_n_dims, numeric_limits<float>::infinity());
+	vector<float> maxs(_n_dims, -numeric_limits<float>::infinity());
+
+	// Per-thread ranges, merged once.
+	#pragma omp parallel
+	{
+		vector<float> mins_thr(_n_dims, numeric_limits<float>::infinity());
+		vector<float> maxs_thr(_n_dims, -numeric_limits<float>::infinity());
+
+		#pragma omp for nowait
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point) {
+			const float* coords = dataset.row(c_point);
+
+			for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+				mins_thr[c_dim] = min(mins_thr[c_dim], coords[c_dim]);
+				maxs_thr[c_dim] = max(maxs_thr[c_dim], coords[c_dim]);
+			}
+		}
+
+		#pragma omp critical
+		for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+			mins[c_dim] = min(mins[c_dim], mins_thr[c_dim]);
+			maxs[c_dim] = max(maxs[c_dim], maxs_thr[c_dim]);
+		}
+	}
+
+	_offsets.resize(_n_dims);
+	_scales.resize(_n_dims);
+
+	for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+		_offsets[c_dim] = (n_points > 0) ? mins[c_dim] : 0.0f;
+		_scales[c_dim] = (n_points > 0) ? (maxs[c_dim] - mins[c_dim]) / 255.0f : 0.0f;
+	}
+}
+
+quantization_t quantizer_t::type() const
+{
+	return _type;
+}
+
+size_t quantizer_t::code_size() const
+{
+	switch (_type) {
+		case quantization_t::int8: return sizeof(uint8_t);
+		case quantization_t::fp16: return sizeof(uint16_t);
+		default: return sizeof(float);
+	}
+}
+
+float quantizer_t::prepare_query(const float* coords, float* scaled) const
+{
+	if (_type != quantization_t::int8) {
+		copy(coords, coords + _n_dims, scaled);
+		return 0.0f;
+	}
+
+	float offset_dot = 0.0f;
+
+	for (uint32_t c_dim = 0; c_dim < _n_dims; ++c_dim) {
+		scaled[c_dim] = coords[c_dim] * _scales[c_dim];
+		offset_dot += coords[c_dim] * _offsets[c_dim];
+	}
+
+	return offset_dot;
+}
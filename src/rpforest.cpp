@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include "rpforest.hpp"
+#include "distance.hpp"
+
+using namespace std;
+
+rpforest_t::rpforest_t(const rpforest_params_t& params, const dataset_t& dataset,
+		vector<point_t>& points)
+: _params(params), _dataset(dataset), _points(points)
+{
+	_params.n_trees = max(_params.n_trees, 1u);
+	_params.leaf_size = max(_params.leaf_size, 1u);
+}
+
+/*
+ * @brief Split the node @ids[@first, @last) of tree @c_tree in two halves.
+ *
+ * The hyperplane bisects two random points of the node. The side of a point
+ * is the difference of its distances to them, so the points are ordered by
+ * it and cut at the median, which keeps the tree balanced whatever the data.
+ *
+ * @param c_tree The tree of the node.
+ * @param ids The points of the tree. The node's range is reordered, its first
+ * half is one child and the rest is the other.
+ * @param first The first point of the node in @ids.
+ * @param last One past its last point.
+ * @param parallel Compute the sides of the points with all the threads.
+ *
+ * @return None.
+ */
+void rpforest_t::_split(uint32_t c_tree, vector<uint32_t>& ids, size_t first, size_t last,
+		bool parallel) const
+{
+	uint32_t n_dims = _dataset.n_dims();
+	size_t n_ids = last - first;
+
+	// Same tree and node, same hyperplane.
+	mt19937_64 rng(_params.seed + 0x9e3779b97f4a7c15ULL * (c_tree + 1) + first);
+
+	size_t pivot1 = rng() % n_ids;
+	size_t pivot2 = rng() % (n_ids - 1);
+	if (pivot2 >= pivot1) ++pivot2;
+
+	const float* coords1 = _dataset.row(ids[first + pivot1]);
+	const float* coords2 = _dataset.row(ids[first + pivot2]);
+
+	vector<pair<float, uint32_t>> sides(n_ids);
+
+	#pragma omp parallel for if (parallel)
+	for (size_t c_id = 0; c_id < n_ids; ++c_id) {
+		const float* coords = _dataset.row(ids[first + c_id]);
+
+		sides[c_id] = {l2_sqr(coords, coords1, n_dims) - l2_sqr(coords, coords2, n_dims),
+			ids[first + c_id]};
+	}
+
+	// Ties are broken by id, the split never depends on the order.
+	nth_element(sides.begin(), sides.begin() + n_ids / 2, sides.end());
+
+	for (size_t c_id = 0; c_id < n_ids; ++c_id)
+		ids[first + c_id] = sides[c_id].second;
+}
+
+/*
+ * @brief Build tree @c_tree, one level at a time.
+ *
+ * @return The leaves of the tree.
+ */
+vector<cluster_t> rpforest_t::_build(uint32_t c_tree) const
+{
+	uint32_t n_dims = _dataset.n_dims();
+	size_t n_points = _points.size();
+	size_t leaf_size = _params.leaf_size;
+
+	vector<uint32_t> ids(n_points);
+	for (size_t c_point = 0; c_point < n_points; ++c_point)
+		ids[c_point] = _points[c_point].id();
+
+	// The nodes of the current level still to split, those of the next one
+	// and the leaves, as ranges of @ids.
+	vector<pair<size_t, size_t>> nodes, next, leaves;
+
+	if (n_points > leaf_size)
+		nodes.push_back({0, n_points});
+	else if (n_points > 0)
+		leaves.push_back({0, n_points});
+
+	while (!nodes.empty()) {
+		// The first levels have a few large nodes, each one is split with all
+		// the threads. Further down, the nodes are split in parallel.
+		bool across = (nodes.size() >= (size_t)omp_get_max_threads());
+
+		#pragma omp parallel for schedule(dynamic) if (across)
+		for (size_t c_node = 0; c_node < nodes.size(); ++c_node)
+			_split(c_tree, ids, nodes[c_node].first, nodes[c_node].second, !across);
+
+		next.clear();
+
+		for (const pair<size_t, size_t>& node : nodes) {
+			size_t middle = node.first + (node.second - node.first) / 2;
+
+			for (const pair<size_t, size_t>& child : {make_pair(node.first, middle),
+					make_pair(middle, node.second)}) {
+				if (child.second - child.first > leaf_size)
+					next.push_back(child);
+				else
+					leaves.push_back(child);
+			}
+		}
+
+		swap(nodes, next);
+	}
+
+	vector<cluster_t> clusters;
+	clusters.reserve(leaves.size());
+
+	for (uint32_t c_leaf = 0; c_leaf < leaves.size(); ++c_leaf) {
+		size_t first = leaves[c_leaf].first;
+
+		clusters.push_back(cluster_t(c_leaf + 1, _dataset.row(ids[first]), n_dims));
+		clusters.back().points(&ids[first], leaves[c_leaf].second - first);
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t c_leaf = 0; c_leaf < clusters.size(); ++c_leaf)
+		clusters[c_leaf].recenter(_dataset);
+
+	return clusters;
+}
+
+void rpforest_t::run()
+{
+	_trees.clear();
+
+	for (uint32_t c_tree = 0; c_tree < _params.n_trees; ++c_tree)
+		_trees.push_back(_build(c_tree));
+
+	// Like K-Means, every point knows its leaf, in the first tree. Moving a
+	// tree doesn't move its leaves, the pointers stay valid.
+	const vector<cluster_t>& leaves = _trees.front();
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t c_leaf = 0; c_leaf < leaves.size(); ++c_leaf)
+		for (uint32_t point_id : leaves[c_leaf].points())
+			_points[point_id].cluster(&leaves[c_leaf]);
+}
+
+uint32_t rpforest_t::n_partitions() const
+{
+	return _trees.size();
+}
+
+const vector<cluster_t>& rpforest_t::partition(uint32_t c_partition) const
+{
+	return _trees.at(c_partition);
+}
+
+void rpforest_t::describe(run_report_t& report) const
+{
+	// No iterations, the shape of the forest and the cluster sizes say it all.
+	report.n_trees = _params.n_trees;
+	report.leaf_size = _params.leaf_size;
+}
@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "streaming.hpp"
+#include "config.hpp"
+#include "dataset.hpp"
+#include "distance.hpp"
+#include "graph.hpp"
+#include "kmeans.hpp"
+#include "knng.hpp"
+#include "point.hpp"
+
+using namespace std;
+
+// Points read at a time from the dataset file, and from a spill file.
+static constexpr uint32_t spill_chunk = 65536;
+
+// The other buckets a point is copied to at most, with an overlap.
+static constexpr uint32_t max_guests = 2;
+
+// Marks the ids of the copies in a spill file. Their rows are not written.
+static constexpr uint32_t guest_flag = 1u << 31;
+
+/*
+ * A bucket read back from its spill file.
+ */
+struct bucket_t {
+	// The coordinates of its points, the i-th row is the point @ids[i].
+	dataset_t coords;
+
+	// The ids of its points in the dataset, with @guest_flag for copies.
+	vector<uint32_t> ids;
+};
+
+/*
+ * @brief Read @n_bytes at @offset of @fd.
+ *
+ * @return False if the file ended first or the read failed.
+ */
+static bool
+_pread_all(int fd, void* buffer, size_t n_bytes, size_t offset)
+{
+	char* bytes = (char*)buffer;
+
+	// pread may read less than asked, continue where it stopped.
+	while (n_bytes > 0) {
+		ssize_t n_read = pread(fd, bytes, n_bytes, offset);
+
+		if (n_read <= 0) return false;
+
+		bytes += n_read;
+		n_bytes -= n_read;
+		offset += n_read;
+	}
+
+	return true;
+}
+
+/*
+ * @brief Write @n_bytes at @offset of @fd.
+ *
+ * @return False if the write failed.
+ */
+static bool
+_pwrite_all(int fd, const void* buffer, size_t n_bytes, size_t offset)
+{
+	const char* bytes = (const char*)buffer;
+
+	while (n_bytes > 0) {
+		ssize_t n_written = pwrite(fd, bytes, n_bytes, offset);
+
+		if (n_written <= 0) return false;
+
+		bytes += n_written;
+		n_bytes -= n_written;
+		offset += n_written;
+	}
+
+	return true;
+}
+
+// The spill file of bucket @c_bucket in @spill_dir.
+static string
+_spill_path(const string& spill_dir, uint32_t c_bucket)
+{
+	return spill_dir + "/knng-spill-" + to_string(c_bucket) + ".bin";
+}
+
+/*
+ * @brief Read a bucket back from its spill file, then remove the file.
+ *
+ * A record of the file is the id of a point (uint32_t) followed by its
+ * coordinates.
+ *
+ * @throws runtime_error If the file cannot be read.
+ *
+ * @return The bucket.
+ */
+static bucket_t
+_load_bucket(const string& path, uint32_t n_dims)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw runtime_error("cannot open " + path);
+
+	struct stat status;
+	if (fstat(fd, &status) < 0) {
+		close(fd);
+		throw runtime_error("cannot stat " + path);
+	}
+
+	size_t row_size = n_dims * sizeof(float);
+	size_t record_size = sizeof(uint32_t) + row_size;
+	size_t n_records = status.st_size / record_size;
+
+	bucket_t bucket;
+	bucket.coords = dataset_t(n_records, n_dims, true);
+	bucket.ids.resize(n_records);
+
+	vector<char> buffer(min(n_records, (size_t)spill_chunk) * record_size);
+
+	for (size_t first = 0; first < n_records; first += spill_chunk) {
+		size_t n_read = min((size_t)spill_chunk, n_records - first);
+
+		if (!_pread_all(fd, buffer.data(), n_read * record_size, first * record_size)) {
+			close(fd);
+			throw runtime_error("cannot read " + path);
+		}
+
+		for (size_t c_record = 0; c_record < n_read; ++c_record) {
+			const char* record = &buffer[c_record * record_size];
+
+			memcpy(&bucket.ids[first + c_record], record, sizeof(uint32_t));
+			memcpy(bucket.coords.row(first + c_record), record + sizeof(uint32_t), row_size);
+		}
+	}
+
+	close(fd);
+	unlink(path.c_str());
+
+	return bucket;
+}
+
+/*
+ * @brief Train the centroids of @n_buckets buckets on a sample of the file.
+ *
+ * @param data_fd The dataset file.
+ * @param n_points The number of points in the file.
+ *
+ * @throws runtime_error If the sample cannot be read.
+ *
+ * @return The centroids, one per row.
+ */
+static dataset_t
+_train_centroids(const config_t& config, int data_fd, uint32_t n_points,
+		uint32_t n_buckets, double deadline)
+{
+	uint32_t n_dims = config.n_dims;
+	size_t row_size = n_dims * sizeof(float);
+	size_t n_sample = min(max(config.streaming_params.sample_size, n_buckets), n_points);
+
+	// Selection sampling, the ids come in order and the reads are sequential.
+	mt19937_64 rng(config.seed);
+	vector<uint32_t> sample_ids;
+	sample_ids.reserve(n_sample);
+
+	for (uint32_t point_id = 0; sample_ids.size() < n_sample; ++point_id) {
+		size_t n_left = n_points - point_id;
+
+		if (uniform_int_distribution<size_t>(0, n_left - 1)(rng) < n_sample - sample_ids.size())
+			sample_ids.push_back(point_id);
+	}
+
+	dataset_t sample(n_sample, n_dims);
+	bool failed = false;
+
+	#pragma omp parallel for schedule(dynamic, 256) reduction(||: failed)
+	for (size_t c_sample = 0; c_sample < n_sample; ++c_sample) {
+		size_t offset = sizeof(uint32_t) + (size_t)sample_ids[c_sample] * row_size;
+
+		if (!_pread_all(data_fd, sample.row(c_sample), row_size, offset)) failed = true;
+	}
+
+	if (failed) throw runtime_error("cannot read " + config.dataset_path);
+
+	kmeans_params_t kmeans_params = config.kmeans_params;
+	kmeans_params.n_clusters = n_buckets;
+	kmeans_params.sample_size = 0;
+	kmeans_params.seed = config.seed;
+	kmeans_params.deadline = deadline;
+
+	vector<point_t> points = sample.points();
+	kmeans_t kmeans(kmeans_params, sample, points);
+	kmeans.run();
+
+	const vector<cluster_t>& clusters = kmeans.clusters();
+	dataset_t centroids(clusters.size(), n_dims);
+
+	for (uint32_t c_bucket = 0; c_bucket < clusters.size(); ++c_bucket)
+		copy(clusters[c_bucket].centroid(), clusters[c_bucket].centroid() + n_dims,
+				centroids.row(c_bucket));
+
+	return centroids;
+}
+
+/*
+ * @brief Stream the dataset file once and append every point to the spill
+ * file of its nearest bucket, and of its next nearest ones with an overlap.
+ *
+ * @param data_fd The dataset file.
+ * @param n_points The number of points in the file.
+ * @param centroids The centroids of the buckets.
+ * @param bucket_sizes Set to the number of points of each bucket, copies
+ * excluded.
+ *
+ * @throws runtime_error If the dataset cannot be read or a spill file
+ * cannot be written.
+ *
+ * @return None.
+ */
+static void
+_spill(const config_t& config, int data_fd, uint32_t n_points, const dataset_t& centroids,
+		vector<uint32_t>& bucket_sizes)
+{
+	const streaming_params_t& params = config.streaming_params;
+	uint32_t n_dims = config.n_dims;
+	uint32_t n_buckets = centroids.n_points();
+	size_t row_size = n_dims * sizeof(float);
+	float max_ratio = params.overlap * params.overlap;
+
+	vector<int> spill_fds(n_buckets, -1);
+
+	auto close_all = [&]() {
+		for (int spill_fd : spill_fds)
+			if (spill_fd >= 0) close(spill_fd);
+	};
+
+	for (uint32_t c_bucket = 0; c_bucket < n_buckets; ++c_bucket) {
+		string path = _spill_path(params.spill_dir, c_bucket);
+
+		spill_fds[c_bucket] = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (spill_fds[c_bucket] < 0) {
+			close_all();
+			throw runtime_error("cannot create " + path);
+		}
+	}
+
+	bucket_sizes.assign(n_buckets, 0);
+
+	// The bytes written to each spill file.
+	vector<size_t> spilled(n_buckets, 0);
+
+	dataset_t chunk(spill_chunk, n_dims);
+
+	// The buckets of each point of the chunk, its own first. @n_buckets for
+	// none.
+	vector<uint32_t> homes((size_t)spill_chunk * (1 + max_guests));
+
+	// The records of the chunk, per bucket.
+	vector<vector<char>> records(n_buckets);
+
+	for (size_t first = 0; first < n_points; first += spill_chunk) {
+		uint32_t n_read = min((size_t)spill_chunk, n_points - first);
+
+		if (!_pread_all(data_fd, chunk.data(), n_read * row_size,
+				sizeof(uint32_t) + first * row_size)) {
+			close_all();
+			throw runtime_error("cannot read " + config.dataset_path);
+		}
+
+		#pragma omp parallel for schedule(dynamic, 256)
+		for (uint32_t c_point = 0; c_point < n_read; ++c_point) {
+			const float* coords = chunk.row(c_point);
+
+			// The nearest buckets so far, nearest first.
+			pair<float, uint32_t> nearest[1 + max_guests];
+			fill(nearest, nearest + 1 + max_guests,
+					make_pair(numeric_limits<float>::infinity(), n_buckets));
+
+			for (uint32_t c_bucket = 0; c_bucket < n_buckets; ++c_bucket) {
+				pair<float, uint32_t> bucket(l2_sqr(coords, centroids.row(c_bucket), n_dims),
+						c_bucket);
+
+				for (uint32_t c_slot = 0; c_slot < 1 + max_guests; ++c_slot)
+					if (bucket < nearest[c_slot]) swap(bucket, nearest[c_slot]);
+			}
+
+			uint32_t* home = &homes[(size_t)c_point * (1 + max_guests)];
+			home[0] = nearest[0].second;
+
+			for (uint32_t c_slot = 1; c_slot < 1 + max_guests; ++c_slot) {
+				bool near = (params.overlap > 0.0f)
+					&& nearest[c_slot].first <= max_ratio * nearest[0].first;
+
+				home[c_slot] = near ? nearest[c_slot].second : n_buckets;
+			}
+		}
+
+		for (uint32_t c_point = 0; c_point < n_read; ++c_point) {
+			const uint32_t* home = &homes[(size_t)c_point * (1 + max_guests)];
+
+			++bucket_sizes[home[0]];
+
+			for (uint32_t c_slot = 0; c_slot < 1 + max_guests; ++c_slot) {
+				if (home[c_slot] == n_buckets) continue;
+
+				uint32_t id = (first + c_point) | (c_slot > 0 ? guest_flag : 0);
+				vector<char>& bucket_records = records[home[c_slot]];
+
+				bucket_records.insert(bucket_records.end(), (const char*)&id,
+						(const char*)&id + sizeof(uint32_t));
+				bucket_records.insert(bucket_records.end(), (const char*)chunk.row(c_point),
+						(const char*)chunk.row(c_point) + row_size);
+			}
+		}
+
+		for (uint32_t c_bucket = 0; c_bucket < n_buckets; ++c_bucket) {
+			vector<char>& bucket_records = records[c_bucket];
+
+			if (!_pwrite_all(spill_fds[c_bucket], bucket_records.data(),
+					bucket_records.size(), spilled[c_bucket])) {
+				close_all();
+				throw runtime_error("cannot write " + _spill_path(params.spill_dir, c_bucket));
+			}
+
+			spilled[c_bucket] += bucket_records.size();
+			bucket_records.clear();
+		}
+	}
+
+	close_all();
+}
+
+void create_knng_streaming(const config_t& config, run_report_t* report)
+{
+	const streaming_params_t& params = config.streaming_params;
+	uint32_t n_dims = config.n_dims;
+	uint32_t k = config.k;
+	size_t row_size = n_dims * sizeof(float);
+
+	double start = omp_get_wtime();
+	bool budgeted = (config.time_budget > 0.0);
+	double deadline = budgeted ? start + config.time_budget : 0.0;
+
+	int data_fd = open(config.dataset_path.c_str(), O_RDONLY);
+	if (data_fd < 0) throw runtime_error("cannot open " + config.dataset_path);
+
+	// Keep only the points that are fully in the file, like read_dataset().
+	uint32_t n_points = 0;
+	struct stat status;
+
+	if (!_pread_all(data_fd, &n_points, sizeof(uint32_t), 0) || fstat(data_fd, &status) < 0) {
+		close(data_fd);
+		throw runtime_error("cannot read " + config.dataset_path);
+	}
+
+	n_points = min((size_t)n_points, (status.st_size - sizeof(uint32_t)) / row_size);
+
+	if (n_points == 0 || n_points >= guest_flag) {
+		close(data_fd);
+		throw runtime_error("cannot stream the " + to_string(n_points) + " points of "
+				+ config.dataset_path);
+	}
+
+	/*
+	 * A point of a bucket costs its coordinates twice, with the packed copy
+	 * of the search, and its row of the knng with distances. Two buckets are
+	 * in memory at a time, and bucket sizes vary, so there are twice as
+	 * many as the budget requires.
+	 */
+	size_t point_bytes = 2 * row_size + 2 * k * sizeof(uint32_t) + sizeof(point_t);
+	double bucket_bytes = max(params.memory_gb, 1e-3) * (1 << 30) / 2;
+	uint32_t n_buckets = 2 * (uint32_t)ceil((double)n_points * point_bytes / bucket_bytes);
+	n_buckets = min(max(n_buckets, 1u), n_points);
+
+	dataset_t centroids;
+	vector<uint32_t> bucket_sizes;
+
+	try {
+		profile_phase_t clustering_phase("clustering", report);
+
+		// The buckets share the rest of the budget.
+		double centroids_deadline = budgeted ? start + 0.05 * config.time_budget : 0.0;
+		centroids = _train_centroids(config, data_fd, n_points, n_buckets, centroids_deadline);
+		clustering_phase.end();
+
+		// Reading and writing are serial, the main thread is busy throughout.
+		profile_phase_t spill_phase("spill", report);
+		busy_timer_t busy;
+		_spill(config, data_fd, n_points, centroids, bucket_sizes);
+	} catch (const runtime_error&) {
+		close(data_fd);
+		throw;
+	}
+
+	close(data_fd);
+	n_buckets = centroids.n_points();
+
+	if (report) report->cluster_sizes = bucket_sizes;
+
+	profile_phase_t search_phase("search", report);
+
+	int out_fd = open(config.output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) throw runtime_error("cannot create " + config.output_path);
+
+	// Size the file once, so the rows can be written in any order.
+	if (ftruncate(out_fd, (size_t)n_points * k * sizeof(uint32_t)) < 0) {
+		close(out_fd);
+		throw runtime_error("cannot resize " + config.output_path);
+	}
+
+	// The next bucket is read while the current one is searched.
+	future<bucket_t> next = async(launch::async, _load_bucket,
+			_spill_path(params.spill_dir, 0), n_dims);
+
+	// The points of the buckets done, copies excluded.
+	size_t n_done = 0;
+
+	for (uint32_t c_bucket = 0; c_bucket < n_buckets; ++c_bucket) {
+		bucket_t bucket;
+
+		try {
+			bucket = next.get();
+		} catch (const runtime_error&) {
+			close(out_fd);
+			throw;
+		}
+
+		if (c_bucket + 1 < n_buckets)
+			next = async(launch::async, _load_bucket,
+					_spill_path(params.spill_dir, c_bucket + 1), n_dims);
+
+		if (bucket.ids.empty()) continue;
+
+		config_t bucket_config = config;
+		bucket_config.streaming_params.enabled = false;
+
+		// The clusters and the budget, in proportion to the bucket's points.
+		double share = (double)bucket_sizes[c_bucket] / (n_points - n_done);
+		bucket_config.kmeans_params.n_clusters = max(1.0,
+				round((double)config.kmeans_params.n_clusters * bucket_sizes[c_bucket] / n_points));
+
+		if (budgeted)
+			bucket_config.time_budget = max(share * (deadline - omp_get_wtime()), 1e-3);
+
+		vector<point_t> points = bucket.coords.points();
+		graph_t knng = create_knng(bucket.coords, points, bucket_config, NULL);
+
+		// Only the rows of the bucket's own points, with their ids in the
+		// dataset.
+		bool failed = false;
+
+		#pragma omp parallel reduction(||: failed)
+		{
+			vector<uint32_t> row(k);
+
+			#pragma omp for schedule(dynamic, 1024)
+			for (size_t c_point = 0; c_point < bucket.ids.size(); ++c_point) {
+				if (bucket.ids[c_point] & guest_flag) continue;
+
+				for (uint32_t c_neighbor = 0; c_neighbor < k; ++c_neighbor)
+					row[c_neighbor] = bucket.ids[knng.row(c_point)[c_neighbor]] & ~guest_flag;
+
+				size_t offset = (size_t)bucket.ids[c_point] * k * sizeof(uint32_t);
+
+				if (!_pwrite_all(out_fd, row.data(), k * sizeof(uint32_t), offset))
+					failed = true;
+			}
+		}
+
+		if (failed) {
+			close(out_fd);
+			throw runtime_error("cannot write " + config.output_path);
+		}
+
+		n_done += bucket_sizes[c_bucket];
+	}
+
+	close(out_fd);
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "synthetic.hpp"
+
+using namespace std;
+
+// The rows generated and written at a time by write_synthetic().
+static constexpr size_t write_rows = 256 * synthetic_block;
+
+/*
+ * @brief The centers of the clusters, uniform in the unit cube.
+ */
+static vector<float> _centers(const synthetic_params_t& params)
+{
+	mt19937_64 rng(params.seed);
+	uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	vector<float> centers((size_t)params.n_clusters * params.n_dims);
+	for (float& coord : centers)
+		coord = uniform(rng);
+
+	return centers;
+}
+
+/*
+ * @brief Fill the rows of the block that starts at row @first.
+ */
+static void _block(const synthetic_params_t& params, const vector<float>& centers,
+		size_t first, size_t n_rows, float* rows)
+{
+	uint32_t n_dims = params.n_dims;
+
+	// Distinct from the seed of the centers.
+	mt19937_64 rng(params.seed + 1 + first / synthetic_block);
+	uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	normal_distribution<float> noise(0.0f, params.spread);
+
+	for (size_t c_row = 0; c_row < n_rows; ++c_row) {
+		float* row = rows + c_row * n_dims;
+
+		if (c_row > 0 && uniform(rng) < params.duplicates) {
+			size_t original = uniform_int_distribution<size_t>(0, c_row - 1)(rng);
+			copy(rows + original * n_dims, rows + (original + 1) * n_dims, row);
+			continue;
+		}
+
+		if (params.n_clusters == 0) {
+			for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+				row[c_dim] = uniform(rng);
+			continue;
+		}
+
+		size_t center = uniform_int_distribution<size_t>(0, params.n_clusters - 1)(rng);
+
+		for (uint32_t c_dim = 0; c_dim < n_dims; ++c_dim)
+			row[c_dim] = centers[center * n_dims + c_dim] + noise(rng);
+	}
+}
+
+void synthetic_rows(const synthetic_params_t& params, size_t first, size_t n_rows,
+		float* rows)
+{
+	vector<float> centers = _centers(params);
+	size_t n_blocks = (n_rows + synthetic_block - 1) / synthetic_block;
+
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t c_block = 0; c_block < n_blocks; ++c_block) {
+		size_t offset = c_block * synthetic_block;
+
+		_block(params, centers, first + offset, min(synthetic_block, n_rows - offset),
+				rows + offset * params.n_dims);
+	}
+}
+
+dataset_t synthetic_dataset(uint32_t n_points, const synthetic_params_t& params)
+{
+	dataset_t dataset(n_points, params.n_dims);
+
+	synthetic_rows(params, 0, n_points, dataset.data());
+
+	return dataset;
+}
+
+void write_synthetic(const string& path, uint32_t n_points, const synthetic_params_t& params)
+{
+	ofstream ofs(path, ios::binary);
+	if (!ofs) throw runtime_error("cannot create " + path);
+
+	ofs.write((const char*)&n_points, sizeof(uint32_t));
+
+	vector<float> rows(write_rows * params.n_dims);
+
+	for (size_t first = 0; first < n_points; first += write_rows) {
+		size_t n_rows = min(write_rows, n_points - first);
+
+		synthetic_rows(params, first, n_rows, rows.data());
+		ofs.write((const char*)rows.data(), n_rows * params.n_dims * sizeof(float));
+	}
+
+	if (!ofs) throw runtime_error("cannot write " + path);
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "knng.hpp"
+#include "point.hpp"
+#include "dataset.hpp"
+#include "config.hpp"
+#include "synthetic.hpp"
+
+using namespace std;
+
+/*
+ * Regression test of merging the knn of the partitions of a forest.
+ *
+ * The first partition's search may compute distances differently from the
+ * others', e.g. re-ranked exactly after a quantized scan. A neighbor found
+ * by several partitions must still be kept once.
+ */
+
+/*
+ * @brief Build the knng of @dataset with the options @args.
+ *
+ * @return The number of rows with a neighbor more than once.
+ */
+static uint32_t _rows_with_duplicates(const dataset_t& dataset, vector<string> args)
+{
+	args.insert(args.begin(), { "knng_test_merge", "unused" });
+
+	vector<char*> argv;
+	for (string& arg : args)
+		argv.push_back(&arg[0]);
+
+	config_t config;
+	if (!parse_config(argv.size(), argv.data(), config)) return dataset.n_points();
+
+	vector<point_t> points = dataset.points();
+	graph_t knng = create_knng(dataset, points, config);
+
+	uint32_t n_rows = 0;
+	vector<uint32_t> row(knng.k());
+
+	for (uint32_t point_id = 0; point_id < dataset.n_points(); ++point_id) {
+		copy(knng.row(point_id), knng.row(point_id) + knng.k(), row.begin());
+		sort(row.begin(), row.end());
+
+		if (adjacent_find(row.begin(), row.end()) != row.end()) ++n_rows;
+	}
+
+	return n_rows;
+}
+
+int main()
+{
+	omp_set_dynamic(0);
+	omp_set_num_threads(omp_get_num_procs());
+
+	synthetic_params_t params;
+	params.n_dims = 32;
+	params.n_clusters = 20;
+
+	dataset_t dataset = synthetic_dataset(20000, params);
+
+	vector<string> forest = { "--engine", "rpforest", "--trees", "3", "--leaf-size", "1000" };
+	vector<vector<string>> searches = {
+		{},
+		{ "--quantize", "fp16" },
+		{ "--quantize", "int8" },
+		{ "--pq", "16", "--pq-bits", "8" },
+		{ "--symmetric" },
+	};
+
+	bool failed = false;
+
+	for (const vector<string>& search : searches) {
+		vector<string> args = forest;
+		args.insert(args.end(), search.begin(), search.end());
+
+		uint32_t n_rows = _rows_with_duplicates(dataset, args);
+
+		string name;
+		for (const string& arg : search)
+			name += " " + arg;
+
+		cout << "rpforest" << name << ": " << n_rows << " rows with duplicates" << endl;
+
+		if (n_rows > 0) failed = true;
+	}
+
+	return failed ? 1 : 0;
+}
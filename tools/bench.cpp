@@ -0,0 +1,290 @@
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <omp.h>
+#include "batch-distance.hpp"
+#include "dataset.hpp"
+#include "distance.hpp"
+#include "graph.hpp"
+#include "input-output.hpp"
+#include "kmeans.hpp"
+#include "synthetic.hpp"
+#include "topk.hpp"
+
+using namespace std;
+
+/*
+ * The sizes of the benchmarks.
+ */
+struct bench_params_t {
+	// The points of the synthetic dataset.
+	uint32_t n_points = 100000;
+
+	// The neighbors kept per point.
+	uint32_t k = 100;
+
+	// The clusters of the K-Means iteration.
+	uint32_t n_clusters = 100;
+
+	// The points of the intra-cluster search.
+	uint32_t cluster_size = 8192;
+
+	// Each benchmark reports its best run.
+	uint32_t n_repeats = 5;
+
+	// Where the load and store benchmarks put their files.
+	string directory = "/tmp";
+
+	// Run only the benchmark with this name. Empty runs all of them.
+	string only;
+};
+
+/*
+ * @brief The best wall time of @n_repeats runs of @run, in seconds.
+ */
+static double _best_time(uint32_t n_repeats, const function<void()>& run)
+{
+	double best = numeric_limits<double>::infinity();
+
+	for (uint32_t c_repeat = 0; c_repeat < n_repeats; ++c_repeat) {
+		double start = omp_get_wtime();
+		run();
+		best = min(best, omp_get_wtime() - start);
+	}
+
+	return best;
+}
+
+/*
+ * @brief Print a result, its time and how many operations per second.
+ */
+static void _report(const string& name, double secs, double n_ops, const string& unit)
+{
+	printf("%-16s %10.4f secs %12.2f M%s/s\n", name.c_str(), secs, n_ops / secs / 1e6,
+			unit.c_str());
+}
+
+static void _print_usage(ostream& outstream, const char* program)
+{
+	outstream << "Usage: " << program << " [options]" << endl;
+	outstream << endl;
+	outstream << "Options:" << endl;
+	outstream << "\t--points N             The points of the dataset (100000)." << endl;
+	outstream << "\t--k N                  The neighbors per point (100)." << endl;
+	outstream << "\t--clusters N           The clusters of K-Means (100)." << endl;
+	outstream << "\t--cluster-size N       The points of the cluster search (8192)." << endl;
+	outstream << "\t--repeats N            Report the best of N runs (5)." << endl;
+	outstream << "\t--dir PATH             Where to put the files of load/store." << endl;
+	outstream << "\t--only NAME            Run only one benchmark: distance, topk," << endl;
+	outstream << "\t                       kmeans, search, load or store." << endl;
+}
+
+int main(int argc, char **argv)
+{
+	omp_set_dynamic(0);
+	omp_set_nested(0);
+	omp_set_num_threads(omp_get_num_procs());
+
+	bench_params_t params;
+	synthetic_params_t data_params;
+
+	for (int c_arg = 1; c_arg < argc; ++c_arg) {
+		string arg = argv[c_arg];
+
+		if (c_arg + 1 == argc) {
+			_print_usage(cerr, argv[0]);
+			return 1;
+		}
+
+		const char* value = argv[++c_arg];
+
+		if (arg == "--points")
+			params.n_points = atoll(value);
+		else if (arg == "--k")
+			params.k = atoll(value);
+		else if (arg == "--clusters")
+			params.n_clusters = atoll(value);
+		else if (arg == "--cluster-size")
+			params.cluster_size = atoll(value);
+		else if (arg == "--repeats")
+			params.n_repeats = atoll(value);
+		else if (arg == "--dir")
+			params.directory = value;
+		else if (arg == "--only")
+			params.only = value;
+		else {
+			cerr << "Unknown option " << arg << endl;
+			_print_usage(cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (params.n_points < 2 || params.k == 0 || params.n_clusters == 0) {
+		_print_usage(cerr, argv[0]);
+		return 1;
+	}
+
+	params.cluster_size = min(params.cluster_size, params.n_points);
+
+	auto enabled = [&](const string& name) {
+		return params.only.empty() || params.only == name;
+	};
+
+	dataset_t dataset = synthetic_dataset(params.n_points, data_params);
+	uint32_t n_points = dataset.n_points();
+	uint32_t n_dims = dataset.n_dims();
+
+	cout << "# Points = " << n_points << ", # Dims = " << n_dims
+		<< ", # Threads = " << omp_get_max_threads()
+		<< ", Distance kernels = " << distance_isa() << endl;
+
+	// One distance per point, to a point far away in memory.
+	if (enabled("distance")) {
+		float checksum = 0.0f;
+
+		double secs = _best_time(params.n_repeats, [&]() {
+			float sum = 0.0f;
+
+			#pragma omp parallel for reduction(+: sum)
+			for (uint32_t c_point = 0; c_point < n_points; ++c_point)
+				sum += l2_sqr(dataset.row(c_point),
+						dataset.row((c_point + n_points / 2) % n_points), n_dims);
+
+			checksum = sum;
+		});
+
+		_report("distance", secs, n_points, "dist");
+
+		// Keep the loop from being optimized out.
+		if (checksum < 0.0f) cout << checksum << endl;
+	}
+
+	// Every thread selects the k nearest of the same stream of distances.
+	if (enabled("topk")) {
+		vector<float> stream(1 << 20);
+		mt19937_64 rng(2023);
+		uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		for (float& distance : stream)
+			distance = uniform(rng);
+
+		uint32_t n_threads = omp_get_max_threads();
+
+		double secs = _best_time(params.n_repeats, [&]() {
+			#pragma omp parallel
+			{
+				topk_t topk(params.k);
+				vector<uint32_t> ids(params.k);
+
+				for (size_t c_item = 0; c_item < stream.size(); ++c_item)
+					topk.push(stream[c_item], c_item);
+
+				topk.write(ids.data(), NULL);
+			}
+		});
+
+		_report("topk", secs, (double)stream.size() * n_threads, "push");
+	}
+
+	// Random initialization and one iteration of K-Means over all points.
+	if (enabled("kmeans")) {
+		kmeans_params_t kmeans_params;
+		kmeans_params.n_clusters = params.n_clusters;
+		kmeans_params.n_iters = 1;
+
+		double secs = _best_time(params.n_repeats, [&]() {
+			vector<point_t> points = dataset.points();
+			kmeans_t kmeans(kmeans_params, dataset, points);
+			kmeans.run();
+		});
+
+		_report("kmeans", secs, (double)n_points * params.n_clusters, "dist");
+	}
+
+	// The knn of every point of a cluster among the cluster's points.
+	if (enabled("search")) {
+		vector<uint32_t> members(params.cluster_size);
+		for (uint32_t c_member = 0; c_member < params.cluster_size; ++c_member)
+			members[c_member] = c_member;
+
+		static constexpr uint32_t query_tile = 64;
+
+		double secs = _best_time(params.n_repeats, [&]() {
+			packed_block_t packed(dataset, members.data(), members.size());
+
+			#pragma omp parallel
+			{
+				vector<topk_t> topks;
+				for (uint32_t c_query = 0; c_query < query_tile; ++c_query)
+					topks.emplace_back(params.k);
+
+				vector<uint32_t> ids(params.k);
+
+				#pragma omp for schedule(dynamic)
+				for (size_t tile = 0; tile < members.size(); tile += query_tile) {
+					uint32_t n_queries = min((size_t)query_tile, members.size() - tile);
+
+					knn_search_block(dataset, &members[tile], n_queries, packed,
+							topks.data());
+
+					for (uint32_t c_query = 0; c_query < n_queries; ++c_query)
+						topks[c_query].write(ids.data(), NULL);
+				}
+			}
+		});
+
+		_report("search", secs, (double)params.cluster_size * params.cluster_size, "pair");
+	}
+
+	// Read a dataset file, mapped or copied.
+	if (enabled("load")) {
+		string path = params.directory + "/knng_bench_data.bin";
+
+		try {
+			write_synthetic(path, n_points, data_params);
+		} catch (const runtime_error& error) {
+			cerr << error.what() << endl;
+			return 1;
+		}
+
+		double secs = _best_time(params.n_repeats, [&]() {
+			dataset_t loaded = read_dataset(path, n_dims);
+		});
+
+		_report("load", secs, (double)n_points * n_dims * sizeof(float), "B");
+
+		remove(path.c_str());
+	}
+
+	// Write a knng file.
+	if (enabled("store")) {
+		string path = params.directory + "/knng_bench_output.bin";
+
+		graph_t knng(n_points, params.k);
+
+		#pragma omp parallel for
+		for (uint32_t c_point = 0; c_point < n_points; ++c_point)
+			for (uint32_t c_slot = 0; c_slot < params.k; ++c_slot)
+				knng.row(c_point)[c_slot] = (c_point + 1 + c_slot) % n_points;
+
+		double secs = 0.0;
+
+		try {
+			secs = _best_time(params.n_repeats, [&]() { write_knng(knng, path); });
+		} catch (const runtime_error& error) {
+			cerr << error.what() << endl;
+			return 1;
+		}
+
+		_report("store", secs, (double)n_points * params.k * sizeof(uint32_t), "B");
+
+		remove(path.c_str());
+	}
+
+	return 0;
+}
@@ -0,0 +1,287 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <omp.h>
+#include "knng.hpp"
+#include "point.hpp"
+#include "dataset.hpp"
+#include "config.hpp"
+#include "evaluation.hpp"
+#include "input-output.hpp"
+
+using namespace std;
+
+/*
+ * One parameter of a sweep, an option of the knng and the values it takes.
+ */
+struct sweep_axis_t {
+	// The option, without the leading "--".
+	string name;
+
+	// Its values. "on" and "off" add or omit a flag without a value.
+	vector<string> values;
+};
+
+/*
+ * The result of one configuration of a sweep.
+ */
+struct sweep_row_t {
+	// The value of each axis, same order as the axes.
+	vector<string> values;
+
+	double recall;
+
+	// The time of the PCA, clustering, encoding, search and refinement.
+	double pca, clustering, encoding, search, refinement;
+
+	// The total time of the construction, all its phases.
+	double total;
+};
+
+/*
+ * @brief Parse a sweep specification, e.g. "clusters=8,16,32;probes=1,2".
+ *
+ * @return False if an axis has no name or no values, true otherwise.
+ */
+static bool _parse_sweep(const string& spec, vector<sweep_axis_t>& axes)
+{
+	stringstream axes_stream(spec);
+	string axis_spec;
+
+	while (getline(axes_stream, axis_spec, ';')) {
+		size_t equals = axis_spec.find('=');
+		if (equals == string::npos || equals == 0) return false;
+
+		sweep_axis_t axis;
+		axis.name = axis_spec.substr(0, equals);
+
+		stringstream values_stream(axis_spec.substr(equals + 1));
+		string value;
+		while (getline(values_stream, value, ','))
+			if (!value.empty()) axis.values.push_back(value);
+
+		if (axis.values.empty()) return false;
+
+		axes.push_back(axis);
+	}
+
+	return !axes.empty();
+}
+
+/*
+ * @brief Build the knng with @config and evaluate it.
+ *
+ * @return The recall of the knng on @queries. The phases go to @report.
+ */
+static double _evaluate(const dataset_t& dataset, const config_t& config,
+		const vector<uint32_t>& queries, const graph_t& truth, run_report_t& report)
+{
+	vector<point_t> points = dataset.points();
+	graph_t knng = create_knng(dataset, points, config, &report);
+
+	return recall(knng, queries, truth);
+}
+
+static void _print_usage(ostream& outstream, const char* program)
+{
+	print_usage(outstream, program);
+	outstream << endl;
+	outstream << "Evaluation options:" << endl;
+	outstream << "\t--queries Q            Evaluate on Q sampled points (1000)." << endl;
+	outstream << "\t--graph PATH           Evaluate the knng in PATH instead of" << endl;
+	outstream << "\t                       building one." << endl;
+	outstream << "\t--sweep SPEC           Build and evaluate every combination of" << endl;
+	outstream << "\t                       e.g. \"clusters=8,16;probes=1,2\". Flags" << endl;
+	outstream << "\t                       take on or off, e.g. \"refine=off,on\"." << endl;
+	outstream << "\t--csv PATH             Where to write the sweep (stdout)." << endl;
+}
+
+int main(int argc, char **argv)
+{
+	// Same threading as the knng itself.
+	omp_set_dynamic(0);
+	omp_set_nested(0);
+	omp_set_num_threads(omp_get_num_procs());
+
+	uint32_t n_queries = 1000;
+	string graph_path, sweep_spec, csv_path;
+
+	// The options of the knng, passed to parse_config() for every run.
+	vector<string> knng_args;
+
+	for (int c_arg = 1; c_arg < argc; ++c_arg) {
+		string arg = argv[c_arg];
+		bool has_value = (c_arg + 1 < argc);
+
+		if (arg == "--queries" && has_value)
+			n_queries = atoll(argv[++c_arg]);
+		else if (arg == "--graph" && has_value)
+			graph_path = argv[++c_arg];
+		else if (arg == "--sweep" && has_value)
+			sweep_spec = argv[++c_arg];
+		else if (arg == "--csv" && has_value)
+			csv_path = argv[++c_arg];
+		else
+			knng_args.push_back(arg);
+	}
+
+	vector<sweep_axis_t> axes;
+	if (!sweep_spec.empty() && !_parse_sweep(sweep_spec, axes)) {
+		cerr << "Invalid sweep " << sweep_spec << endl;
+		return 1;
+	}
+
+	/*
+	 * Parses the options of a run, the common ones followed by @extra.
+	 * parse_config() takes a mutable argv, like main().
+	 */
+	auto parse = [&](const vector<string>& extra, config_t& config) {
+		vector<string> args = knng_args;
+		args.insert(args.end(), extra.begin(), extra.end());
+
+		vector<char*> run_argv(1, argv[0]);
+		for (string& arg : args)
+			run_argv.push_back(&arg[0]);
+
+		return parse_config(run_argv.size(), run_argv.data(), config);
+	};
+
+	config_t config;
+
+	if (!parse({}, config)) {
+		_print_usage(cerr, argv[0]);
+		return 1;
+	}
+
+	double start = omp_get_wtime();
+	dataset_t dataset = read_dataset(config.dataset_path, config.n_dims);
+	double load_time = omp_get_wtime() - start;
+
+	if (dataset.n_points() == 0) {
+		cerr << "No points could be read from " << config.dataset_path << endl;
+		return 1;
+	}
+
+	cerr << "Dataset path = " << config.dataset_path << endl;
+	cerr << "# Points = " << dataset.n_points() << endl;
+	cerr << "Load time = " << load_time << " secs" << endl;
+
+	// The ground truth, shared by every run.
+	start = omp_get_wtime();
+	vector<uint32_t> queries = sample_queries(dataset.n_points(), n_queries, config.seed);
+	graph_t truth = exact_knn(dataset, queries, config.k);
+
+	cerr << "# Queries = " << queries.size() << endl;
+	cerr << "Ground truth time = " << omp_get_wtime() - start << " secs" << endl;
+
+	// Evaluate a saved knng.
+	if (!graph_path.empty()) {
+		try {
+			graph_t knng = read_knng(graph_path, dataset.n_points(), config.k);
+			cout << "Recall@" << config.k << " = " << recall(knng, queries, truth) << endl;
+		} catch (const runtime_error& error) {
+			cerr << error.what() << endl;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// Build and evaluate a single configuration.
+	if (axes.empty()) {
+		run_report_t report;
+		double result = _evaluate(dataset, config, queries, truth, report);
+
+		cout << "Recall@" << config.k << " = " << result << endl;
+		cout << "PCA time = " << report.wall("pca") << " secs" << endl;
+		cout << "Clustering time = " << report.wall("clustering") << " secs" << endl;
+		cout << "Encoding time = " << report.wall("encoding") << " secs" << endl;
+		cout << "Search time = " << report.wall("search") << " secs" << endl;
+		cout << "Refinement time = " << report.wall("refinement") << " secs" << endl;
+		cout << "Total time = " << report.total_wall() << " secs" << endl;
+
+		if (!config.report_path.empty()) {
+			ofstream report_file(config.report_path);
+			write_report(report, report_file);
+		}
+
+		return 0;
+	}
+
+	// Sweep every combination of the axes, the last axis varies fastest.
+	vector<sweep_row_t> rows;
+	vector<size_t> indexes(axes.size(), 0);
+
+	while (true) {
+		sweep_row_t row;
+		vector<string> extra;
+
+		for (size_t c_axis = 0; c_axis < axes.size(); ++c_axis) {
+			const string& value = axes[c_axis].values[indexes[c_axis]];
+
+			row.values.push_back(value);
+
+			if (value == "off") continue;
+
+			extra.push_back("--" + axes[c_axis].name);
+			if (value != "on") extra.push_back(value);
+		}
+
+		config_t run_config;
+
+		if (!parse(extra, run_config)) {
+			_print_usage(cerr, argv[0]);
+			return 1;
+		}
+
+		run_report_t report;
+		row.recall = _evaluate(dataset, run_config, queries, truth, report);
+		row.pca = report.wall("pca");
+		row.clustering = report.wall("clustering");
+		row.encoding = report.wall("encoding");
+		row.search = report.wall("search");
+		row.refinement = report.wall("refinement");
+		row.total = report.total_wall();
+		rows.push_back(row);
+
+		cerr << "Run " << rows.size() << ": recall = " << row.recall
+			<< ", time = " << row.total << " secs" << endl;
+
+		// Next combination, like an odometer.
+		size_t c_axis = axes.size();
+		while (c_axis > 0 && ++indexes[c_axis - 1] == axes[c_axis - 1].values.size())
+			indexes[--c_axis] = 0;
+
+		if (c_axis == 0) break;
+	}
+
+	ofstream csv_file;
+	if (!csv_path.empty()) csv_file.open(csv_path);
+	ostream& csv = csv_path.empty() ? cout : csv_file;
+
+	for (const sweep_axis_t& axis : axes)
+		csv << axis.name << ',';
+	csv << "recall,pca_secs,clustering_secs,encoding_secs,search_secs,refinement_secs,"
+		<< "total_secs,pareto" << endl;
+
+	for (const sweep_row_t& row : rows) {
+		// On the front unless another run is as fast and as accurate, and
+		// strictly better in one of the two.
+		bool pareto = true;
+		for (const sweep_row_t& other : rows)
+			if (other.total <= row.total && other.recall >= row.recall
+					&& (other.total < row.total || other.recall > row.recall))
+				pareto = false;
+
+		for (const string& value : row.values)
+			csv << value << ',';
+		csv << row.recall << ',' << row.pca << ',' << row.clustering << ',' << row.encoding
+			<< ',' << row.search << ',' << row.refinement << ',' << row.total << ','
+			<< pareto << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <omp.h>
+#include "synthetic.hpp"
+
+using namespace std;
+
+static void _print_usage(ostream& outstream, const char* program)
+{
+	outstream << "Usage: " << program << " [path] [# points] [options]" << endl;
+	outstream << endl;
+	outstream << "Options:" << endl;
+	outstream << "\t--dims N               The dimension of each point (100)." << endl;
+	outstream << "\t--clusters N           The number of centers, 0 is uniform (100)." << endl;
+	outstream << "\t--spread S             The deviation around a center (0.05)." << endl;
+	outstream << "\t--duplicates F         The fraction of duplicate points (0)." << endl;
+	outstream << "\t--seed N               The seed of the generator." << endl;
+}
+
+int main(int argc, char **argv)
+{
+	omp_set_dynamic(0);
+	omp_set_num_threads(omp_get_num_procs());
+
+	if (argc < 3) {
+		_print_usage(cerr, argv[0]);
+		return 1;
+	}
+
+	string path = argv[1];
+	uint32_t n_points = atoll(argv[2]);
+	synthetic_params_t params;
+
+	for (int c_arg = 3; c_arg < argc; ++c_arg) {
+		string arg = argv[c_arg];
+
+		if (c_arg + 1 == argc) {
+			cerr << "Missing value of " << arg << endl;
+			_print_usage(cerr, argv[0]);
+			return 1;
+		}
+
+		const char* value = argv[++c_arg];
+
+		if (arg == "--dims")
+			params.n_dims = atoll(value);
+		else if (arg == "--clusters")
+			params.n_clusters = atoll(value);
+		else if (arg == "--spread")
+			params.spread = atof(value);
+		else if (arg == "--duplicates")
+			params.duplicates = atof(value);
+		else if (arg == "--seed")
+			params.seed = strtoull(value, NULL, 10);
+		else {
+			cerr << "Unknown option " << arg << endl;
+			_print_usage(cerr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (params.n_dims == 0) {
+		cerr << "The dimension must be positive" << endl;
+		return 1;
+	}
+
+	try {
+		write_synthetic(path, n_points, params);
+	} catch (const runtime_error& error) {
+		cerr << error.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}